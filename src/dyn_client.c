@@ -163,7 +163,8 @@ client_close(struct context *ctx, struct conn *conn)
         /* dequeue the message (request) from client outq */
         conn->dequeue_outq(ctx, conn, msg);
 
-        if (msg->done) {
+        if (msg->done || msg->rspmgr != NULL) {
+            /* a request waiting on its replicas is not in any server q */
             log_debug(LOG_INFO, "close c %d discarding %s req %"PRIu64" len "
                       "%"PRIu32" type %d", conn->sd,
                       msg->error ? "error": "completed", msg->id, msg->mlen,
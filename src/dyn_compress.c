@@ -0,0 +1,332 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#include <zlib.h>
+
+#include "dyn_core.h"
+#include "dyn_compress.h"
+#include "dyn_dnode_msg.h"
+
+
+/* copy len bytes to the tail of mhdr, taking pooled mbufs as needed */
+static rstatus_t
+mhdr_append(struct mhdr *mhdr, uint8_t *pos, size_t len)
+{
+	struct mbuf *mbuf;
+	size_t n;
+
+	while (len > 0) {
+		mbuf = STAILQ_LAST(mhdr, mbuf, next);
+		if (mbuf == NULL || mbuf_full(mbuf)) {
+			mbuf = mbuf_get();
+			if (mbuf == NULL) {
+				return DN_ENOMEM;
+			}
+			mbuf_insert(mhdr, mbuf);
+		}
+
+		n = MIN(len, mbuf_size(mbuf));
+		mbuf_copy(mbuf, pos, n);
+		pos += n;
+		len -= n;
+	}
+
+	return DN_OK;
+}
+
+
+static void
+mhdr_put(struct mhdr *mhdr)
+{
+	struct mbuf *mbuf;
+
+	while (!STAILQ_EMPTY(mhdr)) {
+		mbuf = STAILQ_FIRST(mhdr);
+		mbuf_remove(mhdr, mbuf);
+		mbuf_put(mbuf);
+	}
+}
+
+
+/*
+ * Raw deflate (no zlib header) of the payload of a cross-DC msg into pooled
+ * mbufs that replace the msg's own. Returns DN_NOOPS when the peer has not
+ * asked for compressed payloads, the payload is below
+ * dyn_compress_threshold, or it would not shrink.
+ */
+rstatus_t
+dyn_compress_msg(struct conn *conn, struct msg *msg)
+{
+	struct mhdr out;
+	struct mbuf *mbuf, *obuf;
+	uint32_t threshold, len;
+	int flush, ret;
+	z_stream *zs;
+
+	threshold = dnode_compress_threshold();
+	if (!conn->dnode_compress || threshold == 0 || msg_length(msg) < threshold) {
+		return DN_NOOPS;
+	}
+
+	len = 0;
+	STAILQ_FOREACH(mbuf, &msg->mhdr, next) {
+		len += mbuf_length(mbuf);
+	}
+
+	zs = conn->zdeflate;
+	if (zs == NULL) {
+		zs = dn_zalloc(sizeof(*zs));
+		if (zs == NULL) {
+			return DN_ENOMEM;
+		}
+
+		if (deflateInit2(zs, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8,
+						 Z_DEFAULT_STRATEGY) != Z_OK) {
+			dn_free(zs);
+			return DN_ENOMEM;
+		}
+		conn->zdeflate = zs;
+	} else if (deflateReset(zs) != Z_OK) {
+		return DN_ERROR;
+	}
+
+	STAILQ_INIT(&out);
+	obuf = NULL;
+	ret = Z_OK;
+
+	STAILQ_FOREACH(mbuf, &msg->mhdr, next) {
+		zs->next_in = mbuf->pos;
+		zs->avail_in = mbuf_length(mbuf);
+		flush = (STAILQ_NEXT(mbuf, next) == NULL) ? Z_FINISH : Z_NO_FLUSH;
+
+		do {
+			if (obuf == NULL || mbuf_full(obuf)) {
+				if (zs->total_out >= len) {
+					goto noops;
+				}
+
+				obuf = mbuf_get();
+				if (obuf == NULL) {
+					mhdr_put(&out);
+					return DN_ENOMEM;
+				}
+				mbuf_insert(&out, obuf);
+			}
+
+			zs->next_out = obuf->last;
+			zs->avail_out = mbuf_size(obuf);
+			ret = deflate(zs, flush);
+			obuf->last = zs->next_out;
+		} while (zs->avail_out == 0);
+	}
+
+	if (ret != Z_STREAM_END) {
+		log_debug(LOG_VERB, "deflate failed on msg %"PRIu64" with %d", msg->id, ret);
+		mhdr_put(&out);
+		return DN_ERROR;
+	}
+
+	if (zs->total_out >= len) {
+		goto noops;
+	}
+
+	if (log_loggable(LOG_VERB)) {
+		log_debug(LOG_VERB, "deflated msg %"PRIu64" from %"PRIu32" to %lu bytes on c %d",
+				  msg->id, len, zs->total_out, conn->sd);
+	}
+
+	/* a request may still be cloned and its keys read, as for encryption */
+	if (msg->request && STAILQ_EMPTY(&msg->plain)) {
+		STAILQ_CONCAT(&msg->plain, &msg->mhdr);
+	} else {
+		mhdr_put(&msg->mhdr);
+	}
+	STAILQ_CONCAT(&msg->mhdr, &out);
+	msg->pos = obuf->last;
+
+	return DN_OK;
+
+noops:
+	mhdr_put(&out);
+	return DN_NOOPS;
+}
+
+
+/*
+ * Inflate the complete payload of r. The compressed bytes are dropped from r
+ * and the inflated ones, followed by whatever was received after the
+ * payload, are queued on conn->inflate_q ahead of anything already there, to
+ * be parsed as if they had just come off the socket.
+ */
+rstatus_t
+dyn_inflate_payload(struct conn *conn, struct msg *r)
+{
+	struct dmsg *dmsg = r->dmsg;
+	struct mhdr out;
+	struct mbuf *mbuf, *nbuf, *obuf, *pbuf;
+	uint32_t left, n, removed;
+	uint8_t *p;
+	int ret;
+	z_stream *zs;
+
+	STAILQ_FOREACH(pbuf, &r->mhdr, next) {
+		if (dmsg->payload >= pbuf->pos && dmsg->payload <= pbuf->last) {
+			break;
+		}
+	}
+
+	if (pbuf == NULL) {
+		return DN_ERROR;
+	}
+
+	zs = conn->zinflate;
+	if (zs == NULL) {
+		zs = dn_zalloc(sizeof(*zs));
+		if (zs == NULL) {
+			return DN_ENOMEM;
+		}
+
+		if (inflateInit2(zs, -MAX_WBITS) != Z_OK) {
+			dn_free(zs);
+			return DN_ENOMEM;
+		}
+		conn->zinflate = zs;
+	} else if (inflateReset(zs) != Z_OK) {
+		return DN_ERROR;
+	}
+
+	STAILQ_INIT(&out);
+	obuf = NULL;
+	ret = Z_OK;
+	left = dmsg->plen;
+	removed = 0;
+
+	for (mbuf = pbuf, p = dmsg->payload; mbuf != NULL; mbuf = nbuf) {
+		nbuf = STAILQ_NEXT(mbuf, next);
+
+		n = MIN(left, (uint32_t)(mbuf->last - p));
+		zs->next_in = p;
+		zs->avail_in = n;
+
+		while (ret != Z_STREAM_END && (zs->avail_in > 0 || obuf == NULL || mbuf_full(obuf))) {
+			if (obuf == NULL || mbuf_full(obuf)) {
+				obuf = mbuf_get();
+				if (obuf == NULL) {
+					goto enomem;
+				}
+				mbuf_insert(&out, obuf);
+			}
+
+			zs->next_out = obuf->last;
+			zs->avail_out = mbuf_size(obuf);
+			ret = inflate(zs, Z_NO_FLUSH);
+			obuf->last = zs->next_out;
+
+			if (ret == Z_BUF_ERROR) {
+				/* needs the rest of the payload */
+				break;
+			}
+
+			if (ret != Z_OK && ret != Z_STREAM_END) {
+				goto error;
+			}
+		}
+
+		p += n;
+		left -= n;
+		removed += n;
+
+		/* anything past the payload belongs to the msgs behind r */
+		if (left == 0 && p < mbuf->last) {
+			if (mhdr_append(&out, p, (size_t)(mbuf->last - p)) != DN_OK) {
+				goto enomem;
+			}
+			removed += (uint32_t)(mbuf->last - p);
+		}
+
+		if (nbuf != NULL) {
+			p = nbuf->pos;
+		}
+	}
+
+	if (ret != Z_STREAM_END) {
+		goto error;
+	}
+
+	if (log_loggable(LOG_VERB)) {
+		log_debug(LOG_VERB, "inflated dmsg %"PRIu64" from %"PRIu32" to %lu bytes on c %d",
+				  dmsg->id, dmsg->plen, zs->total_out, conn->sd);
+	}
+
+	pbuf->last = dmsg->payload;
+	while ((mbuf = STAILQ_NEXT(pbuf, next)) != NULL) {
+		mbuf_remove(&r->mhdr, mbuf);
+		mbuf_put(mbuf);
+	}
+	r->pos = pbuf->last;
+	r->mlen -= removed;
+
+	STAILQ_CONCAT(&out, &conn->inflate_q);
+	STAILQ_CONCAT(&conn->inflate_q, &out);
+
+	return DN_OK;
+
+enomem:
+	mhdr_put(&out);
+	return DN_ENOMEM;
+
+error:
+	log_debug(LOG_VERB, "inflate failed on dmsg %"PRIu64" with %d", dmsg->id, ret);
+	mhdr_put(&out);
+	return DN_ERROR;
+}
+
+
+/*
+ * Receive into buf from conn->inflate_q instead of the socket. Returns the
+ * # of bytes copied.
+ */
+ssize_t
+dyn_inflate_q_recv(struct conn *conn, uint8_t *buf, size_t size)
+{
+	struct mbuf *mbuf;
+	size_t n, copied = 0;
+
+	while (copied < size && !STAILQ_EMPTY(&conn->inflate_q)) {
+		mbuf = STAILQ_FIRST(&conn->inflate_q);
+
+		n = MIN(size - copied, mbuf_length(mbuf));
+		dn_memcpy(buf + copied, mbuf->pos, n);
+		mbuf->pos += n;
+		copied += n;
+
+		if (mbuf_empty(mbuf)) {
+			mbuf_remove(&conn->inflate_q, mbuf);
+			mbuf_put(mbuf);
+		}
+	}
+
+	return (ssize_t)copied;
+}
+
+
+void
+dyn_compress_conn_deinit(struct conn *conn)
+{
+	if (conn->zdeflate != NULL) {
+		deflateEnd(conn->zdeflate);
+		dn_free(conn->zdeflate);
+		conn->zdeflate = NULL;
+	}
+
+	if (conn->zinflate != NULL) {
+		inflateEnd(conn->zinflate);
+		dn_free(conn->zinflate);
+		conn->zinflate = NULL;
+	}
+
+	mhdr_put(&conn->inflate_q);
+	conn->dnode_compress = 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#ifndef DYN_COMPRESS_H_
+#define DYN_COMPRESS_H_
+
+
+#include "dyn_core.h"
+
+
+rstatus_t dyn_compress_msg(struct conn *conn, struct msg *msg);
+rstatus_t dyn_inflate_payload(struct conn *conn, struct msg *r);
+ssize_t dyn_inflate_q_recv(struct conn *conn, uint8_t *buf, size_t size);
+void dyn_compress_conn_deinit(struct conn *conn);
+
+
+#endif /* DYN_COMPRESS_H_ */
@@ -50,6 +50,13 @@ static struct string dist_strings[] = {
 };
 #undef DEFINE_ACTION
 
+#define DEFINE_ACTION(_cons, _name) string(#_name),
+static struct string consistency_strings[] = {
+    CONSISTENCY_CODEC( DEFINE_ACTION )
+    null_string
+};
+#undef DEFINE_ACTION
+
 static struct command conf_commands[] = {
     { string("listen"),
       conf_set_listen,
@@ -167,6 +174,70 @@ static struct command conf_commands[] = {
       conf_set_num,
       offsetof(struct conf_pool, conn_msg_rate)},
 
+    { string("conn_byte_rate"),
+      conf_set_num,
+      offsetof(struct conf_pool, conn_byte_rate)},
+
+    { string("local_conn_msg_rate"),
+      conf_set_num,
+      offsetof(struct conf_pool, local_conn_msg_rate)},
+
+    { string("local_conn_byte_rate"),
+      conf_set_num,
+      offsetof(struct conf_pool, local_conn_byte_rate)},
+
+    { string("dyn_batch_size"),
+      conf_set_num,
+      offsetof(struct conf_pool, dyn_batch_size)},
+
+    { string("dyn_compress_threshold"),
+      conf_set_num,
+      offsetof(struct conf_pool, dyn_compress_threshold)},
+
+    { string("read_consistency"),
+      conf_set_consistency,
+      offsetof(struct conf_pool, read_consistency)},
+
+    { string("write_consistency"),
+      conf_set_consistency,
+      offsetof(struct conf_pool, write_consistency)},
+
+    { string("read_hedge_percentile"),
+      conf_set_num,
+      offsetof(struct conf_pool, read_hedge_percentile)},
+
+    { string("dyn_snitch"),
+      conf_set_bool,
+      offsetof(struct conf_pool, dyn_snitch)},
+
+    { string("queue_high_watermark"),
+      conf_set_num,
+      offsetof(struct conf_pool, queue_high_watermark)},
+
+    { string("queue_low_watermark"),
+      conf_set_num,
+      offsetof(struct conf_pool, queue_low_watermark)},
+
+    { string("msg_pool_max"),
+      conf_set_num,
+      offsetof(struct conf_pool, msg_pool_max)},
+
+    { string("dmsg_pool_max"),
+      conf_set_num,
+      offsetof(struct conf_pool, dmsg_pool_max)},
+
+    { string("conn_pool_max"),
+      conf_set_num,
+      offsetof(struct conf_pool, conn_pool_max)},
+
+    { string("near_cache_size"),
+      conf_set_num,
+      offsetof(struct conf_pool, near_cache_size)},
+
+    { string("near_cache_ttl"),
+      conf_set_num,
+      offsetof(struct conf_pool, near_cache_ttl)},
+
     null_command
 };
 
@@ -242,6 +313,10 @@ conf_server_each_transform(void *elem, void *data)
 
     s->next_retry = 0LL;
     s->failure_count = 0;
+    s->latency = 0LL;
+    s->latency_at = 0LL;
+    s->outstanding = 0;
+    s->overloaded = 0;
 
     log_debug(LOG_VERB, "transform to server %"PRIu32" '%.*s'",
               s->idx, s->pname.len, s->pname.data);
@@ -291,6 +366,10 @@ conf_seed_each_transform(void *elem, void *data)
 
     s->next_retry = 0LL;
     s->failure_count = 0;
+    s->latency = 0LL;
+    s->latency_at = 0LL;
+    s->outstanding = 0;
+    s->overloaded = 0;
 
     s->processed = 0;
     s->is_seed = 1;
@@ -355,6 +434,22 @@ conf_pool_init(struct conf_pool *cp, struct string *name)
     cp->gos_interval = CONF_UNSET_NUM;
 
     cp->conn_msg_rate = CONF_UNSET_NUM;
+    cp->conn_byte_rate = CONF_UNSET_NUM;
+    cp->local_conn_msg_rate = CONF_UNSET_NUM;
+    cp->local_conn_byte_rate = CONF_UNSET_NUM;
+    cp->dyn_batch_size = CONF_UNSET_NUM;
+    cp->dyn_compress_threshold = CONF_UNSET_NUM;
+    cp->read_consistency = CONF_UNSET_CONSISTENCY;
+    cp->write_consistency = CONF_UNSET_CONSISTENCY;
+    cp->read_hedge_percentile = CONF_UNSET_NUM;
+    cp->dyn_snitch = CONF_UNSET_NUM;
+    cp->queue_high_watermark = CONF_UNSET_NUM;
+    cp->queue_low_watermark = CONF_UNSET_NUM;
+    cp->msg_pool_max = CONF_UNSET_NUM;
+    cp->dmsg_pool_max = CONF_UNSET_NUM;
+    cp->conn_pool_max = CONF_UNSET_NUM;
+    cp->near_cache_size = CONF_UNSET_NUM;
+    cp->near_cache_ttl = CONF_UNSET_NUM;
 
     array_null(&cp->server);
     array_null(&cp->dyn_seeds);
@@ -507,7 +602,29 @@ conf_pool_each_transform(void *elem, void *data)
     /* gossip */
     sp->g_interval = cp->gos_interval;
 
-    set_msgs_per_sec(cp->conn_msg_rate);
+    sp->read_consistency = cp->read_consistency;
+    sp->write_consistency = cp->write_consistency;
+    sp->read_hedge_percentile = cp->read_hedge_percentile;
+    sp->read_hedge_delay = 0;
+    sp->read_hedge_refresh = 0;
+    sp->dyn_snitch = cp->dyn_snitch ? 1 : 0;
+    sp->queue_high_watermark = (uint32_t)cp->queue_high_watermark;
+    sp->queue_low_watermark = (uint32_t)cp->queue_low_watermark;
+    sp->clients_paused = 0;
+
+    set_msgs_per_sec(false, (uint32_t)cp->conn_msg_rate);
+    set_bytes_per_sec(false, (uint32_t)cp->conn_byte_rate);
+    set_msgs_per_sec(true, (uint32_t)cp->local_conn_msg_rate);
+    set_bytes_per_sec(true, (uint32_t)cp->local_conn_byte_rate);
+    set_dnode_batch_size((uint32_t)cp->dyn_batch_size);
+    set_dnode_compress_threshold((uint32_t)cp->dyn_compress_threshold);
+    msg_set_pool_max((uint32_t)cp->msg_pool_max);
+    dmsg_set_pool_max((uint32_t)cp->dmsg_pool_max);
+    conn_set_pool_max((uint32_t)cp->conn_pool_max);
+    mbuf_set_ref_pool_max((uint32_t)cp->msg_pool_max);
+    /* a cached reply is as good as one replica's, so only dc_one reads use it */
+    ncache_set_budget((cp->read_consistency == DC_ONE) ? (size_t)cp->near_cache_size : 0,
+                      cp->near_cache_ttl);
 
     log_debug(LOG_VERB, "transform to pool %"PRIu32" '%.*s'", sp->idx,
               sp->name.len, sp->name.data);
@@ -582,6 +699,22 @@ conf_dump(struct conf *cf)
 
         log_debug(LOG_VVERB, "  gos_interval: %d", cp->gos_interval);
         log_debug(LOG_VVERB, "  conn_msg_rate: %d", cp->conn_msg_rate);
+        log_debug(LOG_VVERB, "  conn_byte_rate: %d", cp->conn_byte_rate);
+        log_debug(LOG_VVERB, "  local_conn_msg_rate: %d", cp->local_conn_msg_rate);
+        log_debug(LOG_VVERB, "  local_conn_byte_rate: %d", cp->local_conn_byte_rate);
+        log_debug(LOG_VVERB, "  dyn_batch_size: %d", cp->dyn_batch_size);
+        log_debug(LOG_VVERB, "  dyn_compress_threshold: %d", cp->dyn_compress_threshold);
+        log_debug(LOG_VVERB, "  read_consistency: %d", cp->read_consistency);
+        log_debug(LOG_VVERB, "  write_consistency: %d", cp->write_consistency);
+        log_debug(LOG_VVERB, "  read_hedge_percentile: %d", cp->read_hedge_percentile);
+        log_debug(LOG_VVERB, "  dyn_snitch: %d", cp->dyn_snitch);
+        log_debug(LOG_VVERB, "  queue_high_watermark: %d", cp->queue_high_watermark);
+        log_debug(LOG_VVERB, "  queue_low_watermark: %d", cp->queue_low_watermark);
+        log_debug(LOG_VVERB, "  msg_pool_max: %d", cp->msg_pool_max);
+        log_debug(LOG_VVERB, "  dmsg_pool_max: %d", cp->dmsg_pool_max);
+        log_debug(LOG_VVERB, "  conn_pool_max: %d", cp->conn_pool_max);
+        log_debug(LOG_VVERB, "  near_cache_size: %d", cp->near_cache_size);
+        log_debug(LOG_VVERB, "  near_cache_ttl: %d", cp->near_cache_ttl);
 
         log_debug(LOG_VVERB, "  secure_server_option: \"%.*s\"",
                               cp->secure_server_option.len,
@@ -1514,6 +1647,116 @@ conf_validate_pool(struct conf *cf, struct conf_pool *cp)
 
     if (cp->conn_msg_rate == CONF_UNSET_NUM) {
         cp->conn_msg_rate = CONF_DEFAULT_CONN_MSG_RATE;
+    } else if (cp->conn_msg_rate < 0) {
+        log_error("conf: directive \"conn_msg_rate:\" must be >= 0");
+        return DN_ERROR;
+    }
+
+    if (cp->conn_byte_rate == CONF_UNSET_NUM) {
+        cp->conn_byte_rate = CONF_DEFAULT_CONN_BYTE_RATE;
+    } else if (cp->conn_byte_rate < 0) {
+        log_error("conf: directive \"conn_byte_rate:\" must be >= 0");
+        return DN_ERROR;
+    }
+
+    if (cp->local_conn_msg_rate == CONF_UNSET_NUM) {
+        cp->local_conn_msg_rate = CONF_DEFAULT_LOCAL_CONN_MSG_RATE;
+    } else if (cp->local_conn_msg_rate < 0) {
+        log_error("conf: directive \"local_conn_msg_rate:\" must be >= 0");
+        return DN_ERROR;
+    }
+
+    if (cp->local_conn_byte_rate == CONF_UNSET_NUM) {
+        cp->local_conn_byte_rate = CONF_DEFAULT_LOCAL_CONN_BYTE_RATE;
+    } else if (cp->local_conn_byte_rate < 0) {
+        log_error("conf: directive \"local_conn_byte_rate:\" must be >= 0");
+        return DN_ERROR;
+    }
+
+    if (cp->dyn_batch_size == CONF_UNSET_NUM) {
+        cp->dyn_batch_size = CONF_DEFAULT_DYN_BATCH_SIZE;
+    } else if (cp->dyn_batch_size <= 0 ||
+               cp->dyn_batch_size > CONF_MAX_DYN_BATCH_SIZE) {
+        log_error("conf: directive \"dyn_batch_size:\" must be between 1 and %d",
+                  CONF_MAX_DYN_BATCH_SIZE);
+        return DN_ERROR;
+    }
+
+    if (cp->dyn_compress_threshold == CONF_UNSET_NUM) {
+        cp->dyn_compress_threshold = CONF_DEFAULT_DYN_COMPRESS_THRESHOLD;
+    } else if (cp->dyn_compress_threshold < 0) {
+        log_error("conf: directive \"dyn_compress_threshold:\" must be >= 0");
+        return DN_ERROR;
+    }
+
+    if (cp->read_consistency == CONF_UNSET_CONSISTENCY) {
+        cp->read_consistency = CONF_DEFAULT_CONSISTENCY;
+    }
+
+    if (cp->write_consistency == CONF_UNSET_CONSISTENCY) {
+        cp->write_consistency = CONF_DEFAULT_CONSISTENCY;
+    }
+
+    if (cp->read_hedge_percentile == CONF_UNSET_NUM) {
+        cp->read_hedge_percentile = CONF_DEFAULT_READ_HEDGE_PERCENTILE;
+    } else if (cp->read_hedge_percentile < 0 || cp->read_hedge_percentile > 99) {
+        log_error("conf: directive \"read_hedge_percentile:\" must be between 0 and 99");
+        return DN_ERROR;
+    }
+
+    if (cp->dyn_snitch == CONF_UNSET_NUM) {
+        cp->dyn_snitch = CONF_DEFAULT_DYN_SNITCH;
+    }
+
+    if (cp->queue_high_watermark == CONF_UNSET_NUM) {
+        cp->queue_high_watermark = CONF_DEFAULT_QUEUE_HIGH_WATERMARK;
+    } else if (cp->queue_high_watermark < 0) {
+        log_error("conf: directive \"queue_high_watermark:\" must be positive or 0");
+        return DN_ERROR;
+    }
+
+    if (cp->queue_low_watermark == CONF_UNSET_NUM) {
+        cp->queue_low_watermark = cp->queue_high_watermark / 4 * 3;
+    } else if (cp->queue_low_watermark < 0 ||
+               (cp->queue_high_watermark > 0 &&
+                cp->queue_low_watermark >= cp->queue_high_watermark)) {
+        log_error("conf: directive \"queue_low_watermark:\" must be below queue_high_watermark");
+        return DN_ERROR;
+    }
+
+    if (cp->msg_pool_max == CONF_UNSET_NUM) {
+        cp->msg_pool_max = CONF_DEFAULT_MSG_POOL_MAX;
+    } else if (cp->msg_pool_max < 0) {
+        log_error("conf: directive \"msg_pool_max:\" must be positive or 0");
+        return DN_ERROR;
+    }
+
+    if (cp->dmsg_pool_max == CONF_UNSET_NUM) {
+        cp->dmsg_pool_max = CONF_DEFAULT_DMSG_POOL_MAX;
+    } else if (cp->dmsg_pool_max < 0) {
+        log_error("conf: directive \"dmsg_pool_max:\" must be positive or 0");
+        return DN_ERROR;
+    }
+
+    if (cp->conn_pool_max == CONF_UNSET_NUM) {
+        cp->conn_pool_max = CONF_DEFAULT_CONN_POOL_MAX;
+    } else if (cp->conn_pool_max < 0) {
+        log_error("conf: directive \"conn_pool_max:\" must be positive or 0");
+        return DN_ERROR;
+    }
+
+    if (cp->near_cache_size == CONF_UNSET_NUM) {
+        cp->near_cache_size = CONF_DEFAULT_NEAR_CACHE_SIZE;
+    } else if (cp->near_cache_size < 0) {
+        log_error("conf: directive \"near_cache_size:\" must be positive or 0");
+        return DN_ERROR;
+    }
+
+    if (cp->near_cache_ttl == CONF_UNSET_NUM) {
+        cp->near_cache_ttl = CONF_DEFAULT_NEAR_CACHE_TTL;
+    } else if (cp->near_cache_ttl <= 0) {
+        log_error("conf: directive \"near_cache_ttl:\" must be positive");
+        return DN_ERROR;
     }
 
     if (string_empty(&cp->rack)) {
@@ -2276,6 +2519,35 @@ conf_set_distribution(struct conf *cf, struct command *cmd, void *conf)
     return "is not a valid distribution";
 }
 
+char *
+conf_set_consistency(struct conf *cf, struct command *cmd, void *conf)
+{
+    uint8_t *p;
+    consistency_t *cp;
+    struct string *value, *cons;
+
+    p = conf;
+    cp = (consistency_t *)(p + cmd->offset);
+
+    if (*cp != CONF_UNSET_CONSISTENCY) {
+        return "is a duplicate";
+    }
+
+    value = array_top(&cf->arg);
+
+    for (cons = consistency_strings; cons->len != 0; cons++) {
+        if (string_compare(value, cons) != 0) {
+            continue;
+        }
+
+        *cp = cons - consistency_strings;
+
+        return CONF_OK;
+    }
+
+    return "is not a valid consistency";
+}
+
 char *
 conf_set_hashtag(struct conf *cf, struct command *cmd, void *conf)
 {
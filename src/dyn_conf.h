@@ -46,6 +46,7 @@
 #define CONF_UNSET_PTR  NULL
 #define CONF_UNSET_HASH (hash_type_t) -1
 #define CONF_UNSET_DIST (dist_type_t) -1
+#define CONF_UNSET_CONSISTENCY (consistency_t) -1
 
 #define CONF_DEFAULT_HASH                    HASH_MURMUR
 #define CONF_DEFAULT_DIST                    DIST_VNODE
@@ -68,7 +69,22 @@
 #define CONF_DEFAULT_GOS_INTERVAL            30000  //in millisec
 #define CONF_DEFAULT_PEERS                   200
 
-#define CONF_DEFAULT_CONN_MSG_RATE           50000   //conn msgs per sec
+#define CONF_DEFAULT_CONN_MSG_RATE           50000   //cross-DC conn msgs per sec, 0 is unlimited
+#define CONF_DEFAULT_CONN_BYTE_RATE          0       //cross-DC conn bytes per sec, 0 is unlimited
+#define CONF_DEFAULT_LOCAL_CONN_MSG_RATE     0       //same-DC conn msgs per sec, 0 is unlimited
+#define CONF_DEFAULT_LOCAL_CONN_BYTE_RATE    0       //same-DC conn bytes per sec, 0 is unlimited
+#define CONF_DEFAULT_DYN_BATCH_SIZE          1       //peer reqs per dnode frame
+#define CONF_MAX_DYN_BATCH_SIZE              1024
+#define CONF_DEFAULT_DYN_COMPRESS_THRESHOLD  0       //bytes, 0 disables compression
+#define CONF_DEFAULT_CONSISTENCY             DC_ONE
+#define CONF_DEFAULT_READ_HEDGE_PERCENTILE   0       //0 disables hedged reads
+#define CONF_DEFAULT_DYN_SNITCH              false
+#define CONF_DEFAULT_QUEUE_HIGH_WATERMARK    20000   //reqs queued to a server, 0 disables
+#define CONF_DEFAULT_MSG_POOL_MAX            16384   //free msgs kept, 0 keeps all
+#define CONF_DEFAULT_DMSG_POOL_MAX           16384   //free dmsgs kept, 0 keeps all
+#define CONF_DEFAULT_CONN_POOL_MAX           1024    //free conns kept, 0 keeps all
+#define CONF_DEFAULT_NEAR_CACHE_SIZE         0       //bytes of cached GET replies, 0 disables
+#define CONF_DEFAULT_NEAR_CACHE_TTL          1000    //msec a cached GET reply lives
 
 #define CONF_STR_NONE                        "none"
 #define CONF_STR_DC                          "datacenter"
@@ -142,6 +158,22 @@ struct conf_pool {
     struct string      dc;                    /* this node's dc */
     struct string      env;                   /* aws, google, network, ... */
     int                conn_msg_rate;         /* conn msg per sec */
+    int                conn_byte_rate;        /* conn_byte_rate: */
+    int                local_conn_msg_rate;   /* local_conn_msg_rate: */
+    int                local_conn_byte_rate;  /* local_conn_byte_rate: */
+    int                dyn_batch_size;        /* max peer requests per dnode frame */
+    int                dyn_compress_threshold; /* min cross-DC payload to compress */
+    consistency_t      read_consistency;      /* read_consistency: */
+    consistency_t      write_consistency;     /* write_consistency: */
+    int                read_hedge_percentile; /* read_hedge_percentile: */
+    int                dyn_snitch;            /* dyn_snitch: */
+    int                queue_high_watermark;  /* queue_high_watermark: */
+    int                queue_low_watermark;   /* queue_low_watermark: */
+    int                msg_pool_max;          /* msg_pool_max: */
+    int                dmsg_pool_max;         /* dmsg_pool_max: */
+    int                conn_pool_max;         /* conn_pool_max: */
+    int                near_cache_size;       /* near_cache_size: */
+    int                near_cache_ttl;        /* near_cache_ttl: */
 };
 
 
@@ -179,6 +211,7 @@ char *conf_set_num(struct conf *cf, struct command *cmd, void *conf);
 char *conf_set_bool(struct conf *cf, struct command *cmd, void *conf);
 char *conf_set_hash(struct conf *cf, struct command *cmd, void *conf);
 char *conf_set_distribution(struct conf *cf, struct command *cmd, void *conf);
+char *conf_set_consistency(struct conf *cf, struct command *cmd, void *conf);
 char *conf_set_hashtag(struct conf *cf, struct command *cmd, void *conf);
 char *conf_set_tokens(struct conf *cf, struct command *cmd, void *conf);
 
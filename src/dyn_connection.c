@@ -23,6 +23,7 @@
 #include <sys/uio.h>
 
 #include "dyn_core.h"
+#include "dyn_conf.h"
 #include "dyn_server.h"
 #include "dyn_client.h"
 #include "dyn_proxy.h"
@@ -94,6 +95,8 @@
 
 static uint32_t nfree_connq;       /* # free conn q */
 static struct conn_tqh free_connq; /* free conn q */
+static uint32_t max_free_connq = CONF_DEFAULT_CONN_POOL_MAX; /* # free conns kept by shrink */
+static struct twheel throttle_wheel; /* throttled peer conns by resume time */
 
 /*
  * Return the context associated with this connection.
@@ -175,13 +178,28 @@ _conn_get(void)
     conn->dyn_mode = 0;
     conn->dnode_secured = 0;
     conn->dnode_crypto_state = 0;
+    conn->aes_encrypt_ctx = NULL;
+    conn->aes_decrypt_ctx = NULL;
 
     conn->same_dc = 1;
-    conn->avail_tokens = msgs_per_sec();
-    conn->last_sent = 0;
+    conn->dnode_compress = 0;
+    conn->zdeflate = NULL;
+    conn->zinflate = NULL;
+    STAILQ_INIT(&conn->inflate_q);
+    token_bucket_init(&conn->msg_bucket);
+    token_bucket_init(&conn->byte_bucket);
+    twnode_init(&conn->throttle_node);
+    conn->throttle_node.data = conn;
     conn->last_received = 0;
     conn->attempted_reconnect = 0;
     conn->non_bytes_recv = 0;
+
+    conn->dbatch_msg = NULL;
+    conn->dbatch_tail = NULL;
+    conn->dbatch_id = 0;
+    conn->dbatch_cnt = 0;
+    conn->dbatch_plen = 0;
+    conn->dbatch_type = 0;
     //conn->non_bytes_send = 0;
 
     unsigned char *ase_key = generate_aes_key();
@@ -472,16 +490,89 @@ conn_put(struct conn *conn)
 
     log_debug(LOG_VVERB, "put conn %p", conn);
 
+    twheel_delete(&throttle_wheel, &conn->throttle_node);
+
     nfree_connq++;
     TAILQ_INSERT_HEAD(&free_connq, conn, conn_tqe);
 }
 
+uint32_t
+conn_free_queue_size(void)
+{
+    return nfree_connq;
+}
+
+void
+conn_set_pool_max(uint32_t max)
+{
+    max_free_connq = max;
+}
+
+/* free up to n of the free conns past the cap, least recently put first */
+uint32_t
+conn_shrink(uint32_t n)
+{
+    struct conn *conn;
+    uint32_t nfreed;
+
+    for (nfreed = 0; nfreed < n && max_free_connq > 0 &&
+         nfree_connq > max_free_connq; nfreed++) {
+        conn = TAILQ_LAST(&free_connq, conn_tqh);
+        nfree_connq--;
+        TAILQ_REMOVE(&free_connq, conn, conn_tqe);
+        conn_free(conn);
+    }
+
+    return nfreed;
+}
+
 void
 conn_init(void)
 {
     log_debug(LOG_DEBUG, "conn size %d", sizeof(struct conn));
     nfree_connq = 0;
     TAILQ_INIT(&free_connq);
+    twheel_init(&throttle_wheel, dn_msec_now());
+}
+
+/* stop sending on conn for delay usec, until it has earned tokens again */
+void
+conn_throttle(struct context *ctx, struct conn *conn, int64_t delay)
+{
+    rstatus_t status;
+
+    status = event_del_out(ctx->evb, conn);
+    if (status != DN_OK) {
+        conn->err = errno;
+    }
+
+    if (conn->throttle_node.head != NULL) {
+        return;
+    }
+
+    conn->throttle_node.key = dn_msec_now() + (delay + 999) / 1000;
+    twheel_insert(&throttle_wheel, &conn->throttle_node);
+}
+
+/* next throttled conn due to send again by now, NULL if none */
+struct conn *
+conn_throttle_expire(int64_t now)
+{
+    struct twnode *node;
+
+    node = twheel_expire(&throttle_wheel, now);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    return node->data;
+}
+
+/* earliest msec a throttled conn may send again at, -1 if none */
+int64_t
+conn_throttle_next(void)
+{
+    return twheel_next(&throttle_wheel);
 }
 
 void
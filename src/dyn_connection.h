@@ -20,12 +20,14 @@
  * limitations under the License.
  */
 
+#include <openssl/evp.h>
+#include <zlib.h>
+
 #include "dyn_core.h"
 
 #ifndef _DYN_CONNECTION_H_
 #define _DYN_CONNECTION_H_
 
-#define MAX_CONN_QUEUE_SIZE           20000
 #define MAX_CONN_ALLOWABLE_NON_RECV   5
 #define MAX_CONN_ALLOWABLE_NON_SEND   5
 
@@ -103,13 +105,27 @@ struct conn {
     unsigned           dnode_secured:1;      /* is a secured connection? */
     unsigned           dnode_crypto_state:1; /* crypto state */
     unsigned char      aes_key[50]; //aes_key[34];              /* a place holder for AES key */
+    EVP_CIPHER_CTX     *aes_encrypt_ctx;     /* keyed at the crypto handshake */
+    EVP_CIPHER_CTX     *aes_decrypt_ctx;     /* keyed at the crypto handshake */
 
     unsigned           same_dc:1;            /* bit to indicate whether a peer conn is same DC */
-    uint32_t           avail_tokens;          /* used to throttle the traffics */
-    uint32_t           last_sent;             /* ts in sec used to determine the last sent time */
+    unsigned           dnode_compress:1;     /* peer takes compressed payloads? */
+    z_stream           *zdeflate;            /* created on the first compressed payload */
+    z_stream           *zinflate;            /* created on the first compressed payload */
+    struct mhdr        inflate_q;            /* inflated bytes not parsed yet */
+    struct token_bucket msg_bucket;           /* peer: msgs it may be sent */
+    struct token_bucket byte_bucket;          /* peer: bytes it may be sent */
+    struct twnode      throttle_node;         /* entry in throttle wheel while out of tokens */
     uint32_t           last_received;         /* last ts to receive a byte */
     uint32_t           attempted_reconnect;   /* #attempted reconnect before calling close */
     uint32_t           non_bytes_recv;        /* #times or epoll triggers we receive no bytes */
+
+    struct msg         *dbatch_msg;           /* peer: request carrying the open batched frame header */
+    struct msg         *dbatch_tail;          /* peer: last request packed under dbatch_msg */
+    uint64_t           dbatch_id;             /* id of the batched frame */
+    uint32_t           dbatch_cnt;            /* peer: # requests packed, dnode client: # left to unpack */
+    uint32_t           dbatch_plen;           /* peer: payload bytes packed */
+    uint8_t            dbatch_type;           /* dmsg type shared by the batch */
     //uint32_t           non_bytes_send;        /* #times or epoll triggers that we are not able to send any bytes */
 };
 
@@ -129,10 +145,16 @@ struct conn *conn_get_proxy(void *owner);
 struct conn *conn_get_peer(void *owner, bool client, bool redis);
 struct conn *conn_get_dnode(void *owner);
 void conn_put(struct conn *conn);
+void conn_throttle(struct context *ctx, struct conn *conn, int64_t delay);
+struct conn *conn_throttle_expire(int64_t now);
+int64_t conn_throttle_next(void);
 ssize_t conn_recv(struct conn *conn, void *buf, size_t size);
 ssize_t conn_sendv(struct conn *conn, struct array *sendv, size_t nsend);
 void conn_init(void);
 void conn_deinit(void);
+uint32_t conn_free_queue_size(void);
+void conn_set_pool_max(uint32_t max);
+uint32_t conn_shrink(uint32_t n);
 void conn_print(struct conn *conn);
 
 #endif
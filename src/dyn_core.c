@@ -31,6 +31,9 @@
 #include "dyn_dnode_peer.h"
 #include "dyn_gossip.h"
 
+#define CORE_SHRINK_INTERVAL    1000    /* msec between free pool shrinks */
+#define CORE_SHRINK_BATCH       4096    /* max objects freed per pool per shrink */
+
 
 static uint32_t ctx_id; /* context generation */
 
@@ -47,12 +50,15 @@ core_ctx_create(struct instance *nci)
 		return NULL;
 	}
 	ctx->id = ++ctx_id;
+	ctx->worker_id = nci->worker_id;
+	ctx->nworkers = nci->nworkers;
 	ctx->cf = NULL;
 	ctx->stats = NULL;
 	ctx->evb = NULL;
 	array_null(&ctx->pool);
 	ctx->max_timeout = nci->stats_interval;
 	ctx->timeout = ctx->max_timeout;
+	ctx->shrink_at = dn_msec_now() + CORE_SHRINK_INTERVAL;
 	ctx->dyn_state = INIT;
 
 	/* parse and create configuration */
@@ -184,12 +190,8 @@ core_ctx_create(struct instance *nci)
 	}
 
 	//init ring msg queue
-	CBUF_Init(C2G_InQ);
-	CBUF_Init(C2G_OutQ);
-
-	//init stats msg queue
-	CBUF_Init(C2S_InQ);
-	CBUF_Init(C2S_OutQ);
+	ring_queue_init(&C2G_InQ);
+	ring_queue_init(&C2G_OutQ);
 
 	gossip_pool_init(ctx);
 
@@ -364,24 +366,45 @@ core_error(struct context *ctx, struct conn *conn)
 	core_close(ctx, conn);
 }
 
+/*
+ * Free pools only grow under load; give back a batch of what each holds
+ * past its cap at every interval, so that a spike is unwound gradually.
+ */
+static void
+core_shrink(struct context *ctx, int64_t now)
+{
+	uint32_t n;
+
+	if (now < ctx->shrink_at) {
+		return;
+	}
+	ctx->shrink_at = now + CORE_SHRINK_INTERVAL;
+
+	n = msg_shrink(CORE_SHRINK_BATCH);
+	n += dmsg_shrink(CORE_SHRINK_BATCH);
+	n += conn_shrink(CORE_SHRINK_BATCH);
+	n += mbuf_shrink(CORE_SHRINK_BATCH);
+
+	if (n > 0) {
+		log_debug(LOG_VERB, "shrunk free pools by %"PRIu32" objects", n);
+	}
+}
+
 static void
 core_timeout(struct context *ctx)
 {
-	for (;;) {
-		struct msg *msg;
-		struct conn *conn;
-		int64_t now, then;
-
-		msg = msg_tmo_min();
-		if (msg == NULL) {
-			ctx->timeout = ctx->max_timeout;
-			return;
-		}
+	struct msg *msg;
+	struct conn *conn;
+	struct response_mgr *mgr;
+	int64_t now, then, hedge, resume;
+	rstatus_t status;
+
+	now = dn_msec_now();
 
+	while ((msg = msg_tmo_expire(now)) != NULL) {
 		/* skip over req that are in-error or done */
 
 		if (msg->error || msg->done) {
-			msg_tmo_delete(msg);
 			continue;
 		}
 
@@ -390,20 +413,10 @@ core_timeout(struct context *ctx)
 		 * out server
 		 */
 
-		conn = msg->tmo_rbe.data;
-		then = msg->tmo_rbe.key;
-
-		now = dn_msec_now();
-		if (now < then) {
-			int delta = (int)(then - now);
-			ctx->timeout = MIN(delta, ctx->max_timeout);
-			return;
-		}
+		conn = msg->tmo_node.data;
 
 		log_debug(LOG_WARN, "req %"PRIu64" on s %d timedout", msg->id, conn->sd);
 
-		msg_tmo_delete(msg);
-
 		if (conn->dyn_mode) {
 			if (!conn->dnode_client && !conn->dnode_server) { //outgoing peer requests
 		 	   struct server *server = conn->owner;
@@ -419,6 +432,43 @@ core_timeout(struct context *ctx)
 
 		core_close(ctx, conn);
 	}
+
+	while ((mgr = rspmgr_hedge_expire(now)) != NULL) {
+		req_forward_hedge(ctx, mgr);
+	}
+
+	/* throttled peers have earned tokens again */
+	while ((conn = conn_throttle_expire(now)) != NULL) {
+		if (conn->sd < 0) {
+			continue;
+		}
+
+		status = event_add_out(ctx->evb, conn);
+		if (status != DN_OK) {
+			conn->err = errno;
+		}
+	}
+
+	then = msg_tmo_next();
+	hedge = rspmgr_hedge_next();
+	if (then < 0 || (hedge >= 0 && hedge < then)) {
+		then = hedge;
+	}
+	resume = conn_throttle_next();
+	if (then < 0 || (resume >= 0 && resume < then)) {
+		then = resume;
+	}
+
+	core_shrink(ctx, now);
+	if (then < 0 || ctx->shrink_at < then) {
+		then = ctx->shrink_at;
+	}
+
+	if (then < 0) {
+		ctx->timeout = ctx->max_timeout;
+	} else {
+		ctx->timeout = (int)MIN(MAX(then - now, 0), ctx->max_timeout);
+	}
 }
 
 
@@ -570,11 +620,12 @@ core_debug(struct context *ctx)
 static rstatus_t
 core_process_messages(void)
 {
-	log_debug(LOG_VERB, "length of C2G_OutQ : %d", CBUF_Len( C2G_OutQ ));
+	struct ring_msg *msg;
+
+	log_debug(LOG_VERB, "length of C2G_OutQ : %"PRIu32"", ring_queue_len(&C2G_OutQ));
 
-	while (!CBUF_IsEmpty(C2G_OutQ)) {
-		struct ring_msg *msg = (struct ring_msg *) CBUF_Pop(C2G_OutQ);
-		if (msg != NULL && msg->cb != NULL) {
+	while ((msg = ring_queue_pop(&C2G_OutQ)) != NULL) {
+		if (msg->cb != NULL) {
 			msg->cb(msg);
 			core_debug(msg->sp->ctx);
 			ring_msg_deinit(msg);
@@ -101,6 +101,7 @@ struct instance;
 struct event_base;
 struct rack;
 struct dyn_ring;
+struct response_mgr;
 
 #include <stddef.h>
 #include <stdint.h>
@@ -124,15 +125,19 @@ struct dyn_ring;
 #include "dyn_string.h"
 #include "dyn_queue.h"
 #include "dyn_rbtree.h"
+#include "dyn_twheel.h"
 #include "dyn_log.h"
 #include "dyn_util.h"
 #include "dyn_stats.h"
 #include "dyn_mbuf.h"
 #include "dyn_message.h"
+#include "dyn_response_mgr.h"
+#include "dyn_near_cache.h"
+#include "dyn_token_bucket.h"
 #include "dyn_connection.h"
-#include "dyn_cbuf.h"
 #include "dyn_ring_queue.h"
 #include "dyn_crypto.h"
+#include "dyn_compress.h"
 #include "dyn_setting.h"
 
 #include "event/dyn_event.h"
@@ -160,6 +165,8 @@ typedef enum dyn_state {
 
 struct context {
     uint32_t           id;          /* unique context id */
+    uint32_t           worker_id;   /* worker process index */
+    uint32_t           nworkers;    /* # worker processes */
     struct conf        *cf;         /* configuration */
     struct stats       *stats;      /* stats */
 
@@ -167,6 +174,7 @@ struct context {
     struct event_base  *evb;        /* event base */
     int                max_timeout; /* max timeout in msec */
     int                timeout;     /* timeout in msec */
+    int64_t            shrink_at;   /* msec of next free pool shrink */
     dyn_state_t        dyn_state;   /* state of the node.  Don't need volatile as
                                        it is ok to eventually get its new value */
     unsigned           enable_gossip:1;   /* enable/disable gossip */
@@ -184,6 +192,11 @@ struct instance {
     char            *stats_addr;                 /* stats monitoring addr */
     char            hostname[DN_MAXHOSTNAMELEN]; /* hostname */
     size_t          mbuf_chunk_size;             /* mbuf chunk size */
+    size_t          mbuf_prealloc;               /* MB of mbufs preallocated */
+    size_t          mbuf_max_idle;               /* MB of idle mbufs kept */
+    unsigned        mbuf_hugepages:1;            /* mbufs in hugepages? */
+    uint32_t        nworkers;                    /* # worker processes */
+    uint32_t        worker_id;                   /* index of this worker */
     pid_t           pid;                         /* process id */
     char            *pid_filename;               /* pid filename */
     unsigned        pidfile:1;                   /* pid file created? */
@@ -202,6 +215,8 @@ struct rack {
 	uint32_t           ncontinuum;           /* # continuum points */
 	uint32_t           nserver_continuum;    /* # servers - live and dead on continuum (const) */
 	struct continuum   *continuum;           /* continuum */
+	uint32_t           *fast_token;          /* 32-bit continuum tokens in eytzinger order, NULL if any is wider */
+	uint32_t           *fast_index;          /* dyn_peer index of each fast_token slot */
 };
 
 
@@ -230,6 +245,11 @@ struct server {
     int64_t            next_retry;    /* next retry time in usec */
     uint32_t           failure_count; /* # consecutive failures */
 
+    int64_t            latency;       /* ewma of response latency in usec */
+    int64_t            latency_at;    /* time of the last latency sample in usec */
+    uint32_t           outstanding;   /* # requests queued or in flight */
+    unsigned           overloaded:1;  /* turning requests away? */
+
     struct string      rack;          /* logical rack */
     struct string      dc;            /* server's dc */
     struct array       tokens;        /* DHT tokens this peer owns */
@@ -299,6 +319,15 @@ struct server_pool {
     struct string      secure_server_option;
     struct string      pem_key_file;
 
+    consistency_t      read_consistency;     /* read consistency level */
+    consistency_t      write_consistency;    /* write consistency level */
+    int                read_hedge_percentile; /* latency percentile to hedge reads at, 0 if off */
+    int                read_hedge_delay;     /* msec to wait before hedging a read */
+    int64_t            read_hedge_refresh;   /* next read_hedge_delay update in msec */
+    unsigned           dyn_snitch:1;         /* steer reads to the fastest local rack? */
+    uint32_t           queue_high_watermark; /* # queued reqs a server is overloaded at, 0 if off */
+    uint32_t           queue_low_watermark;  /* # queued reqs it recovers at */
+    unsigned           clients_paused:1;     /* client reads paused by admission control? */
 };
 
 
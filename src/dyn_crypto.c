@@ -17,6 +17,7 @@
 #include "dyn_server.h"
 
 static EVP_CIPHER *aes_cipher;
+static EVP_CIPHER *aes_stream_cipher;
 static RSA *rsa;
 static int rsa_size = 0;
 
@@ -120,21 +121,21 @@ static rstatus_t
 aes_init(void)
 {
 	// Initalize contexts
-	aes_encrypt_ctx = (EVP_CIPHER_CTX*) malloc(sizeof(EVP_CIPHER_CTX));
-	aes_decrypt_ctx = (EVP_CIPHER_CTX*) malloc(sizeof(EVP_CIPHER_CTX));
-
-	EVP_CIPHER_CTX_init(aes_encrypt_ctx);
+	aes_encrypt_ctx = EVP_CIPHER_CTX_new();
+	aes_decrypt_ctx = EVP_CIPHER_CTX_new();
+	if (aes_encrypt_ctx == NULL || aes_decrypt_ctx == NULL) {
+		return DN_ENOMEM;
+	}
 
 	//EVP_CIPHER_CTX_set_padding(aes_encrypt_ctx, RSA_PKCS1_PADDING);
 	EVP_CIPHER_CTX_set_padding(aes_encrypt_ctx, RSA_NO_PADDING);
 
-	EVP_CIPHER_CTX_init(aes_decrypt_ctx);
-
 	//EVP_CIPHER_CTX_set_padding(aes_decrypt_ctx, RSA_PKCS1_PADDING);
 	EVP_CIPHER_CTX_set_padding(aes_decrypt_ctx, RSA_NO_PADDING);
 
 	// Init AES
 	aes_cipher =  EVP_aes_128_cbc();
+	aes_stream_cipher = EVP_aes_128_ctr();
 
 
 	if(RAND_bytes(aes_key, aes_key_size) == 0) {
@@ -194,14 +195,8 @@ crypto_init_for_test()
 rstatus_t
 crypto_deinit(void)
 {
-	EVP_CIPHER_CTX_cleanup(aes_encrypt_ctx);
-
-
-	EVP_CIPHER_CTX_cleanup(aes_decrypt_ctx);
-
-
-	free(aes_encrypt_ctx);
-	free(aes_decrypt_ctx);
+	EVP_CIPHER_CTX_free(aes_encrypt_ctx);
+	EVP_CIPHER_CTX_free(aes_decrypt_ctx);
 
 	//free(aes_key);
 
@@ -311,135 +306,183 @@ aes_encrypt(const unsigned char *msg, size_t msg_len, unsigned char **enc_msg, u
 }
 
 
-rstatus_t
-dyn_aes_encrypt(const unsigned char *msg, size_t msg_len, struct mbuf *mbuf, unsigned char *aes_key)
+/*
+ * Peer links use AES in CTR mode: the ciphertext has the plaintext's length,
+ * so a msg is encrypted in place and can be decrypted in whatever pieces it
+ * arrives in. Each msg gets its own counter block, built from the dnode msg
+ * id and type. Only the counter block is reset per msg; the conn's contexts
+ * keep the expanded key.
+ */
+static rstatus_t
+aes_stream_iv(EVP_CIPHER_CTX *ctx, uint64_t msg_id, uint8_t type)
 {
+	unsigned char iv[AES_BLOCK_SIZE];
+	int i;
 
-	size_t block_len  = 0;
-	size_t enc_msg_len = 0;
-
-	ASSERT(mbuf != NULL && mbuf->last == mbuf->pos);
+	for (i = 0; i < 8; i++) {
+		iv[i] = (unsigned char)(msg_id >> (56 - 8 * i));
+	}
+	iv[8] = type;
+	memset(iv + 9, 0, AES_BLOCK_SIZE - 9);
 
-	//if(!EVP_EncryptInit_ex(aes_encrypt_ctx, aes_cipher, NULL, aes_key, aes_iv)) {
-	if(!EVP_EncryptInit_ex(aes_encrypt_ctx, aes_cipher, NULL, aes_key, aes_key)) {
-		loga_hexdump(msg, msg_len, "Bad data in EVP_EncryptInit_ex, crypto data with %ld bytes of data", msg_len);
+	if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv)) {
+		log_debug(LOG_VERB, "Bad data in EVP_EncryptInit_ex for msg %"PRIu64, msg_id);
 		return DN_ERROR;
 	}
 
-	if(!EVP_EncryptUpdate(aes_encrypt_ctx, mbuf->start, (int*)&block_len, (unsigned char*) msg, msg_len)) {
-		loga_hexdump(msg, msg_len, "Bad data in EVP_EncryptUpdate, crypto data with %ld bytes of data", msg_len);
-		return DN_ERROR;
+	return DN_OK;
+}
+
+
+/*
+ * Key the conn's cipher contexts. Done at the crypto handshake: when a
+ * secured peer conn sends its first msg, which carries the AES key, or when
+ * a dnode client receives a key.
+ */
+rstatus_t
+dyn_aes_conn_init(struct conn *conn)
+{
+	if (conn->aes_encrypt_ctx == NULL) {
+		conn->aes_encrypt_ctx = EVP_CIPHER_CTX_new();
 	}
-	enc_msg_len += block_len;
 
-	if(!EVP_EncryptFinal_ex(aes_encrypt_ctx, mbuf->start + enc_msg_len, (int*) &block_len)) {
-		loga_hexdump(msg, msg_len, "Bad data in EVP_EncryptFinal_ex, crypto data with %ld bytes of data", msg_len);
-		return DN_ERROR;
+	if (conn->aes_decrypt_ctx == NULL) {
+		conn->aes_decrypt_ctx = EVP_CIPHER_CTX_new();
 	}
 
-	EVP_CIPHER_CTX_cleanup(aes_encrypt_ctx);
+	if (conn->aes_encrypt_ctx == NULL || conn->aes_decrypt_ctx == NULL) {
+		dyn_aes_conn_deinit(conn);
+		return DN_ENOMEM;
+	}
 
-	//for encrypt, we allow to use up to the extra space
-	if (enc_msg_len + block_len > mbuf->end_extra - mbuf->last) {
+	if (!EVP_EncryptInit_ex(conn->aes_encrypt_ctx, aes_stream_cipher, NULL, conn->aes_key, NULL) ||
+		!EVP_EncryptInit_ex(conn->aes_decrypt_ctx, aes_stream_cipher, NULL, conn->aes_key, NULL)) {
+		log_debug(LOG_VERB, "Bad key in EVP_EncryptInit_ex on c %d", conn->sd);
 		return DN_ERROR;
 	}
 
-	mbuf->last = mbuf->pos + enc_msg_len + block_len;
-
-	return enc_msg_len + block_len;
+	return DN_OK;
 }
 
 
-rstatus_t
-dyn_aes_decrypt(unsigned char *enc_msg, size_t enc_msg_len, struct mbuf *mbuf, unsigned char *aes_key)
+void
+dyn_aes_conn_deinit(struct conn *conn)
 {
-	if (ENCRYPTION) {
-		size_t dec_len   = 0;
-		size_t block_len = 0;
+	if (conn->aes_encrypt_ctx != NULL) {
+		EVP_CIPHER_CTX_free(conn->aes_encrypt_ctx);
+		conn->aes_encrypt_ctx = NULL;
+	}
 
-		ASSERT(mbuf != NULL && mbuf->start == mbuf->pos);
+	if (conn->aes_decrypt_ctx != NULL) {
+		EVP_CIPHER_CTX_free(conn->aes_decrypt_ctx);
+		conn->aes_decrypt_ctx = NULL;
+	}
+}
 
-		//if(!EVP_DecryptInit_ex(aes_decrypt_ctx, aes_cipher, NULL, aes_key, aes_iv)) {
-		if(!EVP_DecryptInit_ex(aes_decrypt_ctx, aes_cipher, NULL, aes_key, aes_key)) {
-			loga_hexdump(enc_msg, enc_msg_len, "Bad data in EVP_DecryptInit_ex, crypto data with %ld bytes of data", enc_msg_len);
-			return DN_ERROR;
-		}
 
-		if(!EVP_DecryptUpdate(aes_decrypt_ctx, mbuf->pos, (int*) &block_len, enc_msg, (int)enc_msg_len)) {
-			loga_hexdump(enc_msg, enc_msg_len, "Bad data in EVP_DecryptUpdate, crypto data with %ld bytes of data", enc_msg_len);
-			return DN_ERROR;
-		}
-		dec_len += block_len;
+/*
+ * Decrypt len bytes of a msg payload in place. offset is where buf starts
+ * in the payload; the pieces of a payload must come in order.
+ */
+rstatus_t
+dyn_aes_decrypt_stream(struct conn *conn, unsigned char *buf, size_t len,
+		               size_t offset, uint64_t msg_id, uint8_t type)
+{
+	int n;
 
-		if(!EVP_DecryptFinal_ex(aes_decrypt_ctx, mbuf->pos + dec_len, (int*) &block_len)) {
-			loga_hexdump(enc_msg, enc_msg_len, "Bad data in EVP_DecryptFinal_ex, crypto data with %ld bytes of data", enc_msg_len);
-			return DN_ERROR;
-		}
+	if (!ENCRYPTION || len == 0) {
+		return DN_OK;
+	}
 
-		dec_len += block_len;
-		mbuf->last = mbuf->pos + dec_len;
+	if (conn->aes_decrypt_ctx == NULL && dyn_aes_conn_init(conn) != DN_OK) {
+		return DN_ERROR;
+	}
 
-		EVP_CIPHER_CTX_cleanup(aes_decrypt_ctx);
+	if (offset == 0 && aes_stream_iv(conn->aes_decrypt_ctx, msg_id, type) != DN_OK) {
+		return DN_ERROR;
+	}
 
-		return (int) dec_len;
+	if (!EVP_EncryptUpdate(conn->aes_decrypt_ctx, buf, &n, buf, (int)len)) {
+		loga_hexdump(buf, len, "Bad data in EVP_EncryptUpdate, crypto data with %ld bytes of data", len);
+		return DN_ERROR;
 	}
 
-	mbuf_copy(mbuf, enc_msg, enc_msg_len);
-	return (int) enc_msg_len;
+	return DN_OK;
 }
 
 /*
- *  AES encrypt a msg with one or more buffers
+ *  AES encrypt a msg with one or more buffers as one stream. A response owns
+ *  its buffers and is encrypted in place. A request is encrypted into pooled
+ *  mbufs and its plaintext is moved to msg->plain: it may still be cloned for
+ *  other racks, and its keys are read until it is answered. Shared buffers
+ *  are never encrypted in place.
  *
+ *  A request whose plaintext was already kept by compression is made of
+ *  owned deflated buffers, which are encrypted in place.
  */
 rstatus_t
-dyn_aes_encrypt_msg(struct msg *msg, unsigned char *aes_key)
+dyn_aes_encrypt_msg(struct msg *msg, struct conn *conn,
+		            uint64_t msg_id, uint8_t type)
 {
-	struct mhdr mhdr_tem;
+	struct mbuf *mbuf, *nbuf, *cbuf;
 	size_t count = 0;
+	uint32_t len;
+	int n;
+	bool keep;
 
 	if (STAILQ_EMPTY(&msg->mhdr)) {
 		return DN_ERROR;
 	}
 
-	STAILQ_INIT(&mhdr_tem);
+	keep = msg->request && STAILQ_EMPTY(&msg->plain);
 
-	struct mbuf *mbuf;
-	while (!STAILQ_EMPTY(&msg->mhdr)) {
-		mbuf = STAILQ_FIRST(&msg->mhdr);
-		//STAILQ_REMOVE_HEAD(&msg->mhdr, next);
-		mbuf_remove(&msg->mhdr, mbuf);
+	if (conn->aes_encrypt_ctx == NULL && dyn_aes_conn_init(conn) != DN_OK) {
+		return DN_ERROR;
+	}
 
-		//mbuf_dump(mbuf);
+	if (aes_stream_iv(conn->aes_encrypt_ctx, msg_id, type) != DN_OK) {
+		return DN_ERROR;
+	}
 
-		struct mbuf *nbuf = mbuf_get();
-		if (nbuf == NULL) {
-			mbuf_put(mbuf);
-			return DN_ERROR;
+	for (mbuf = STAILQ_FIRST(&msg->mhdr); mbuf != NULL; mbuf = nbuf) {
+		nbuf = STAILQ_NEXT(mbuf, next);
+
+		len = mbuf_length(mbuf);
+		if (len == 0) {
+			if (keep) {
+				mbuf_remove(&msg->mhdr, mbuf);
+				mbuf_insert(&msg->plain, mbuf);
+			}
+			continue;
 		}
 
-		int n = dyn_aes_encrypt(mbuf->start, mbuf->last - mbuf->start, nbuf, aes_key);
-		if (n > 0)
-			count += n;
+		if (!keep && mbuf->shared == NULL && mbuf->refcount <= 1) {
+			if (!EVP_EncryptUpdate(conn->aes_encrypt_ctx, mbuf->pos, &n, mbuf->pos, (int)len)) {
+				return DN_ERROR;
+			}
+			count += (size_t)n;
+			continue;
+		}
 
-		mbuf_put(mbuf);
-		//mbuf_dump(nbuf);
-		if (STAILQ_EMPTY(&mhdr_tem)) {
-			STAILQ_INSERT_HEAD(&mhdr_tem, nbuf, next);
-		} else {
-			STAILQ_INSERT_TAIL(&mhdr_tem, nbuf, next);
+		cbuf = mbuf_get_size(len);
+		if (cbuf == NULL) {
+			return DN_ERROR;
 		}
-	}
 
-	while (!STAILQ_EMPTY(&mhdr_tem)) {
-		mbuf = STAILQ_FIRST(&mhdr_tem);
-		//STAILQ_REMOVE_HEAD(&mhdr_tem, next);
-		mbuf_remove(&mhdr_tem, mbuf);
+		if (len > mbuf_size(cbuf) ||
+			!EVP_EncryptUpdate(conn->aes_encrypt_ctx, cbuf->last, &n, mbuf->pos, (int)len)) {
+			mbuf_put(cbuf);
+			return DN_ERROR;
+		}
+		cbuf->last += n;
+		count += (size_t)n;
 
-		if (STAILQ_EMPTY(&msg->mhdr)) {
-			STAILQ_INSERT_HEAD(&msg->mhdr, mbuf, next);
+		STAILQ_INSERT_AFTER(&msg->mhdr, mbuf, cbuf, next);
+		mbuf_remove(&msg->mhdr, mbuf);
+		if (keep) {
+			mbuf_insert(&msg->plain, mbuf);
 		} else {
-			STAILQ_INSERT_TAIL(&msg->mhdr, mbuf, next);
+			mbuf_put(mbuf);
 		}
 	}
 
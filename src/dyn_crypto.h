@@ -38,11 +38,14 @@ int calc_decode_length(const char *b64input, const size_t length);
 rstatus_t aes_encrypt(const unsigned char *msg, size_t msgLen, unsigned char **encMsg, unsigned char *aes_key);
 rstatus_t aes_decrypt(unsigned char *encMsg, size_t encMsgLen, unsigned char **decMsg, unsigned char *aes_key);
 
-rstatus_t dyn_aes_encrypt(const unsigned char *msg, size_t msgLen,
-		                  struct mbuf *mbuf, unsigned char *aes_key);
+rstatus_t dyn_aes_conn_init(struct conn *conn);
+void dyn_aes_conn_deinit(struct conn *conn);
 
-rstatus_t dyn_aes_decrypt(unsigned char *encMsg, size_t encMsgLen,
-		                  struct mbuf *mbuf, unsigned char *aes_key);
+rstatus_t dyn_aes_encrypt_msg(struct msg *msg, struct conn *conn,
+		                      uint64_t msg_id, uint8_t type);
+
+rstatus_t dyn_aes_decrypt_stream(struct conn *conn, unsigned char *buf, size_t len,
+		                         size_t offset, uint64_t msg_id, uint8_t type);
 
 unsigned char* generate_aes_key(void);
 
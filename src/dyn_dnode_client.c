@@ -120,6 +120,9 @@ dnode_client_close(struct context *ctx, struct conn *conn)
 
     dnode_client_close_stats(ctx, conn->owner, conn->err, conn->eof);
 
+    dyn_aes_conn_deinit(conn);
+    dyn_compress_conn_deinit(conn);
+
     if (conn->sd < 0) {
         conn->unref(conn);
         conn_put(conn);
@@ -6,6 +6,7 @@
 #include <ctype.h>
 
 #include "dyn_core.h"
+#include "dyn_conf.h"
 #include "dyn_crypto.h"
 #include "dyn_dnode_msg.h"
 #include "dyn_server.h"
@@ -16,6 +17,7 @@ static uint8_t version = VERSION_10;
 static uint64_t dmsg_id;          /* message id counter */
 static uint32_t nfree_dmsgq;      /* # free msg q */
 static struct dmsg_tqh free_dmsgq; /* free msg q */
+static uint32_t max_free_dmsgq = CONF_DEFAULT_DMSG_POOL_MAX; /* # free dmsgs kept by shrink */
 
 static const struct string MAGIC_STR = string("   $2014$ ");
 static const struct string CRLF_STR = string(CRLF);
@@ -26,6 +28,56 @@ static unsigned char aes_decrypted_buf[34];
 static rstatus_t dmsg_to_gossip(struct ring_msg *rmsg);
 
 
+/*
+ * Account for the part of an encrypted or compressed payload that lies in
+ * [pos, pos + len), decrypting it in place. Anything past the payload belongs
+ * to the next msg.
+ */
+rstatus_t
+dmsg_payload_recv(struct msg *r, uint8_t *pos, uint32_t len)
+{
+	struct dmsg *dmsg = r->dmsg;
+	uint32_t n;
+
+	n = MIN(len, dmsg->plen - dmsg->pdone);
+	if ((dmsg->bit_field & DMSG_BIT_ENCRYPTED) &&
+		dyn_aes_decrypt_stream(r->owner, pos, n, dmsg->pdone,
+	                           dmsg->id, (uint8_t)dmsg->type) != DN_OK) {
+		loga("Unable to decrypt payload of dmsg %"PRIu64, dmsg->id);
+		return DN_ERROR;
+	}
+
+	dmsg->pdone += n;
+	return DN_OK;
+}
+
+
+/*
+ * A compressed payload is parsed once it is all in and inflated; until then
+ * the msg waits for more data.
+ */
+static void
+dmsg_inflate(struct msg *r)
+{
+	struct dmsg *dmsg = r->dmsg;
+	rstatus_t status;
+
+	r->result = MSG_PARSE_AGAIN;
+	if (dmsg->pdone < dmsg->plen) {
+		return;
+	}
+
+	status = dyn_inflate_payload(r->owner, r);
+	if (status != DN_OK) {
+		loga("Unable to inflate payload of dmsg %"PRIu64, dmsg->id);
+		r->result = (status == DN_ENOMEM) ? MSG_OOM_ERROR : MSG_PARSE_ERROR;
+		return;
+	}
+
+	dmsg->bit_field &= (uint8_t)~DMSG_BIT_COMPRESSED;
+}
+
+
 static bool 
 dyn_parse_core(struct msg *r)
 {
@@ -415,6 +467,27 @@ dyn_parse_core(struct msg *r)
    r->pos = p;
    dmsg->source_address = r->owner->addr;
 
+   if (dmsg->bit_field & DMSG_BIT_COMPRESS_OK) {
+      r->owner->dnode_compress = 1;
+   }
+
+   if (r->request && (dmsg->bit_field & DMSG_BIT_BATCH)) {
+      //the requests after this one carry no header of their own
+      struct conn *conn = r->owner;
+      uint32_t i, count = 0;
+      for (i = 0; i < dmsg->mlen && isdigit(dmsg->data[i]); i++) {
+         count = count*10 + (dmsg->data[i] - '0');
+      }
+
+      conn->dbatch_cnt = (count > 0) ? count - 1 : 0;
+      conn->dbatch_id = dmsg->id + 1;
+      conn->dbatch_type = dmsg->type;
+      if (log_loggable(LOG_VVERB)) {
+         log_debug(LOG_VVERB, "batched frame %"PRIu64" with %"PRIu32" reqs on c %d",
+                   dmsg->id, count, conn->sd);
+      }
+   }
+
    if (log_loggable(LOG_VVERB)) {
       log_debug(LOG_VVERB, "at done with p at %d", p);
       log_hexdump(LOG_VVERB, r->pos, b->last - r->pos, "done and inspecting req %"PRIu64" "
@@ -458,6 +531,28 @@ dyn_parse_req(struct msg *r)
 	bool done_parsing = false;
 	struct mbuf *b = STAILQ_LAST(&r->mhdr, mbuf, next);
 
+	if (r->dmsg == NULL && r->dyn_state == DYN_START && r->owner->dbatch_cnt > 0) {
+		//next request of a batched frame: reuse the frame's header
+		struct conn *conn = r->owner;
+		struct dmsg *dmsg = dmsg_get();
+		if (dmsg == NULL) {
+			loga("unable to create a new dmsg");
+			r->result = MSG_OOM_ERROR;
+			return;
+		}
+
+		dmsg->owner = r;
+		dmsg->id = conn->dbatch_id++;
+		dmsg->type = conn->dbatch_type;
+		dmsg->same_dc = conn->same_dc;
+		dmsg->source_address = conn->addr;
+		dmsg->payload = r->pos;
+		conn->dbatch_cnt--;
+
+		r->dmsg = dmsg;
+		r->dyn_state = DYN_DONE;
+	}
+
 	if (dyn_parse_core(r)) {
 		struct dmsg *dmsg = r->dmsg;
 		struct conn *conn = r->owner;
@@ -471,60 +566,43 @@ dyn_parse_req(struct msg *r)
 			return;
 		}
 
-		if (r->dyn_state == DYN_DONE && dmsg->bit_field == 1) {
-			dmsg->owner->owner->dnode_secured = 1;
-			r->owner->dnode_crypto_state = 1;
+		if (r->dyn_state == DYN_DONE &&
+			(dmsg->bit_field & (DMSG_BIT_ENCRYPTED | DMSG_BIT_COMPRESSED))) {
 			r->dyn_state = DYN_POST_DONE;
-			r->result = MSG_PARSE_REPAIR;
-
-			if (dmsg->mlen > 1) {
-				//Decrypt AES key
-				dyn_rsa_decrypt(dmsg->data, aes_decrypted_buf);
-				strncpy(r->owner->aes_key, aes_decrypted_buf, strlen(aes_decrypted_buf));
-			}
-
-			if (dmsg->plen + b->pos <= b->last) {
-				struct mbuf *decrypted_buf = mbuf_get();
-				if (decrypted_buf == NULL) {
-					loga("Unable to obtain an mbuf for dnode msg's header!");
-					r->result = MSG_OOM_ERROR;
-					return;
-				}
-
-				dyn_aes_decrypt(b->pos, dmsg->plen, decrypted_buf, r->owner->aes_key);
-
-				b->pos = b->pos + dmsg->plen;
-				r->pos = decrypted_buf->start;
-				mbuf_copy(decrypted_buf, b->pos, mbuf_length(b));
-
-				mbuf_insert(&r->mhdr, decrypted_buf);
-				mbuf_remove(&r->mhdr, b);
-				mbuf_put(b);
 
-				r->mlen = mbuf_length(decrypted_buf);
-
-				if (r->redis) {
-					return redis_parse_req(r);
+			if (dmsg->bit_field & DMSG_BIT_ENCRYPTED) {
+				dmsg->owner->owner->dnode_secured = 1;
+				r->owner->dnode_crypto_state = 1;
+
+				if (dmsg->mlen > 1) {
+					//Decrypt AES key
+					dyn_rsa_decrypt(dmsg->data, aes_decrypted_buf);
+					memcpy(r->owner->aes_key, aes_decrypted_buf, AES_KEYLEN);
+					if (dyn_aes_conn_init(r->owner) != DN_OK) {
+						r->result = MSG_OOM_ERROR;
+						return;
+					}
 				}
+			}
 
-				return memcache_parse_req(r);
+			//the payload bytes that came with the header; the rest is
+			//taken care of as it is received
+			if (dmsg_payload_recv(r, b->pos, (uint32_t)(b->last - b->pos)) != DN_OK) {
+				r->result = MSG_PARSE_ERROR;
+				return;
 			}
+		}
 
-			//substract alraedy received bytes
-			dmsg->plen -= b->last - b->pos;
+		if (r->dyn_state == DYN_POST_DONE) {
+			if (dmsg->bit_field & DMSG_BIT_COMPRESSED) {
+				return dmsg_inflate(r);
+			}
 
-			return;
-		} else if (r->dyn_state == DYN_POST_DONE) {
-			struct mbuf *last_buf = STAILQ_LAST(&r->mhdr, mbuf, next);
-			if (last_buf->read_flip == 1) {
-				if (r->redis)
-					redis_parse_req(r);
-				else
-					memcache_parse_req(r);
-			} else {
-				r->result = MSG_PARSE_AGAIN;
+			if (r->redis) {
+				return redis_parse_req(r);
 			}
-			return;
+
+			return memcache_parse_req(r);
 		}
 
 		if (dmsg->type == GOSSIP_SYN) {
@@ -578,60 +656,43 @@ void dyn_parse_rsp(struct msg *r)
 			return;
 		}
 
-		if (r->dyn_state == DYN_DONE && dmsg->bit_field == 1) {
-			dmsg->owner->owner->dnode_secured = 1;
-			r->owner->dnode_crypto_state = 1;
+		if (r->dyn_state == DYN_DONE &&
+			(dmsg->bit_field & (DMSG_BIT_ENCRYPTED | DMSG_BIT_COMPRESSED))) {
 			r->dyn_state = DYN_POST_DONE;
-			r->result = MSG_PARSE_REPAIR;
-
-			if (dmsg->mlen > 1) {
-				//Decrypt AES key
-				dyn_rsa_decrypt(dmsg->data, aes_decrypted_buf);
-				strncpy(r->owner->aes_key, aes_decrypted_buf, strlen(aes_decrypted_buf));
-			}
 
-			if (dmsg->plen + b->pos <= b->last) {
-				struct mbuf *decrypted_buf = mbuf_get();
-				if (decrypted_buf == NULL) {
-					loga("Unable to obtain an mbuf for dnode msg's header!");
-					r->result = MSG_OOM_ERROR;
-					return;
+			if (dmsg->bit_field & DMSG_BIT_ENCRYPTED) {
+				dmsg->owner->owner->dnode_secured = 1;
+				r->owner->dnode_crypto_state = 1;
+
+				if (dmsg->mlen > 1) {
+					//Decrypt AES key
+					dyn_rsa_decrypt(dmsg->data, aes_decrypted_buf);
+					memcpy(r->owner->aes_key, aes_decrypted_buf, AES_KEYLEN);
+					if (dyn_aes_conn_init(r->owner) != DN_OK) {
+						r->result = MSG_OOM_ERROR;
+						return;
+					}
 				}
-
-				dyn_aes_decrypt(b->pos, dmsg->plen, decrypted_buf, r->owner->aes_key);
-
-				b->pos = b->pos + dmsg->plen;
-				r->pos = decrypted_buf->start;
-				mbuf_copy(decrypted_buf, b->pos, mbuf_length(b));
-
-				mbuf_insert(&r->mhdr, decrypted_buf);
-				mbuf_remove(&r->mhdr, b);
-				mbuf_put(b);
-
-				r->mlen = mbuf_length(decrypted_buf);
-				if (r->redis) {
-					return redis_parse_rsp(r);
-				}
-
-				return memcache_parse_rsp(r);
 			}
 
-			//substract alraedy received bytes
-			dmsg->plen -= b->last - b->pos;
-			return;
+			//the payload bytes that came with the header; the rest is
+			//taken care of as it is received
+			if (dmsg_payload_recv(r, b->pos, (uint32_t)(b->last - b->pos)) != DN_OK) {
+				r->result = MSG_PARSE_ERROR;
+				return;
+			}
+		}
 
-		} else if (r->dyn_state == DYN_POST_DONE) {
-			struct mbuf *last_buf = STAILQ_LAST(&r->mhdr, mbuf, next);
-			if (last_buf->read_flip == 1) {
-				if (r->redis)
-					redis_parse_rsp(r);
-				else
-					memcache_parse_rsp(r);
+		if (r->dyn_state == DYN_POST_DONE) {
+			if (dmsg->bit_field & DMSG_BIT_COMPRESSED) {
+				return dmsg_inflate(r);
+			}
 
-			} else {
-				r->result = MSG_PARSE_AGAIN;
+			if (r->redis) {
+				return redis_parse_rsp(r);
 			}
-			return;
+
+			return memcache_parse_rsp(r);
 		}
 
 		if (done_parsing)
@@ -673,6 +734,36 @@ dmsg_put(struct dmsg *dmsg)
 	TAILQ_INSERT_HEAD(&free_dmsgq, dmsg, m_tqe);
 }
 
+uint32_t
+dmsg_free_queue_size(void)
+{
+    return nfree_dmsgq;
+}
+
+void
+dmsg_set_pool_max(uint32_t max)
+{
+    max_free_dmsgq = max;
+}
+
+/* free up to n of the free dmsgs past the cap, least recently put first */
+uint32_t
+dmsg_shrink(uint32_t n)
+{
+    struct dmsg *dmsg;
+    uint32_t nfreed;
+
+    for (nfreed = 0; nfreed < n && max_free_dmsgq > 0 &&
+         nfree_dmsgq > max_free_dmsgq; nfreed++) {
+        dmsg = TAILQ_LAST(&free_dmsgq, dmsg_tqh);
+        nfree_dmsgq--;
+        TAILQ_REMOVE(&free_dmsgq, dmsg, m_tqe);
+        dmsg_free(dmsg);
+    }
+
+    return nfreed;
+}
+
 void
 dmsg_dump(struct dmsg *dmsg)
 {
@@ -739,6 +830,7 @@ done:
     dmsg->data = NULL;
 
     dmsg->plen = 0;
+    dmsg->pdone = 0;
     dmsg->payload = NULL;
 
     dmsg->type = DMSG_UNKNOWN;
@@ -755,7 +847,7 @@ done:
 
 rstatus_t 
 dmsg_write(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
-         struct conn *conn, uint32_t payload_len)
+         struct conn *conn, uint32_t payload_len, uint8_t flags)
 {
 
     mbuf_write_string(mbuf, &MAGIC_STR);
@@ -769,10 +861,12 @@ dmsg_write(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
     mbuf_write_char(mbuf, ' ');
     //encryption bit
     if (conn->dnode_secured) {
-       mbuf_write_uint8(mbuf, 1);
-    } else {
-       mbuf_write_uint8(mbuf, 0);
+       flags |= DMSG_BIT_ENCRYPTED;
+    }
+    if (dnode_compress_threshold() > 0) {
+       flags |= DMSG_BIT_COMPRESS_OK;
     }
+    mbuf_write_uint8(mbuf, flags);
 
     //version
     mbuf_write_char(mbuf, ' ');
@@ -817,6 +911,60 @@ dmsg_write(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
     return DN_OK;
 }
 
+/*
+ * Header of a batched frame: 'count' requests of the same type follow it back
+ * to back. Same layout as dmsg_write, with the batch bit set and the count in
+ * place of the data field. Never used on secured connections.
+ */
+rstatus_t
+dmsg_write_batch(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
+                 struct conn *conn, uint32_t count, uint32_t payload_len)
+{
+    uint32_t ndigits, n;
+
+    ASSERT(!conn->dnode_secured);
+
+    for (ndigits = 1, n = count; n >= 10; n /= 10) {
+        ndigits++;
+    }
+
+    mbuf_write_string(mbuf, &MAGIC_STR);
+    mbuf_write_uint64(mbuf, msg_id);
+
+    mbuf_write_char(mbuf, ' ');
+    mbuf_write_uint8(mbuf, type);
+
+    mbuf_write_char(mbuf, ' ');
+    if (dnode_compress_threshold() > 0) {
+       mbuf_write_uint8(mbuf, DMSG_BIT_BATCH | DMSG_BIT_COMPRESS_OK);
+    } else {
+       mbuf_write_uint8(mbuf, DMSG_BIT_BATCH);
+    }
+
+    mbuf_write_char(mbuf, ' ');
+    mbuf_write_uint8(mbuf, version);
+
+    mbuf_write_char(mbuf, ' ');
+    if (conn->same_dc)
+   	 mbuf_write_uint8(mbuf, 1);
+    else
+   	 mbuf_write_uint8(mbuf, 0);
+
+    //data: # of requests in the frame
+    mbuf_write_char(mbuf, ' ');
+    mbuf_write_char(mbuf, '*');
+    mbuf_write_uint32(mbuf, ndigits);
+    mbuf_write_char(mbuf, ' ');
+    mbuf_write_uint32(mbuf, count);
+
+    mbuf_write_char(mbuf, ' ');
+    mbuf_write_char(mbuf, '*');
+    mbuf_write_uint32(mbuf, payload_len);
+    mbuf_write_string(mbuf, &CRLF_STR);
+
+    return DN_OK;
+}
+
 //Used in gossip forwarding msg only for now
 rstatus_t
 dmsg_write_mbuf(struct mbuf *mbuf, uint64_t msg_id, uint8_t type, struct conn *conn, uint32_t plen)
@@ -879,7 +1027,11 @@ dmsg_write_mbuf(struct mbuf *mbuf, uint64_t msg_id, uint8_t type, struct conn *c
 static rstatus_t
 dmsg_to_gossip(struct ring_msg *rmsg)
 {
-        CBUF_Push(C2G_InQ, rmsg);
+        if (!ring_queue_push(&C2G_InQ, rmsg)) {
+                log_warn("core to gossip queue is full, dropping msg");
+                ring_msg_deinit(rmsg);
+                return DN_ERROR;
+        }
 
         return DN_OK;
 }
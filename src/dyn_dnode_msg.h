@@ -10,6 +10,15 @@
 #define _DYN_DNODE_MSG_H_
 
 
+/* dmsg bit_field flags */
+#define DMSG_BIT_ENCRYPTED    0x1
+#define DMSG_BIT_COMPRESSED   0x2
+#define DMSG_BIT_BATCH        0x4   /* data field carries the # of requests packed
+                                       back to back after this header */
+#define DMSG_BIT_COMPRESS_OK  0x8   /* sender takes compressed payloads */
+
+#define DMSG_HEADER_MAX       128   /* longest header, not counting an rsa encrypted aes key */
+
 typedef enum dmsg_version {
     VERSION_10 = 1
 } dmsg_version_t;
@@ -74,6 +83,7 @@ struct dmsg {
     uint8_t  *data;                       /*  data */ 
 
     uint32_t plen;                        /* payload length */
+    uint32_t pdone;                       /* payload bytes received so far, when encrypted or compressed */
     uint8_t  *payload;                    /* pointer to payload */
 };
 
@@ -89,13 +99,20 @@ void dmsg_put(struct dmsg *dmsg);
 void dmsg_dump(struct dmsg *dmsg);
 void dmsg_init(void);
 void dmsg_deinit(void);
+uint32_t dmsg_free_queue_size(void);
+void dmsg_set_pool_max(uint32_t max);
+uint32_t dmsg_shrink(uint32_t n);
 bool dmsg_empty(struct dmsg *msg);
 struct dmsg *dmsg_get(void);
 rstatus_t dmsg_write(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
-		             struct conn *conn, uint32_t payload_len);
+		             struct conn *conn, uint32_t payload_len, uint8_t flags);
+
+rstatus_t dmsg_write_batch(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
+		             struct conn *conn, uint32_t count, uint32_t payload_len);
 
 rstatus_t dmsg_write_mbuf(struct mbuf *mbuf, uint64_t msg_id, uint8_t type,
 		                  struct conn *conn, uint32_t plen);
+rstatus_t dmsg_payload_recv(struct msg *r, uint8_t *pos, uint32_t len);
 bool dmsg_process(struct context *ctx, struct conn *conn, struct dmsg *dmsg);
 
 #endif
@@ -152,6 +152,10 @@ dnode_peer_add_local(struct server_pool *pool, struct server *peer)
 
 	peer->next_retry = 0LL;
 	peer->failure_count = 0;
+	peer->latency = 0LL;
+	peer->latency_at = 0LL;
+	peer->outstanding = 0;
+	peer->overloaded = 0;
 	peer->is_seed = 1;
 	string_copy(&peer->dc, pool->dc.data, pool->dc.len);
 	peer->owner = pool;
@@ -532,6 +536,9 @@ dnode_peer_close(struct context *ctx, struct conn *conn)
 	dnode_peer_close_stats(ctx, conn->owner, conn->err, conn->eof,
 			conn->connected);
 
+	dyn_aes_conn_deinit(conn);
+	dyn_compress_conn_deinit(conn);
+
 	if (conn->sd < 0) {
 		dnode_peer_failure(ctx, conn->owner);
 		conn->unref(conn);
@@ -539,6 +546,9 @@ dnode_peer_close(struct context *ctx, struct conn *conn)
 		return;
 	}
 
+	conn->dbatch_msg = NULL;
+	conn->dbatch_tail = NULL;
+
 	for (msg = TAILQ_FIRST(&conn->imsg_q); msg != NULL; msg = nmsg) {
 		nmsg = TAILQ_NEXT(msg, s_tqe);
 
@@ -571,6 +581,8 @@ dnode_peer_close(struct context *ctx, struct conn *conn)
 					"len %"PRIu32" type %d from c %d%c %s", conn->sd, msg->id,
 					msg->mlen, msg->type, c_conn->sd, conn->err ? ':' : ' ',
 							conn->err ? strerror(conn->err): " ");
+
+			rspmgr_submit(ctx, msg);
 		}
 
 		stats_pool_incr(ctx, server->owner, peer_dropped_requests);
@@ -603,6 +615,8 @@ dnode_peer_close(struct context *ctx, struct conn *conn)
 					"len %"PRIu32" type %d from c %d%c %s", conn->sd, msg->id,
 					msg->mlen, msg->type, c_conn->sd, conn->err ? ':' : ' ',
 							conn->err ? strerror(conn->err): " ");
+
+			rspmgr_submit(ctx, msg);
 		}
 	}
 	ASSERT(TAILQ_EMPTY(&conn->omsg_q));
@@ -832,6 +846,10 @@ dnode_peer_add_node(struct server_pool *sp, struct node *node)
 
 	s->next_retry = 0LL;
 	s->failure_count = 0;
+	s->latency = 0LL;
+	s->latency_at = 0LL;
+	s->outstanding = 0;
+	s->overloaded = 0;
 	s->is_seed = node->is_seed;
 
 	log_debug(LOG_VERB, "add a node to peer %"PRIu32" '%.*s'",
@@ -1159,27 +1177,6 @@ dnode_peer_pool_update(struct server_pool *pool)
 
 }
 
-static struct dyn_token *
-dnode_peer_pool_hash(struct server_pool *pool, uint8_t *key, uint32_t keylen)
-{
-	ASSERT(array_n(&pool->peers) != 0);
-	ASSERT(key != NULL && keylen != 0);
-
-	struct dyn_token *token = dn_alloc(sizeof(struct dyn_token));
-	if (token == NULL) {
-		return NULL;
-	}
-	init_dyn_token(token);
-
-	rstatus_t status = pool->key_hash((char *)key, keylen, token);
-	if (status != DN_OK) {
-		dn_free(token);
-		return NULL;
-	}
-
-	return token;
-}
-
 static struct server *
 dnode_peer_pool_reroute_server(struct server_pool *pool, struct rack *rack, uint8_t *key, uint32_t keylen)
 {
@@ -1201,27 +1198,25 @@ dnode_peer_pool_reroute_server(struct server_pool *pool, struct rack *rack, uint
 }
 
 static struct server *
-dnode_peer_pool_server(struct server_pool *pool, struct rack *rack, uint8_t *key, uint32_t keylen)
+dnode_peer_pool_server(struct server_pool *pool, struct rack *rack, struct msg *msg,
+		uint8_t *key, uint32_t keylen)
 {
 	struct server *server;
 	uint32_t idx;
-	struct dyn_token *token = NULL;
+	struct dyn_token *token;
 
 	ASSERT(array_n(&pool->peers) != 0);
 
 	if (keylen == 0) {
 		idx = 0; //for no argument command
 	} else {
-		token = dnode_peer_pool_hash(pool, key, keylen);
+		token = msg_key_token(pool, msg, key, keylen);
+		if (token == NULL) {
+			return NULL;
+		}
 		//print_dyn_token(token, 1);
-		idx = vnode_dispatch(rack->continuum, rack->ncontinuum, token);
+		idx = vnode_rack_dispatch(rack, token);
 		//loga("found idx %d for rack '%.*s' ", idx, rack->name->len, rack->name->data);
-
-		//TODOs: should reuse the token
-		if (token != NULL) {
-			deinit_dyn_token(token);
-			dn_free(token);
-		}
 	}
 
 	ASSERT(idx < array_n(&pool->peers));
@@ -1245,7 +1240,7 @@ dnode_peer_pool_server(struct server_pool *pool, struct rack *rack, uint8_t *key
 
 struct conn *
 dnode_peer_pool_conn(struct context *ctx, struct server_pool *pool, struct rack *rack,
-		uint8_t *key, uint32_t keylen, uint8_t msg_type)
+		struct msg *msg, uint8_t *key, uint32_t keylen)
 {
 	rstatus_t status;
 	struct server *server;
@@ -1261,11 +1256,11 @@ dnode_peer_pool_conn(struct context *ctx, struct server_pool *pool, struct rack
 		return NULL;
 	}
 
-	if (msg_type == 1) {  //always local
+	if (msg->msg_type == 1) {  //always local
 		server = array_get(&pool->peers, 0);
 	} else {
 		/* from a given {key, keylen} pick a server from pool */
-		server = dnode_peer_pool_server(pool, rack, key, keylen);
+		server = dnode_peer_pool_server(pool, rack, msg, key, keylen);
 		if (server == NULL) {
 			log_debug(LOG_VERB, "What? There is no such server in rack '%.*s' for key '%.*s'",
 					rack->name, keylen, key);
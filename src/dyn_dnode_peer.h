@@ -26,7 +26,7 @@ void dnode_peer_close(struct context *ctx, struct conn *conn);
 void dnode_peer_connected(struct context *ctx, struct conn *conn);
 void dnode_peer_ok(struct context *ctx, struct conn *conn);
 
-struct conn *dnode_peer_pool_conn(struct context *ctx, struct server_pool *pool, struct rack *rack, uint8_t *key, uint32_t keylen, uint8_t msg_type);
+struct conn *dnode_peer_pool_conn(struct context *ctx, struct server_pool *pool, struct rack *rack, struct msg *msg, uint8_t *key, uint32_t keylen);
 rstatus_t dnode_peer_pool_run(struct server_pool *pool);
 rstatus_t dnode_peer_pool_update(struct server_pool *pool);
 rstatus_t dnode_peer_pool_preconnect(struct context *ctx);
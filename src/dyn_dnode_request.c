@@ -66,6 +66,7 @@ dnode_req_peer_dequeue_imsgq(struct context *ctx, struct conn *conn, struct msg
 	ASSERT(!conn->dnode_client && !conn->dnode_server);
 
 	TAILQ_REMOVE(&conn->imsg_q, msg, s_tqe);
+	server_outstanding_decr(conn);
 
 	struct server_pool *pool = (struct server_pool *) array_get(&ctx->pool, 0);
 	stats_pool_decr(ctx, pool, peer_in_queue);
@@ -93,6 +94,7 @@ dnode_req_peer_enqueue_omsgq(struct context *ctx, struct conn *conn, struct msg
 	ASSERT(!conn->dnode_client && !conn->dnode_server);
 
 	TAILQ_INSERT_TAIL(&conn->omsg_q, msg, s_tqe);
+	server_outstanding_incr(conn);
 
 	//use only the 1st pool
 	struct server_pool *pool = (struct server_pool *) array_get(&ctx->pool, 0);
@@ -123,6 +125,7 @@ dnode_req_peer_dequeue_omsgq(struct context *ctx, struct conn *conn, struct msg
 	msg_tmo_delete(msg);
 
 	TAILQ_REMOVE(&conn->omsg_q, msg, s_tqe);
+	server_outstanding_decr(conn);
 
 	//use the 1st pool
 	struct server_pool *pool = (struct server_pool *) array_get(&ctx->pool, 0);
@@ -192,6 +195,7 @@ dnode_req_forward_error(struct context *ctx, struct conn *conn, struct msg *msg)
 		}
 	}
 
+	rspmgr_submit(ctx, msg);
 }
 
 
@@ -212,6 +216,11 @@ dnode_req_forward(struct context *ctx, struct conn *conn, struct msg *msg)
 	key = NULL;
 	keylen = 0;
 
+	/* a write from a peer stales the near cache too */
+	if (!msg->is_read) {
+		req_cache_invalidate(msg);
+	}
+
 	if (!string_empty(&pool->hash_tag)) {
 		struct string *tag = &pool->hash_tag;
 		uint8_t *tag_start, *tag_end;
@@ -235,6 +244,11 @@ dnode_req_forward(struct context *ctx, struct conn *conn, struct msg *msg)
 	if (msg->dmsg->type == DMSG_REQ) {
 	   local_req_forward(ctx, conn, msg, key, keylen);
 	} else if (msg->dmsg->type == DMSG_REQ_FORWARD) {
+		/* hash once, before msg is cloned for every rack */
+		if (keylen != 0) {
+			IGNORE_RET_VAL(msg_key_token(pool, msg, key, keylen));
+		}
+
 		struct mbuf *orig_mbuf = STAILQ_FIRST(&msg->mhdr);
 		struct datacenter *dc = server_get_dc(pool, &pool->dc);
 		uint32_t rack_cnt = array_n(&dc->racks);
@@ -291,39 +305,58 @@ dnode_req_recv_done(struct context *ctx, struct conn *conn,
 }
 
 
+/*
+ * Once the request carrying a batched frame header is picked for sending,
+ * the header can no longer be rewritten, so the batch is closed.
+ */
+static struct msg *
+dnode_req_send_next_batch(struct conn *conn, struct msg *msg)
+{
+	if (msg != NULL && msg == conn->dbatch_msg) {
+		conn->dbatch_msg = NULL;
+		conn->dbatch_tail = NULL;
+	}
+
+	return msg;
+}
+
+/*
+ * Requests to a peer are paced by its msg and byte budgets, which differ for
+ * same-DC and cross-DC peers. Out of either, the peer is not written to
+ * until the bucket has refilled.
+ */
 struct msg *
 dnode_req_send_next(struct context *ctx, struct conn *conn)
 {
-	rstatus_t status;
+	struct msg *msg;
+	uint32_t msg_rate, byte_rate;
+	int64_t now, wait;
 
 	ASSERT(!conn->dnode_client && !conn->dnode_server);
 
-	uint32_t now = time(NULL);
-	//throttling the sending traffics here
-	if (!conn->same_dc) {
-		if (conn->last_sent != 0) {
-			uint32_t elapsed_time = now - conn->last_sent;
-			uint32_t earned_tokens = elapsed_time * msgs_per_sec();
-			conn->avail_tokens = (conn->avail_tokens + earned_tokens) < msgs_per_sec()?
-					conn->avail_tokens + earned_tokens : msgs_per_sec();
-
-		}
+	msg_rate = msgs_per_sec(conn->same_dc);
+	byte_rate = bytes_per_sec(conn->same_dc);
 
-		conn->last_sent = now;
-		if (conn->avail_tokens > 0) {
-			conn->avail_tokens--;
-			return req_send_next(ctx, conn);
+	if (msg_rate != 0 || byte_rate != 0) {
+		now = dn_usec_now();
+		wait = MAX(token_bucket_wait(&conn->msg_bucket, msg_rate, now),
+				   token_bucket_wait(&conn->byte_bucket, byte_rate, now));
+		if (wait > 0) {
+			conn_throttle(ctx, conn, wait);
+			return NULL;
 		}
+	}
 
-		//requeue
-		status = event_add_out(ctx->evb, conn);
-        IGNORE_RET_VAL(status);
+	msg = dnode_req_send_next_batch(conn, req_send_next(ctx, conn));
 
-		return NULL;
+	/* a msg sent partially comes around again; it is paid for once */
+	if (msg != NULL && !msg->charged) {
+		msg->charged = 1;
+		token_bucket_take(&conn->msg_bucket, msg_rate, 1);
+		token_bucket_take(&conn->byte_bucket, byte_rate, msg_length(msg));
 	}
 
-	conn->last_sent = now;
-	return req_send_next(ctx, conn);
+	return msg;
 }
 
 void
@@ -349,6 +382,80 @@ dnode_peer_req_forward_stats(struct context *ctx, struct server *server, struct
 }
 
 
+/* A request that gets compressed travels in a frame of its own */
+static bool
+dnode_peer_req_compressible(struct conn *p_conn, struct msg *msg,
+		                    dmsg_type_t msg_type)
+{
+	uint32_t threshold = dnode_compress_threshold();
+
+	return msg_type == DMSG_REQ_FORWARD && p_conn->dnode_compress &&
+		   threshold > 0 && msg_length(msg) >= threshold;
+}
+
+
+/*
+ * Pack a request into the open batched frame on the peer conn. This is
+ * possible when the frame header has not been picked for sending yet, the
+ * frame's requests are still the tail of the peer inq and they share the
+ * same dmsg type. The frame header is rewritten with the new count.
+ *
+ * The receiver numbers the packed requests on from the frame's id, so each
+ * one takes the next peer_msg_id; once another frame has taken an id, the
+ * batch is closed.
+ */
+static bool
+dnode_peer_req_batch(struct context *ctx, struct conn *p_conn, struct msg *msg,
+		             dmsg_type_t msg_type)
+{
+	struct msg *head = p_conn->dbatch_msg;
+	struct mbuf *header_buf;
+	uint32_t plen;
+
+	if (head == NULL || p_conn->dnode_secured ||
+		p_conn->dbatch_type != msg_type ||
+		p_conn->dbatch_cnt >= dnode_batch_size() ||
+		peer_msg_id != p_conn->dbatch_id + p_conn->dbatch_cnt ||
+		TAILQ_LAST(&p_conn->imsg_q, msg_tqh) != p_conn->dbatch_tail ||
+		dnode_peer_req_compressible(p_conn, msg, msg_type)) {
+		p_conn->dbatch_msg = NULL;
+		p_conn->dbatch_tail = NULL;
+		return false;
+	}
+
+	plen = msg_length(msg);
+	header_buf = STAILQ_FIRST(&head->mhdr);
+	mbuf_rewind(header_buf);
+	dmsg_write_batch(header_buf, p_conn->dbatch_id, msg_type, p_conn,
+			         p_conn->dbatch_cnt + 1, p_conn->dbatch_plen + plen);
+
+	peer_msg_id++;
+	p_conn->dbatch_cnt++;
+	p_conn->dbatch_plen += plen;
+	p_conn->dbatch_tail = msg;
+
+	p_conn->enqueue_inq(ctx, p_conn, msg);
+
+	return true;
+}
+
+/* Open a batched frame with a request that just got its own header */
+static void
+dnode_peer_req_batch_open(struct conn *p_conn, struct msg *msg,
+		                  uint64_t msg_id, dmsg_type_t msg_type)
+{
+	if (p_conn->dnode_secured || dnode_batch_size() <= 1) {
+		return;
+	}
+
+	p_conn->dbatch_msg = msg;
+	p_conn->dbatch_tail = msg;
+	p_conn->dbatch_id = msg_id;
+	p_conn->dbatch_cnt = 1;
+	p_conn->dbatch_plen = msg_length(msg);
+	p_conn->dbatch_type = msg_type;
+}
+
 /* Forward a client request over to a peer */
 void dnode_peer_req_forward(struct context *ctx, struct conn *c_conn, struct conn *p_conn,
 		struct msg *msg, struct rack *rack,
@@ -366,7 +473,7 @@ void dnode_peer_req_forward(struct context *ctx, struct conn *c_conn, struct con
 	struct string *dc = rack->dc;
 	rstatus_t status;
 	/* enqueue message (request) into client outq, if response is expected */
-	if (!msg->noreply && !msg->swallow) {
+	if (!msg->noreply && !msg->swallow && !rspmgr_is_replica(msg)) {
 		c_conn->enqueue_outq(ctx, c_conn, msg);
 	}
 
@@ -381,17 +488,28 @@ void dnode_peer_req_forward(struct context *ctx, struct conn *c_conn, struct con
 		return;
 	}
 
+	struct server_pool *pool = c_conn->owner;
+	dmsg_type_t msg_type = (string_compare(&pool->dc, dc) != 0)? DMSG_REQ_FORWARD : DMSG_REQ;
+
+	if (dnode_peer_req_batch(ctx, p_conn, msg, msg_type)) {
+		dnode_peer_req_forward_stats(ctx, p_conn->owner, msg);
+		return;
+	}
+
 	uint64_t msg_id = peer_msg_id++;
 
-	struct mbuf *header_buf = mbuf_get();
+	struct mbuf *header_buf = mbuf_get_size(DMSG_HEADER_MAX + (size_t)dyn_rsa_size());
 	if (header_buf == NULL) {
 		loga("Unable to obtain an mbuf for dnode msg's header!");
 		req_put(msg);
 		return;
 	}
 
-	struct server_pool *pool = c_conn->owner;
-	dmsg_type_t msg_type = (string_compare(&pool->dc, dc) != 0)? DMSG_REQ_FORWARD : DMSG_REQ;
+	//compress before encrypting; only cross-DC payloads are worth it
+	uint8_t flags = 0;
+	if (msg_type == DMSG_REQ_FORWARD && dyn_compress_msg(p_conn, msg) == DN_OK) {
+		flags |= DMSG_BIT_COMPRESSED;
+	}
 
 	if (p_conn->dnode_secured) {
 		//Encrypting and adding header for a request
@@ -401,7 +519,7 @@ void dnode_peer_req_forward(struct context *ctx, struct conn *c_conn, struct con
 
 		//write dnode header
 		if (ENCRYPTION) {
-			status = dyn_aes_encrypt_msg(msg, p_conn->aes_key);
+			status = dyn_aes_encrypt_msg(msg, p_conn, msg_id, msg_type);
 			if (status == DN_ERROR) {
 				loga("OOM to obtain an mbuf for encryption!");
 				mbuf_put(header_buf);
@@ -413,17 +531,20 @@ void dnode_peer_req_forward(struct context *ctx, struct conn *c_conn, struct con
 			   log_debug(LOG_VERB, "#encrypted bytes : %d", status);
 			}
 
-			dmsg_write(header_buf, msg_id, msg_type, p_conn, msg_length(msg));
+			dmsg_write(header_buf, msg_id, msg_type, p_conn, msg_length(msg), flags);
 		} else {
 			if (log_loggable(LOG_VVERB)) {
 			   log_debug(LOG_VERB, "no encryption on the msg payload");
 			}
-			dmsg_write(header_buf, msg_id, msg_type, p_conn, msg_length(msg));
+			dmsg_write(header_buf, msg_id, msg_type, p_conn, msg_length(msg), flags);
 		}
 
 	} else {
 		//write dnode header
-		dmsg_write(header_buf, msg_id, msg_type, p_conn, msg_length(msg));
+		dmsg_write(header_buf, msg_id, msg_type, p_conn, msg_length(msg), flags);
+		if (!(flags & DMSG_BIT_COMPRESSED)) {
+			dnode_peer_req_batch_open(p_conn, msg, msg_id, msg_type);
+		}
 	}
 
 	mbuf_insert_head(&msg->mhdr, header_buf);
@@ -468,7 +589,7 @@ peer_gossip_forward1(struct context *ctx, struct conn *conn, bool redis, struct
 
     uint64_t msg_id = peer_msg_id++;
 
-	dmsg_write(nbuf, msg_id, GOSSIP_SYN, version, data);
+	dmsg_write(nbuf, msg_id, GOSSIP_SYN, version, data, 0);
 	mbuf_insert_head(&msg->mhdr, nbuf);
 
     if (TAILQ_EMPTY(&conn->imsg_q)) {
@@ -519,29 +640,25 @@ dnode_peer_gossip_forward(struct context *ctx, struct conn *conn, bool redis, st
 		}
 
 		if (ENCRYPTION) {
-			struct mbuf *encrypted_buf = mbuf_get();
-			if (encrypted_buf == NULL) {
-				loga("Unable to obtain an data_buf for encryption!");
-				return; //TODOs: need to clean up
+			if (log_loggable(LOG_VVERB)) {
+				log_hexdump(LOG_VVERB, data_buf->pos, mbuf_length(data_buf), "dyn message original payload: ");
+			}
+
+			mbuf_insert(&msg->mhdr, data_buf);
+			status = dyn_aes_encrypt_msg(msg, conn, msg_id, GOSSIP_SYN);
+			if (status == DN_ERROR) {
+				loga("Unable to encrypt gossip data!");
+				mbuf_put(header_buf);
+				dnode_rsp_put(msg);
+				return;
 			}
 
-			status = dyn_aes_encrypt(data_buf->pos, mbuf_length(data_buf), encrypted_buf, conn->aes_key);
 			if (log_loggable(LOG_VERB)) {
 			   log_debug(LOG_VERB, "#encrypted bytes : %d", status);
 			}
 
 			//write dnode header
-			dmsg_write(header_buf, msg_id, GOSSIP_SYN, conn, mbuf_length(encrypted_buf));
-
-			if (log_loggable(LOG_VVERB)) {
-				log_hexdump(LOG_VVERB, data_buf->pos, mbuf_length(data_buf), "dyn message original payload: ");
-				log_hexdump(LOG_VVERB, encrypted_buf->pos, mbuf_length(encrypted_buf), "dyn message encrypted payload: ");
-			}
-
-			mbuf_remove(&msg->mhdr, data_buf);
-			mbuf_insert(&msg->mhdr, encrypted_buf);
-			//free data_buf as no one will need it again
-			mbuf_put(data_buf);  //TODOS: need to remove this from the msg->mhdr as in the other method
+			dmsg_write(header_buf, msg_id, GOSSIP_SYN, conn, mbuf_length(data_buf), 0);
 
 		} else {
 			if (log_loggable(LOG_VVERB)) {
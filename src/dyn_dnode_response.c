@@ -5,6 +5,7 @@
 
 #include "dyn_core.h"
 #include "dyn_dnode_peer.h"
+#include "dyn_node_snitch.h"
 
 
 struct msg *
@@ -128,6 +129,8 @@ dnode_rsp_forward(struct context *ctx, struct conn *peer_conn, struct msg *msg)
 	peer_conn->dequeue_outq(ctx, peer_conn, pmsg);
 	pmsg->done = 1;
 
+	snitch_update(peer_conn->owner, pmsg->qtime_in_microsec, dn_usec_now());
+
 	/* establish msg <-> pmsg (response <-> request) link */
 	pmsg->peer = msg;
 	msg->peer = pmsg;
@@ -146,6 +149,8 @@ dnode_rsp_forward(struct context *ctx, struct conn *peer_conn, struct msg *msg)
 	}
 
 	dnode_rsp_forward_stats(ctx, peer_conn->owner, msg);
+
+	rspmgr_submit(ctx, pmsg);
 }
 
 
@@ -189,7 +194,7 @@ dnode_rsp_gos_syn(struct context *ctx, struct conn *p_conn, struct msg *msg)
 	uint8_t type = GOSSIP_SYN_REPLY;
 	struct string data = string("SYN_REPLY_OK");
 
-	dmsg_write(nbuf, msg_id, type, p_conn, 0);
+	dmsg_write(nbuf, msg_id, type, p_conn, 0, 0);
 	mbuf_insert(&pmsg->mhdr, nbuf);
 
 	//dnode_rsp_recv_done(ctx, p_conn, msg, pmsg);
@@ -271,12 +276,19 @@ dnode_rsp_send_next(struct context *ctx, struct conn *conn)
 		//need to deal with multi-block later
 		uint64_t msg_id = pmsg->dmsg->id;
 
-		struct mbuf *header_buf = mbuf_get();
+		struct mbuf *header_buf = mbuf_get_size(DMSG_HEADER_MAX + (size_t)dyn_rsa_size());
 		if (header_buf == NULL) {
 			loga("Unable to obtain an mbuf for header!");
 			return NULL; //need to address error here properly
 		}
 		dmsg_type_t msg_type = DMSG_RES;
+
+		//a reply to a cross-DC request goes back compressed too
+		uint8_t flags = 0;
+		if (pmsg->dmsg->type == DMSG_REQ_FORWARD && dyn_compress_msg(conn, msg) == DN_OK) {
+			flags |= DMSG_BIT_COMPRESSED;
+		}
+
 		//TODOs: need to set the outcoming conn to be secured too if the incoming conn is secured
 		if (pmsg->owner->dnode_secured || conn->dnode_secured) {
 			if (log_loggable(LOG_VVERB)) {
@@ -285,7 +297,7 @@ dnode_rsp_send_next(struct context *ctx, struct conn *conn)
 			}
 
 			if (ENCRYPTION) {
-			  status = dyn_aes_encrypt_msg(msg, conn->aes_key);
+			  status = dyn_aes_encrypt_msg(msg, conn, msg_id, msg_type);
 			  if (status == DN_ERROR) {
 					loga("OOM to obtain an mbuf for encryption!");
 					mbuf_put(header_buf);
@@ -297,17 +309,17 @@ dnode_rsp_send_next(struct context *ctx, struct conn *conn)
 				   log_debug(LOG_VERB, "#encrypted bytes : %d", status);
 			  }
 
-			  dmsg_write(header_buf, msg_id, msg_type, conn, msg_length(msg));
+			  dmsg_write(header_buf, msg_id, msg_type, conn, msg_length(msg), flags);
 			} else {
 				if (log_loggable(LOG_VVERB)) {
 				   log_debug(LOG_VERB, "no encryption on the msg payload");
 				}
-				dmsg_write(header_buf, msg_id, msg_type, conn, msg_length(msg));
+				dmsg_write(header_buf, msg_id, msg_type, conn, msg_length(msg), flags);
 			}
 
 		} else {
 			//write dnode header
-			dmsg_write(header_buf, msg_id, msg_type, conn, msg_length(msg));
+			dmsg_write(header_buf, msg_id, msg_type, conn, msg_length(msg), flags);
 		}
 
 		mbuf_insert_head(&msg->mhdr, header_buf);
@@ -81,15 +81,26 @@ static rstatus_t
 dnode_reuse(struct conn *p)
 {
     rstatus_t status;
+    struct server_pool *pool = p->owner;
     struct sockaddr_un *un;
 
     switch (p->family) {
     case AF_INET:
     case AF_INET6:
         status = dn_set_reuseaddr(p->sd);
+        if (status == DN_OK && pool->ctx->nworkers > 1) {
+            status = dn_set_reuseport(p->sd);
+        }
         break;
 
     case AF_UNIX:
+        if (pool->ctx->nworkers > 1) {
+            /* workers cannot share a unix domain socket path */
+            errno = EINVAL;
+            status = DN_ERROR;
+            break;
+        }
+
         /*
          * bind() will fail if the pathname already exist. So, we call unlink()
          * to delete the pathname, in case it already exists. If it does not
@@ -70,8 +70,9 @@ static rstatus_t
 gossip_process_msgs(void)
 {
 	//TODOs: fix this to process an array of nodes
-	while (!CBUF_IsEmpty(C2G_InQ)) {
-		struct ring_msg *msg = (struct ring_msg *) CBUF_Pop(C2G_InQ);
+	struct ring_msg *msg;
+
+	while ((msg = ring_queue_pop(&C2G_InQ)) != NULL) {
 		msg->cb(msg);
 		ring_msg_deinit(msg);
 	}
@@ -81,27 +82,30 @@ gossip_process_msgs(void)
 
 
 static rstatus_t
-gossip_msg_to_core(struct server_pool *sp, struct node *node, void *cb)
+gossip_ring_msg_to_core(struct server_pool *sp, struct ring_msg *msg, void *cb)
 {
-	struct ring_msg *msg = create_ring_msg();
-	struct node *rnode = (struct node *) array_get(&msg->nodes, 0);
-	node_copy(node, rnode);
-
 	msg->cb = cb;
 	msg->sp = sp;
-	CBUF_Push(C2G_OutQ, msg);
+	if (!ring_queue_push(&C2G_OutQ, msg)) {
+		log_warn("gossip to core queue is full, dropping msg");
+		ring_msg_deinit(msg);
+		return DN_ERROR;
+	}
+
+	/* don't leave the update waiting for the core's next event or timeout */
+	event_wakeup(sp->ctx->evb);
 
 	return DN_OK;
 }
 
 static rstatus_t
-gossip_ring_msg_to_core(struct server_pool *sp, struct ring_msg *msg, void *cb)
+gossip_msg_to_core(struct server_pool *sp, struct node *node, void *cb)
 {
-	msg->cb = cb;
-	msg->sp = sp;
-	CBUF_Push(C2G_OutQ, msg);
+	struct ring_msg *msg = create_ring_msg();
+	struct node *rnode = (struct node *) array_get(&msg->nodes, 0);
+	node_copy(node, rnode);
 
-	return DN_OK;
+	return gossip_ring_msg_to_core(sp, msg, cb);
 }
 
 
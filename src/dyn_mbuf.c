@@ -22,111 +22,360 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "dyn_core.h"
 
+/*
+ * Chunks are carved out of slabs that are mmap'ed from the OS, in hugepages
+ * if asked for. Each size class has its own slabs; a slab hands out its
+ * chunks in order and takes back the ones put to it. Slabs with chunks put
+ * back sit ahead of those with only uncarved ones in their class's avail q,
+ * so that recycled chunks are reused first. Once all chunks of a slab are
+ * back and more than max_idle bytes of slabs are idle, the slab is unmapped.
+ */
+TAILQ_HEAD(mbuf_slab_tqh, mbuf_slab);
+
+struct mbuf_class {
+    size_t                 chunk_size;  /* header + data (const) */
+    size_t                 offset;      /* mbuf offset in chunk (const) - include the extra space */
+    size_t                 slab_size;   /* slab mapping size (const) */
+    struct mbuf_slab_tqh   avail_slabq; /* slabs with chunks to hand out */
+};
+
+struct mbuf_slab {
+    TAILQ_ENTRY(mbuf_slab) s_tqe;     /* link in slab q */
+    TAILQ_ENTRY(mbuf_slab) a_tqe;     /* link in avail q */
+    struct mbuf_class      *mclass;   /* owner class */
+    uint8_t                *base;     /* start of mapping */
+    size_t                 size;      /* mapping size */
+    uint32_t               nchunk;    /* # chunks in slab */
+    uint32_t               ncarved;   /* # chunks carved so far */
+    uint32_t               nused;     /* # chunks handed out */
+    uint32_t               nfree;     /* # chunks put back */
+    struct mhdr            free_q;    /* chunks put back */
+    unsigned               avail:1;   /* in avail q? */
+    unsigned               huge:1;    /* mapped in hugepages? */
+};
+
 static uint32_t nfree_mbufq;   /* # free mbuf */
-static struct mhdr free_mbufq; /* free mbuf q */
 
-static size_t mbuf_chunk_size; /* mbuf chunk size - header + data (const) */
-static size_t mbuf_offset;     /* mbuf offset in chunk (const) - include the extra space*/
+static uint32_t nfree_mbuf_refq;   /* # free reference mbuf */
+static struct mhdr free_mbuf_refq; /* free reference mbuf q */
+static uint32_t max_free_mbuf_refq; /* # free reference mbuf kept by shrink */
+
+static const size_t mbuf_class_sizes[] = MBUF_CLASS_SIZES;
+
+static struct mbuf_class mbuf_class[MBUF_NCLASS + 1]; /* by increasing size */
+static uint32_t nmbuf_class;                /* # size classes */
+static struct mbuf_class *default_class;    /* class of -m sized mbufs */
+
+static struct mbuf_slab_tqh slabq;       /* all slabs */
+static uint32_t nslab;                   /* # slabs */
+static size_t idle_slab_size;            /* bytes of slabs with no chunk handed out */
+static size_t max_idle_slab_size;        /* bytes of idle slabs kept mapped */
+static bool mbuf_hugepages;              /* map slabs in hugepages? */
+
+static void *
+mbuf_slab_map(size_t size, bool populate, bool *huge)
+{
+    void *p;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_POPULATE
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+
+#ifdef MAP_HUGETLB
+    if (mbuf_hugepages) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *huge = true;
+            return p;
+        }
+
+        log_warn("mmap of %zu bytes in hugepages failed, using regular "
+                 "pages: %s", size, strerror(errno));
+        mbuf_hugepages = false;
+    }
+#endif
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) {
+        log_error("mmap of %zu bytes failed: %s", size, strerror(errno));
+        return NULL;
+    }
+
+    *huge = false;
+    return p;
+}
+
+static struct mbuf_slab *
+mbuf_slab_create(struct mbuf_class *mclass, bool populate)
+{
+    struct mbuf_slab *slab;
+    bool huge;
+
+    slab = dn_alloc(sizeof(*slab));
+    if (slab == NULL) {
+        return NULL;
+    }
+
+    slab->size = mclass->slab_size;
+    slab->base = mbuf_slab_map(slab->size, populate, &huge);
+    if (slab->base == NULL) {
+        dn_free(slab);
+        return NULL;
+    }
+
+    slab->mclass = mclass;
+    slab->nchunk = (uint32_t)(slab->size / mclass->chunk_size);
+    slab->ncarved = 0;
+    slab->nused = 0;
+    slab->nfree = 0;
+    STAILQ_INIT(&slab->free_q);
+    slab->huge = huge ? 1 : 0;
+
+    TAILQ_INSERT_TAIL(&slabq, slab, s_tqe);
+    TAILQ_INSERT_TAIL(&mclass->avail_slabq, slab, a_tqe);
+    slab->avail = 1;
+    nslab++;
+    idle_slab_size += slab->size;
+
+    log_debug(LOG_VERB, "map mbuf slab %p of %"PRIu32" %zu byte chunks%s",
+              slab->base, slab->nchunk, mclass->chunk_size,
+              slab->huge ? " in hugepages" : "");
+
+    return slab;
+}
+
+static void
+mbuf_slab_destroy(struct mbuf_slab *slab)
+{
+    ASSERT(slab->nused == 0);
+
+    log_debug(LOG_VERB, "unmap mbuf slab %p", slab->base);
+
+    if (slab->avail) {
+        TAILQ_REMOVE(&slab->mclass->avail_slabq, slab, a_tqe);
+    }
+    TAILQ_REMOVE(&slabq, slab, s_tqe);
+    nfree_mbufq -= slab->nfree;
+    nslab--;
+    idle_slab_size -= slab->size;
+
+    munmap(slab->base, slab->size);
+    dn_free(slab);
+}
 
 static struct mbuf *
-_mbuf_get(void)
+_mbuf_get(struct mbuf_class *mclass)
 {
+    struct mbuf_slab *slab;
     struct mbuf *mbuf;
     uint8_t *buf;
 
-    //loga("_mbuf_get, nfree_mbufq = %d", nfree_mbufq);
+    slab = TAILQ_FIRST(&mclass->avail_slabq);
+    if (slab == NULL) {
+        slab = mbuf_slab_create(mclass, false);
+        if (slab == NULL) {
+            return NULL;
+        }
+    }
+
+    if (slab->nused++ == 0) {
+        idle_slab_size -= slab->size;
+    }
 
-    if (!STAILQ_EMPTY(&free_mbufq)) {
-        ASSERT(nfree_mbufq > 0);
+    if (!STAILQ_EMPTY(&slab->free_q)) {
+        ASSERT(nfree_mbufq > 0 && slab->nfree > 0);
 
-        mbuf = STAILQ_FIRST(&free_mbufq);
+        mbuf = STAILQ_FIRST(&slab->free_q);
         nfree_mbufq--;
-        STAILQ_REMOVE_HEAD(&free_mbufq, next);
+        slab->nfree--;
+        STAILQ_REMOVE_HEAD(&slab->free_q, next);
 
         ASSERT(mbuf->magic == MBUF_MAGIC);
-        goto done;
+    } else {
+        /*
+         * mbuf header is at the tail end of the mbuf. This enables us to catch
+         * buffer overrun early by asserting on the magic value during get or
+         * put operations
+         *
+         *   <------------- mbuf_chunk_size ------------------------->
+         *   +-------------------------------------------------------+
+         *   |       mbuf data                      |  mbuf header   |
+         *   |     (mbuf_offset)                    | (struct mbuf)  |
+         *   +-------------------------------------------------------+
+         *   ^           ^        ^      ^          ^^
+         *   |           |        |      |          ||
+         *   |           |        |      |          \ \mbuf->end_extra (one byte past valid bound)
+         *   \           |        |      \           \
+         *   mbuf->start \        |      mbuf->end    mbuf
+         *             mbuf->pos  |
+         *                        \
+         *                       mbuf->last (one byte past valid byte)
+         *
+         */
+        ASSERT(slab->ncarved < slab->nchunk);
+
+        buf = slab->base + slab->ncarved++ * mclass->chunk_size;
+        mbuf = (struct mbuf *)(buf + mclass->offset);
+        mbuf->magic = MBUF_MAGIC;
+        mbuf->chunk_size = (uint32_t)mclass->chunk_size;
+        mbuf->slab = slab;
     }
 
-    buf = dn_alloc(mbuf_chunk_size);
-    if (buf == NULL) {
-        return NULL;
+    /* only recycled chunks ahead of uncarved ones */
+    if (STAILQ_EMPTY(&slab->free_q)) {
+        TAILQ_REMOVE(&mclass->avail_slabq, slab, a_tqe);
+        if (slab->ncarved < slab->nchunk) {
+            TAILQ_INSERT_TAIL(&mclass->avail_slabq, slab, a_tqe);
+        } else {
+            slab->avail = 0;
+        }
     }
 
-    /*
-     * mbuf header is at the tail end of the mbuf. This enables us to catch
-     * buffer overrun early by asserting on the magic value during get or
-     * put operations
-     *
-     *   <------------- mbuf_chunk_size ------------------------->
-     *   +-------------------------------------------------------+
-     *   |       mbuf data                      |  mbuf header   |
-     *   |     (mbuf_offset)                    | (struct mbuf)  |
-     *   +-------------------------------------------------------+
-     *   ^           ^        ^      ^          ^^
-     *   |           |        |      |          ||
-     *   |           |        |      |          \ \mbuf->end_extra (one byte past valid bound)
-     *   \           |        |      \           \
-     *   mbuf->start \        |      mbuf->end    mbuf
-     *             mbuf->pos  |
-     *                        \
-     *                       mbuf->last (one byte past valid byte)
-     *
-     */
-    mbuf = (struct mbuf *)(buf + mbuf_offset);
-    mbuf->magic = MBUF_MAGIC;
-    mbuf->chunk_size = mbuf_chunk_size;
-
-done:
     STAILQ_NEXT(mbuf, next) = NULL;
     return mbuf;
 }
 
+/* give a chunk back to its slab, unmapping the slab if too many are idle */
+static void
+_mbuf_put(struct mbuf *mbuf)
+{
+    struct mbuf_slab *slab = mbuf->slab;
 
-struct mbuf *
-mbuf_get(void)
+    ASSERT(slab != NULL && slab->nused > 0);
+
+    STAILQ_INSERT_HEAD(&slab->free_q, mbuf, next);
+    slab->nfree++;
+    nfree_mbufq++;
+
+    if (slab->nfree == 1) {
+        if (slab->avail) {
+            TAILQ_REMOVE(&slab->mclass->avail_slabq, slab, a_tqe);
+        }
+        TAILQ_INSERT_HEAD(&slab->mclass->avail_slabq, slab, a_tqe);
+        slab->avail = 1;
+    }
+
+    if (--slab->nused > 0) {
+        return;
+    }
+
+    idle_slab_size += slab->size;
+    if (idle_slab_size > max_idle_slab_size) {
+        mbuf_slab_destroy(slab);
+    }
+}
+
+static struct mbuf *
+mbuf_get_class(struct mbuf_class *mclass)
 {
     struct mbuf *mbuf;
     uint8_t *buf;
 
-    mbuf = _mbuf_get();
+    mbuf = _mbuf_get(mclass);
     if (mbuf == NULL) {
    	  loga("mbuf is Null");
         return NULL;
     }
 
-    buf = (uint8_t *)mbuf - mbuf_offset;
+    buf = (uint8_t *)mbuf - mclass->offset;
     mbuf->start = buf;
-    mbuf->end = buf + mbuf_offset - MBUF_ESIZE;
-    mbuf->end_extra = buf + mbuf_offset;
+    mbuf->end = buf + mclass->offset - MBUF_ESIZE;
+    mbuf->end_extra = buf + mclass->offset;
 
-    ASSERT(mbuf->end - mbuf->start == (int)mbuf_offset);
     ASSERT(mbuf->start < mbuf->end);
 
     mbuf->pos = mbuf->start;
     mbuf->last = mbuf->start;
 
-    mbuf->read_flip = 0;
+    mbuf->refcount = 1;
+    mbuf->shared = NULL;
 
     log_debug(LOG_VVERB, "get mbuf %p", mbuf);
 
     return mbuf;
 }
 
-static void
-mbuf_free(struct mbuf *mbuf)
+struct mbuf *
+mbuf_get(void)
 {
-    uint8_t *buf;
+    return mbuf_get_class(default_class);
+}
 
-    log_debug(LOG_VVERB, "put mbuf %p len %d", mbuf, mbuf->last - mbuf->pos);
+/*
+ * Get an mbuf from the smallest class with room for size bytes, or from the
+ * largest class if none has.
+ */
+struct mbuf *
+mbuf_get_size(size_t size)
+{
+    uint32_t i;
+
+    for (i = 0; i < nmbuf_class - 1; i++) {
+        if (mbuf_class[i].offset - MBUF_ESIZE >= size) {
+            break;
+        }
+    }
+
+    return mbuf_get_class(&mbuf_class[i]);
+}
+
+/*
+ * Get a read-only mbuf that refers to the unread data [pos, last) of
+ * mbuf without copying it. The reference is only a header; the chunk
+ * that owns the data goes back to the free q once its owner and all
+ * references to it have been put.
+ *
+ * The reference has its own pos, so several connections can send the
+ * same data independently. It has no room left (last == end), so nothing
+ * can ever be appended to it.
+ */
+struct mbuf *
+mbuf_ref(struct mbuf *mbuf)
+{
+    struct mbuf *owner, *rbuf;
 
-    ASSERT(STAILQ_NEXT(mbuf, next) == NULL);
     ASSERT(mbuf->magic == MBUF_MAGIC);
 
-    buf = (uint8_t *)mbuf - mbuf_offset;
-    dn_free(buf);
+    owner = mbuf->shared != NULL ? mbuf->shared : mbuf;
+
+    if (!STAILQ_EMPTY(&free_mbuf_refq)) {
+        ASSERT(nfree_mbuf_refq > 0);
+
+        rbuf = STAILQ_FIRST(&free_mbuf_refq);
+        nfree_mbuf_refq--;
+        STAILQ_REMOVE_HEAD(&free_mbuf_refq, next);
+    } else {
+        rbuf = dn_alloc(sizeof(*rbuf));
+        if (rbuf == NULL) {
+            return NULL;
+        }
+        rbuf->magic = MBUF_MAGIC;
+    }
+
+    STAILQ_NEXT(rbuf, next) = NULL;
+    rbuf->start = mbuf->pos;
+    rbuf->pos = mbuf->pos;
+    rbuf->last = mbuf->last;
+    rbuf->end = mbuf->last;
+    rbuf->end_extra = mbuf->last;
+    rbuf->chunk_size = 0;
+    rbuf->refcount = 0;
+    rbuf->shared = owner;
+    rbuf->slab = NULL;
+
+    owner->refcount++;
+
+    log_debug(LOG_VVERB, "ref mbuf %p to %p len %d", rbuf, owner,
+              rbuf->last - rbuf->pos);
+
+    return rbuf;
 }
 
 uint32_t mbuf_free_queue_size(void)
@@ -134,6 +383,39 @@ uint32_t mbuf_free_queue_size(void)
     return 	nfree_mbufq;
 }
 
+uint32_t
+mbuf_slab_count(void)
+{
+    return nslab;
+}
+
+void
+mbuf_set_ref_pool_max(uint32_t max)
+{
+    max_free_mbuf_refq = max;
+}
+
+/*
+ * Free up to n of the free reference mbufs past the cap. Chunks need no
+ * shrinking; their idle slabs are unmapped as they are put.
+ */
+uint32_t
+mbuf_shrink(uint32_t n)
+{
+    struct mbuf *mbuf;
+    uint32_t nfreed;
+
+    for (nfreed = 0; nfreed < n && max_free_mbuf_refq > 0 &&
+         nfree_mbuf_refq > max_free_mbuf_refq; nfreed++) {
+        mbuf = STAILQ_FIRST(&free_mbuf_refq);
+        nfree_mbuf_refq--;
+        STAILQ_REMOVE_HEAD(&free_mbuf_refq, next);
+        dn_free(mbuf);
+    }
+
+    return nfreed;
+}
+
 
 void mbuf_dump(struct mbuf *mbuf)
 {
@@ -150,13 +432,27 @@ void mbuf_dump(struct mbuf *mbuf)
 void
 mbuf_put(struct mbuf *mbuf)
 {
+    struct mbuf *owner;
+
     log_debug(LOG_VVERB, "put mbuf %p len %d", mbuf, mbuf->last - mbuf->pos);
 
     ASSERT(STAILQ_NEXT(mbuf, next) == NULL);
     ASSERT(mbuf->magic == MBUF_MAGIC);
 
-    nfree_mbufq++;
-    STAILQ_INSERT_HEAD(&free_mbufq, mbuf, next);
+    owner = mbuf->shared;
+    if (owner != NULL) {
+        mbuf->shared = NULL;
+        nfree_mbuf_refq++;
+        STAILQ_INSERT_HEAD(&free_mbuf_refq, mbuf, next);
+        mbuf = owner;
+    }
+
+    ASSERT(mbuf->refcount > 0);
+    if (--mbuf->refcount > 0) {
+        return;
+    }
+
+    _mbuf_put(mbuf);
 }
 
 /*
@@ -201,7 +497,7 @@ mbuf_size(struct mbuf *mbuf)
 size_t
 mbuf_data_size(void)
 {
-    return mbuf_offset;
+    return default_class->offset;
 }
 
 /*
@@ -284,7 +580,9 @@ mbuf_split(struct mhdr *h, uint8_t *pos, mbuf_copy_t cb, void *cbarg)
     if (pos < mbuf->pos || pos > mbuf->last)
    	 return NULL;
 
-    nbuf = mbuf_get();
+    /* the tail of a large class mbuf may not fit in a default one */
+    size = (size_t)(mbuf->last - pos);
+    nbuf = mbuf_get_size(size);
     if (nbuf == NULL) {
         return NULL;
     }
@@ -295,7 +593,6 @@ mbuf_split(struct mhdr *h, uint8_t *pos, mbuf_copy_t cb, void *cbarg)
     }
 
     /* copy data from mbuf to nbuf */
-    size = (size_t)(mbuf->last - pos);
     mbuf_copy(nbuf, pos, size);
 
     /* adjust mbuf */
@@ -308,29 +605,105 @@ mbuf_split(struct mhdr *h, uint8_t *pos, mbuf_copy_t cb, void *cbarg)
     return nbuf;
 }
 
+/* add a class for mbufs of size bytes, unless there is one already */
+static void
+mbuf_class_add(size_t size)
+{
+    struct mbuf_class *mclass;
+    uint32_t i, j;
+
+    for (i = 0; i < nmbuf_class && mbuf_class[i].chunk_size < size + MBUF_ESIZE; i++) {
+        ;
+    }
+
+    if (i < nmbuf_class && mbuf_class[i].chunk_size == size + MBUF_ESIZE) {
+        return;
+    }
+
+    /* avail qs are set up once all classes are in */
+    for (j = nmbuf_class; j > i; j--) {
+        mbuf_class[j] = mbuf_class[j - 1];
+    }
+    nmbuf_class++;
+
+    /* a slab holds at least a few chunks of the largest classes */
+    mclass = &mbuf_class[i];
+    mclass->chunk_size = size + MBUF_ESIZE;
+    mclass->offset = mclass->chunk_size - MBUF_HSIZE;
+    mclass->slab_size = MAX(MBUF_SLAB_SIZE, 8 * mclass->chunk_size);
+    mclass->slab_size = (mclass->slab_size + MBUF_SLAB_SIZE - 1) / MBUF_SLAB_SIZE * MBUF_SLAB_SIZE;
+}
+
 void
 mbuf_init(struct instance *nci)
 {
+    struct mbuf_slab *slab;
+    size_t prealloc;
+    uint32_t i;
+
     nfree_mbufq = 0;
-    STAILQ_INIT(&free_mbufq);
 
-    mbuf_chunk_size = nci->mbuf_chunk_size + MBUF_ESIZE;
-    mbuf_offset = mbuf_chunk_size - MBUF_HSIZE;
+    nfree_mbuf_refq = 0;
+    STAILQ_INIT(&free_mbuf_refq);
+    max_free_mbuf_refq = 0;
+
+    nmbuf_class = 0;
+    for (i = 0; i < MBUF_NCLASS; i++) {
+        mbuf_class_add(mbuf_class_sizes[i]);
+    }
+    mbuf_class_add(nci->mbuf_chunk_size);
+
+    for (i = 0; i < nmbuf_class; i++) {
+        TAILQ_INIT(&mbuf_class[i].avail_slabq);
+        if (mbuf_class[i].chunk_size == nci->mbuf_chunk_size + MBUF_ESIZE) {
+            default_class = &mbuf_class[i];
+        }
+    }
+
+    TAILQ_INIT(&slabq);
+    nslab = 0;
+    idle_slab_size = 0;
+    mbuf_hugepages = nci->mbuf_hugepages ? true : false;
+
+    /* the preallocation is never given back */
+    prealloc = nci->mbuf_prealloc << 20;
+    max_idle_slab_size = MAX(nci->mbuf_max_idle << 20, prealloc);
+
+    /* slabs are populated here, so their pages are local to the core thread */
+    while (idle_slab_size < prealloc) {
+        slab = mbuf_slab_create(default_class, true);
+        if (slab == NULL) {
+            log_warn("preallocated %zu of %zu bytes of mbufs", idle_slab_size,
+                     prealloc);
+            break;
+        }
+    }
 
     log_debug(LOG_DEBUG, "mbuf hsize %d chunk size %zu offset %zu length %zu",
-              MBUF_HSIZE, mbuf_chunk_size, mbuf_offset, mbuf_offset);
+              MBUF_HSIZE, default_class->chunk_size, default_class->offset,
+              default_class->offset);
 }
 
+/* unmap the idle slabs; the ones with chunks still out are left alone */
 void
 mbuf_deinit(void)
 {
-    while (!STAILQ_EMPTY(&free_mbufq)) {
-        struct mbuf *mbuf = STAILQ_FIRST(&free_mbufq);
-        mbuf_remove(&free_mbufq, mbuf);
-        mbuf_free(mbuf);
-        nfree_mbufq--;
+    struct mbuf_slab *slab, *tslab;
+
+    for (slab = TAILQ_FIRST(&slabq); slab != NULL; slab = tslab) {
+        tslab = TAILQ_NEXT(slab, s_tqe);
+        if (slab->nused == 0) {
+            mbuf_slab_destroy(slab);
+        }
+    }
+
+    while (!STAILQ_EMPTY(&free_mbuf_refq)) {
+        struct mbuf *mbuf = STAILQ_FIRST(&free_mbuf_refq);
+        mbuf_remove(&free_mbuf_refq, mbuf);
+        dn_free(mbuf);
+        nfree_mbuf_refq--;
     }
-    ASSERT(nfree_mbufq == 0);
+    ASSERT(nfree_mbuf_refq == 0);
 }
 
 
@@ -423,6 +796,10 @@ mbuf_alloc(size_t size)
    mbuf->pos = mbuf->start;
    mbuf->last = mbuf->start;
 
+   mbuf->refcount = 1;
+   mbuf->shared = NULL;
+   mbuf->slab = NULL;
+
    return mbuf;
 }
 
@@ -28,6 +28,8 @@
 
 typedef void (*mbuf_copy_t)(struct mbuf *, void *);
 
+struct mbuf_slab;
+
 struct mbuf {
     uint32_t           magic;   /* mbuf magic (const) */
     STAILQ_ENTRY(mbuf) next;    /* next mbuf */
@@ -36,8 +38,10 @@ struct mbuf {
     uint8_t            *start;  /* start of buffer (const) */
     uint8_t            *end;    /* end of buffer (const) */
     uint8_t            *end_extra; /*end of the buffer - including the extra region */
-    uint32_t           read_flip; /* readable flag used in encryption/decryption mode */
     uint32_t           chunk_size;
+    uint32_t           refcount; /* # holders of the data in this chunk */
+    struct mbuf        *shared;  /* mbuf owning the data we point into, NULL if we own it */
+    struct mbuf_slab   *slab;    /* slab the chunk was carved from, NULL if none */
 };
 
 STAILQ_HEAD(mhdr, mbuf);
@@ -48,6 +52,10 @@ STAILQ_HEAD(mhdr, mbuf);
 #define MBUF_SIZE       16384
 #define MBUF_HSIZE      sizeof(struct mbuf)
 #define MBUF_ESIZE      16
+#define MBUF_SLAB_SIZE  (2 * 1024 * 1024) /* one 2MB hugepage */
+#define MBUF_CLASS_SIZES    { 512, 4096, 16384, 65536, 1048576 }
+#define MBUF_NCLASS         5                 /* # sizes above, -m may add one */
+#define MBUF_MAX_IDLE   64                /* MB of idle slabs kept by default */
 
 
 static inline bool
@@ -65,8 +73,13 @@ mbuf_full(struct mbuf *mbuf)
 void mbuf_init(struct instance *nci);
 void mbuf_deinit(void);
 struct mbuf *mbuf_get(void);
+struct mbuf *mbuf_get_size(size_t size);
+struct mbuf *mbuf_ref(struct mbuf *mbuf);
 void mbuf_put(struct mbuf *mbuf);
 uint32_t mbuf_free_queue_size(void);
+uint32_t mbuf_slab_count(void);
+void mbuf_set_ref_pool_max(uint32_t max);
+uint32_t mbuf_shrink(uint32_t n);
 void mbuf_dump(struct mbuf *mbuf);
 void mbuf_rewind(struct mbuf *mbuf);
 uint32_t mbuf_length(struct mbuf *mbuf);
@@ -26,6 +26,7 @@
 #include <sys/uio.h>
 
 #include "dyn_core.h"
+#include "dyn_conf.h"
 #include "dyn_server.h"
 #include "proto/dyn_proto.h"
 
@@ -118,38 +119,46 @@ static uint64_t msg_id;          /* message id counter */
 static uint64_t frag_id;         /* fragment id counter */
 static uint32_t nfree_msgq;      /* # free msg q */
 static struct msg_tqh free_msgq; /* free msg q */
-static struct rbtree tmo_rbt;    /* timeout rbtree */
-static struct rbnode tmo_rbs;    /* timeout rbtree sentinel */
+static uint32_t max_free_msgq = CONF_DEFAULT_MSG_POOL_MAX; /* # free msgs kept by shrink */
+static struct twheel tmo_wheel; /* timeout wheel */
 
 static struct msg *
-msg_from_rbe(struct rbnode *node)
+msg_from_twe(struct twnode *node)
 {
     struct msg *msg;
     int offset;
 
-    offset = offsetof(struct msg, tmo_rbe);
+    offset = offsetof(struct msg, tmo_node);
     msg = (struct msg *)((char *)node - offset);
 
     return msg;
 }
 
+/* next msg whose timeout expired by now, taken off the timeout wheel */
 struct msg *
-msg_tmo_min(void)
+msg_tmo_expire(int64_t now)
 {
-    struct rbnode *node;
+    struct twnode *node;
 
-    node = rbtree_min(&tmo_rbt);
+    node = twheel_expire(&tmo_wheel, now);
     if (node == NULL) {
         return NULL;
     }
 
-    return msg_from_rbe(node);
+    return msg_from_twe(node);
+}
+
+/* earliest msec a msg can time out at, -1 if none is waiting */
+int64_t
+msg_tmo_next(void)
+{
+    return twheel_next(&tmo_wheel);
 }
 
 void
 msg_tmo_insert(struct msg *msg, struct conn *conn)
 {
-    struct rbnode *node;
+    struct twnode *node;
     int timeout;
 
     //ASSERT(msg->request);
@@ -160,14 +169,14 @@ msg_tmo_insert(struct msg *msg, struct conn *conn)
         return;
     }
 
-    node = &msg->tmo_rbe;
+    node = &msg->tmo_node;
     node->key = dn_msec_now() + timeout;
     node->data = conn;
 
-    rbtree_insert(&tmo_rbt, node);
+    twheel_insert(&tmo_wheel, node);
 
     if (log_loggable(LOG_VERB)) {
-       log_debug(LOG_VERB, "insert msg %"PRIu64" into tmo rbt with expiry of "
+       log_debug(LOG_VERB, "insert msg %"PRIu64" into tmo wheel with expiry of "
               "%d msec", msg->id, timeout);
     }
 }
@@ -175,20 +184,20 @@ msg_tmo_insert(struct msg *msg, struct conn *conn)
 void
 msg_tmo_delete(struct msg *msg)
 {
-    struct rbnode *node;
+    struct twnode *node;
 
-    node = &msg->tmo_rbe;
+    node = &msg->tmo_node;
 
     /* already deleted */
 
-    if (node->data == NULL) {
+    if (node->head == NULL) {
         return;
     }
 
-    rbtree_delete(&tmo_rbt, node);
+    twheel_delete(&tmo_wheel, node);
 
     if (log_loggable(LOG_VERB)) {
-       log_debug(LOG_VERB, "delete msg %"PRIu64" from tmo rbt", msg->id);
+       log_debug(LOG_VERB, "delete msg %"PRIu64" from tmo wheel", msg->id);
     }
 }
 
@@ -230,6 +239,8 @@ _msg_get(bool force_alloc)
     if (msg == NULL) {
         return NULL;
     }
+    msg->keys = NULL;
+    msg->frag_map = NULL;
 
 done:
     /* c_tqe, s_tqe, and m_tqe are left uninitialized */
@@ -237,10 +248,12 @@ done:
     msg->peer = NULL;
     msg->owner = NULL;
     msg->stime_in_microsec = 0L;
+    msg->qtime_in_microsec = 0L;
 
-    rbtree_node_init(&msg->tmo_rbe);
+    twnode_init(&msg->tmo_node);
 
     STAILQ_INIT(&msg->mhdr);
+    STAILQ_INIT(&msg->plain);
     msg->mlen = 0;
 
     msg->state = 0;
@@ -250,8 +263,7 @@ done:
     msg->parser = NULL;
     msg->result = MSG_PARSE_OK;
 
-    msg->pre_splitcopy = NULL;
-    msg->post_splitcopy = NULL;
+    msg->fragment = NULL;
     msg->pre_coalesce = NULL;
     msg->post_coalesce = NULL;
 
@@ -259,19 +271,29 @@ done:
 
     msg->key_start = NULL;
     msg->key_end = NULL;
+    msg->key_buf = NULL;
+    if (msg->keys != NULL) {
+        msg->keys->nelem = 0; /* keep the allocation for the next request */
+    }
 
     msg->vlen = 0;
     msg->end = NULL;
+    msg->bin_opaque = 0;
+    msg->bin_opcode = 0;
 
     msg->frag_owner = NULL;
     msg->nfrag = 0;
     msg->frag_id = 0;
+    if (msg->frag_map != NULL) {
+        msg->frag_map->nelem = 0;
+    }
 
     msg->narg_start = NULL;
     msg->narg_end = NULL;
     msg->narg = 0;
     msg->rnarg = 0;
     msg->rlen = 0;
+    msg->vlen_rem = 0;
     msg->integer = 0;
 
     msg->err = 0;
@@ -285,7 +307,11 @@ done:
     msg->first_fragment = 0;
     msg->last_fragment = 0;
     msg->swallow = 0;
+    msg->charged = 0;
+    msg->key_hashed = 0;
     msg->redis = 0;
+    msg->binary = 0;
+    msg->quiet = 0;
 
     //dynomite
     msg->is_read = 1;
@@ -293,6 +319,8 @@ done:
     msg->dmsg = NULL;
     msg->msg_type = 0;
     msg->dyn_error = 0;
+    msg->rspmgr = NULL;
+    msg->cache_epoch = 0;
     return msg;
 }
 
@@ -334,8 +362,7 @@ msg_get(struct conn *conn, bool request, bool redis)
                msg->parser = redis_parse_rsp;
             }
         }
-        msg->pre_splitcopy = redis_pre_splitcopy;
-        msg->post_splitcopy = redis_post_splitcopy;
+        msg->fragment = redis_fragment;
         msg->pre_coalesce = redis_pre_coalesce;
         msg->post_coalesce = redis_post_coalesce;
     } else {
@@ -352,8 +379,7 @@ msg_get(struct conn *conn, bool request, bool redis)
                msg->parser = memcache_parse_rsp;
             }
         }
-        msg->pre_splitcopy = memcache_pre_splitcopy;
-        msg->post_splitcopy = memcache_post_splitcopy;
+        msg->fragment = memcache_fragment;
         msg->pre_coalesce = memcache_pre_coalesce;
         msg->post_coalesce = memcache_post_coalesce;
     }
@@ -374,8 +400,7 @@ msg_clone(struct msg *src, struct mbuf *mbuf_start, struct msg *target)
     target->redis = src->redis;
 
     target->parser = src->parser;
-    target->pre_splitcopy = src->pre_splitcopy;
-    target->post_splitcopy = src->post_splitcopy; 
+    target->fragment = src->fragment;
     target->pre_coalesce = src->pre_coalesce;
     target->post_coalesce = src->post_coalesce;
 
@@ -384,47 +409,156 @@ msg_clone(struct msg *src, struct mbuf *mbuf_start, struct msg *target)
     target->type = src->type;
     target->key_start = src->key_start;
     target->key_end = src->key_end;
+    if (src->key_buf != NULL) {
+        /* the clone may outlive src, so it gets its own decoded key */
+        target->key_buf = dn_alloc((size_t)(src->key_end - src->key_start));
+        if (target->key_buf == NULL) {
+            return DN_ENOMEM;
+        }
+        dn_memcpy(target->key_buf, src->key_start, (size_t)(src->key_end - src->key_start));
+        target->key_start = target->key_buf;
+        target->key_end = target->key_buf + (src->key_end - src->key_start);
+    }
+    target->key_token = src->key_token;
+    target->key_hashed = src->key_hashed;
     target->mlen = src->mlen;
     target->pos = src->pos;
     target->vlen = src->vlen;
     target->is_read = src->is_read;
+    target->binary = src->binary;
+    target->quiet = src->quiet;
+    target->bin_opcode = src->bin_opcode;
+    target->bin_opaque = src->bin_opaque;
 
+    /*
+     * The payload is shared, not copied: each target mbuf is a reference
+     * into the source chunk with its own read marker. A source that has
+     * been sent encrypted is cloned from its plaintext.
+     */
+    struct mhdr *mhdr = STAILQ_EMPTY(&src->plain) ? &src->mhdr : &src->plain;
     struct mbuf *mbuf, *nbuf;
     bool started = false;
-    STAILQ_FOREACH(mbuf, &src->mhdr, next) {
+    STAILQ_FOREACH(mbuf, mhdr, next) {
         if (!started && mbuf != mbuf_start) {
             continue;
         } else {
             started = true;
         }
-        nbuf = mbuf_get();
+        nbuf = mbuf_ref(mbuf);
         if (nbuf == NULL) {
             return ENOMEM;
         }
 
-        uint32_t len = mbuf_length(mbuf);
-        mbuf_copy(nbuf, mbuf->pos, len);
         mbuf_insert(&target->mhdr, nbuf);
     }
 
     return DN_OK;
 }
 
+/*
+ * Token of the routing key of a request, hashed on first use. It is kept on
+ * msg and copied to its clones, so a request fanned out to every rack and dc
+ * is hashed once. NULL if the key could not be hashed.
+ */
+struct dyn_token *
+msg_key_token(struct server_pool *pool, struct msg *msg, uint8_t *key, uint32_t keylen)
+{
+    ASSERT(key != NULL && keylen != 0);
+
+    if (!msg->key_hashed) {
+        init_dyn_token(&msg->key_token);
+        if (pool->key_hash((char *)key, keylen, &msg->key_token) != DN_OK) {
+            return NULL;
+        }
+        msg->key_hashed = 1;
+    }
+
+    return &msg->key_token;
+}
 
+/* record a key of a multi-key request; msg->keys keeps them in request order */
+rstatus_t
+msg_add_key(struct msg *msg, uint8_t *start, uint8_t *end)
+{
+    struct keypos *kpos;
+
+    if (msg->keys == NULL) {
+        msg->keys = array_create(8, sizeof(struct keypos));
+        if (msg->keys == NULL) {
+            return DN_ENOMEM;
+        }
+    }
+
+    kpos = array_push(msg->keys);
+    if (kpos == NULL) {
+        return DN_ENOMEM;
+    }
+    kpos->start = start;
+    kpos->end = end;
+
+    return DN_OK;
+}
+
+/*
+ * Room for n contiguous bytes at the tail of msg, taking an mbuf large
+ * enough for them if the last one is short. The bytes count in msg->mlen.
+ */
+uint8_t *
+msg_reserve(struct msg *msg, size_t n)
+{
+    struct mbuf *mbuf;
+    uint8_t *pos;
+
+    mbuf = STAILQ_LAST(&msg->mhdr, mbuf, next);
+    if (mbuf == NULL || mbuf_size(mbuf) < n) {
+        mbuf = mbuf_get_size(n);
+        if (mbuf == NULL || mbuf_size(mbuf) < n) {
+            if (mbuf != NULL) {
+                mbuf_put(mbuf);
+            }
+            return NULL;
+        }
+        mbuf_insert(&msg->mhdr, mbuf);
+    }
+
+    pos = mbuf->last;
+    mbuf->last += n;
+    msg->mlen += (uint32_t)n;
+
+    return pos;
+}
+
+uint64_t
+msg_gen_frag_id(void)
+{
+    return ++frag_id;
+}
+
+
+
+/*
+ * Error reply to req: a binary frame if req came in the memcache binary
+ * protocol, a text line otherwise
+ */
 struct msg *
-msg_get_error(bool redis, dyn_error_t dyn_err, err_t err)
+msg_get_error(struct msg *req, bool redis, dyn_error_t dyn_err, err_t err)
 {
     struct msg *msg;
     struct mbuf *mbuf;
     int n;
     char *errstr = err ? strerror(err) : "unknown";
     char *protstr = redis ? "-ERR" : "SERVER_ERROR";
-    char *source;
+    char *source = "";
 
     if (dyn_err == PEER_CONNECTION_REFUSE) {
     	source = "Peer:";
     } else if (dyn_err == STORAGE_CONNECTION_REFUSE) {
     	source = "Storage:";
+    } else if (dyn_err == QUORUM_NOT_REACHED) {
+    	source = "Quorum:";
+    	errstr = err ? strerror(err) : "not reached";
+    } else if (dyn_err == SERVER_OVERLOADED) {
+    	source = "Overload:";
     }
 
     msg = _msg_get(1);
@@ -442,7 +576,15 @@ msg_get_error(bool redis, dyn_error_t dyn_err, err_t err)
     }
     mbuf_insert(&msg->mhdr, mbuf);
 
-    n = dn_scnprintf(mbuf->last, mbuf_size(mbuf), "%s %s %s"CRLF, protstr, source, errstr);
+    if (req != NULL && req->binary) {
+        n = dn_scnprintf(mbuf->last + MEMCACHE_BINARY_HEADER_LEN,
+                         mbuf_size(mbuf) - MEMCACHE_BINARY_HEADER_LEN, "%s %s %s",
+                         protstr, source, errstr);
+        memcache_binary_error(req, mbuf->last, (uint32_t)n);
+        n += MEMCACHE_BINARY_HEADER_LEN;
+    } else {
+        n = dn_scnprintf(mbuf->last, mbuf_size(mbuf), "%s %s %s"CRLF, protstr, source, errstr);
+    }
     mbuf->last += n;
     msg->mlen = (uint32_t)n;
 
@@ -492,14 +634,46 @@ msg_get_rsp_integer(bool redis)
 static void
 msg_free(struct msg *msg)
 {
-    ASSERT(STAILQ_EMPTY(&msg->mhdr));
+    ASSERT(STAILQ_EMPTY(&msg->mhdr) && STAILQ_EMPTY(&msg->plain));
 
     if (log_loggable(LOG_VVERB)) {
        log_debug(LOG_VVERB, "free msg %p id %"PRIu64"", msg, msg->id);
     }
+
+    if (msg->keys != NULL) {
+        array_destroy(msg->keys);
+    }
+    if (msg->frag_map != NULL) {
+        array_destroy(msg->frag_map);
+    }
+    alloc_msg_count--;
     dn_free(msg);
 }
 
+void
+msg_set_pool_max(uint32_t max)
+{
+    max_free_msgq = max;
+}
+
+/* free up to n of the free msgs past the cap, least recently put first */
+uint32_t
+msg_shrink(uint32_t n)
+{
+    struct msg *msg;
+    uint32_t nfreed;
+
+    for (nfreed = 0; nfreed < n && max_free_msgq > 0 &&
+         nfree_msgq > max_free_msgq; nfreed++) {
+        msg = TAILQ_LAST(&free_msgq, msg_tqh);
+        nfree_msgq--;
+        TAILQ_REMOVE(&free_msgq, msg, m_tqe);
+        msg_free(msg);
+    }
+
+    return nfreed;
+}
+
 void
 msg_put(struct msg *msg)
 {
@@ -519,6 +693,16 @@ msg_put(struct msg *msg)
         mbuf_put(mbuf);
     }
 
+    while (!STAILQ_EMPTY(&msg->plain)) {
+        struct mbuf *mbuf = STAILQ_FIRST(&msg->plain);
+        mbuf_remove(&msg->plain, mbuf);
+        mbuf_put(mbuf);
+    }
+
+    if (msg->key_buf != NULL) {
+        dn_free(msg->key_buf);
+    }
+
     nfree_msgq++;
     TAILQ_INSERT_HEAD(&free_msgq, msg, m_tqe);
 }
@@ -584,7 +768,9 @@ msg_init(void)
     frag_id = 0;
     nfree_msgq = 0;
     TAILQ_INIT(&free_msgq);
-    rbtree_init(&tmo_rbt, &tmo_rbs);
+    twheel_init(&tmo_wheel, dn_msec_now());
+    rspmgr_init();
+    ncache_init();
 }
 
 void
@@ -599,6 +785,9 @@ msg_deinit(void)
         msg_free(msg);
     }
     ASSERT(nfree_msgq == 0);
+
+    rspmgr_deinit();
+    ncache_deinit();
 }
 
 bool
@@ -650,107 +839,6 @@ msg_parsed(struct context *ctx, struct conn *conn, struct msg *msg)
     return DN_OK;
 }
 
-static rstatus_t
-msg_fragment(struct context *ctx, struct conn *conn, struct msg *msg)
-{
-    rstatus_t status;  /* return status */
-    struct msg *nmsg;  /* new message */
-    struct mbuf *nbuf; /* new mbuf */
-
-    ASSERT((conn->client && !conn->proxy) || (conn->dnode_client && !conn->dnode_server));
-    ASSERT(msg->request);
-
-    nbuf = mbuf_split(&msg->mhdr, msg->pos, msg->pre_splitcopy, msg);
-    if (nbuf == NULL) {
-        return DN_ENOMEM;
-    }
-
-    status = msg->post_splitcopy(msg);
-    if (status != DN_OK) {
-        mbuf_put(nbuf);
-        return status;
-    }
-
-    nmsg = msg_get(msg->owner, msg->request, msg->redis);
-    if (nmsg == NULL) {
-        mbuf_put(nbuf);
-        return DN_ENOMEM;
-    }
-    mbuf_insert(&nmsg->mhdr, nbuf);
-    nmsg->pos = nbuf->pos;
-
-    /* update length of current (msg) and new message (nmsg) */
-    nmsg->mlen = mbuf_length(nbuf);
-    msg->mlen -= nmsg->mlen;
-
-    /*
-     * Attach unique fragment id to all fragments of the message vector. All
-     * fragments of the message, including the first fragment point to the
-     * first fragment through the frag_owner pointer. The first_fragment and
-     * last_fragment identify first and last fragment respectively.
-     *
-     * For example, a message vector given below is split into 3 fragments:
-     *  'get key1 key2 key3\r\n'
-     *  Or,
-     *  '*4\r\n$4\r\nmget\r\n$4\r\nkey1\r\n$4\r\nkey2\r\n$4\r\nkey3\r\n'
-     *
-     *   +--------------+
-     *   |  msg vector  |
-     *   |(original msg)|
-     *   +--------------+
-     *
-     *       frag_owner         frag_owner
-     *     /-----------+      /------------+
-     *     |           |      |            |
-     *     |           v      v            |
-     *   +--------------------+     +---------------------+
-     *   |   frag_id = 10     |     |   frag_id = 10      |
-     *   | first_fragment = 1 |     |  first_fragment = 0 |
-     *   | last_fragment = 0  |     |  last_fragment = 0  |
-     *   |     nfrag = 3      |     |      nfrag = 0      |
-     *   +--------------------+     +---------------------+
-     *               ^
-     *               |  frag_owner
-     *               \-------------+
-     *                             |
-     *                             |
-     *                  +---------------------+
-     *                  |   frag_id = 10      |
-     *                  |  first_fragment = 0 |
-     *                  |  last_fragment = 1  |
-     *                  |      nfrag = 0      |
-     *                  +---------------------+
-     *
-     *
-     */
-    if (msg->frag_id == 0) {
-        msg->frag_id = ++frag_id;
-        msg->first_fragment = 1;
-        msg->nfrag = 1;
-        msg->frag_owner = msg;
-    }
-    nmsg->frag_id = msg->frag_id;
-    msg->last_fragment = 0;
-    nmsg->last_fragment = 1;
-    nmsg->frag_owner = msg->frag_owner;
-    msg->frag_owner->nfrag++;
-
-    if (!conn->dyn_mode) {
-       stats_pool_incr(ctx, conn->owner, fragments);
-    } else {
-    	
-    }
-
-    if (log_loggable(LOG_VERB)) {
-       log_debug(LOG_VERB, "fragment msg into %"PRIu64" and %"PRIu64" frag id "
-              "%"PRIu64"", msg->id, nmsg->id, msg->frag_id);
-    }
-
-    conn->recv_done(ctx, conn, msg, nmsg);
-
-    return DN_OK;
-}
-
 static rstatus_t
 msg_repair(struct context *ctx, struct conn *conn, struct msg *msg)
 {
@@ -778,6 +866,7 @@ msg_parse(struct context *ctx, struct conn *conn, struct msg *msg)
 		return DN_OK;
 	}
 
+	msg->vlen_rem = 0;
 	msg->parser(msg);
 
 	switch (msg->result) {
@@ -786,11 +875,6 @@ msg_parse(struct context *ctx, struct conn *conn, struct msg *msg)
 		status = msg_parsed(ctx, conn, msg);
 		break;
 
-	case MSG_PARSE_FRAGMENT:
-		//log_debug(LOG_VVERB, "MSG_PARSE_FRAGMENT");
-		status = msg_fragment(ctx, conn, msg);
-		break;
-
 	case MSG_PARSE_REPAIR:
 		//log_debug(LOG_VVERB, "MSG_PARSE_REPAIR");
 		status = msg_repair(ctx, conn, msg);
@@ -829,33 +913,35 @@ msg_recv_chain(struct context *ctx, struct conn *conn, struct msg *msg)
 	size_t msize;
 	ssize_t n;
 
-	int expected_fill = ((msg->dyn_state == DYN_DONE || msg->dyn_state == DYN_POST_DONE) && msg->dmsg->bit_field == 1) ?
-			                    msg->dmsg->plen : -1;  //used in encryption case only
+	//encrypted or compressed payload that is still being received
+	bool payload = msg->dyn_state == DYN_POST_DONE &&
+			       (msg->dmsg->bit_field & (DMSG_BIT_ENCRYPTED | DMSG_BIT_COMPRESSED)) &&
+			       msg->dmsg->pdone < msg->dmsg->plen;
 
 	mbuf = STAILQ_LAST(&msg->mhdr, mbuf, next);
-	if (mbuf == NULL || mbuf_full(mbuf) ||
-			(expected_fill != -1 && mbuf->last == mbuf->end_extra)) {
-		mbuf = mbuf_get();
+	if (mbuf == NULL || mbuf_full(mbuf)) {
+		//the rest of a large value goes into as few mbufs of a larger class as it takes
+		if (msg->vlen_rem > mbuf_data_size()) {
+			mbuf = mbuf_get_size(msg->vlen_rem);
+		} else {
+			mbuf = mbuf_get();
+		}
 		if (mbuf == NULL) {
 			return DN_ENOMEM;
 		}
 		mbuf_insert(&msg->mhdr, mbuf);
-
 		msg->pos = mbuf->pos;
 	}
+	ASSERT(mbuf->end - mbuf->last > 0);
 
-	ASSERT(mbuf->end_extra - mbuf->last > 0);
+	msize = mbuf_size(mbuf);
 
-	if (expected_fill == -1) {
-		msize = mbuf_size(mbuf);
+	if (!STAILQ_EMPTY(&conn->inflate_q)) {
+		//an inflated payload goes through the parser before the socket is read again
+		n = dyn_inflate_q_recv(conn, mbuf->last, msize);
 	} else {
-		msize = (msg->dmsg->plen <= mbuf->end_extra - mbuf->last) ?
-				                     msg->dmsg->plen :
-				                     mbuf->end_extra - mbuf->last;
+		n = conn_recv(conn, mbuf->last, msize);
 	}
-
-	n = conn_recv(conn, mbuf->last, msize);
-
 	if (n < 0) {
 		if (n == DN_EAGAIN) {
 			return DN_OK;
@@ -863,62 +949,13 @@ msg_recv_chain(struct context *ctx, struct conn *conn, struct msg *msg)
 		return DN_ERROR;
 	}
 
-	ASSERT((mbuf->last + n) <= mbuf->end_extra);
+	ASSERT((mbuf->last + n) <= mbuf->end);
+	if (payload && dmsg_payload_recv(msg, mbuf->last, (uint32_t)n) != DN_OK) {
+		msg->dyn_error = BAD_FORMAT;
+	}
 	mbuf->last += n;
 	msg->mlen += (uint32_t)n;
 
-	//Only used in encryption case
-	if (expected_fill != -1) {
-		if ( n >=  msg->dmsg->plen  || mbuf->end_extra == mbuf->last) {
-			//log_debug(LOG_VERB, "About to decrypt this mbuf as it is full or eligible!");
-			struct mbuf *nbuf = NULL;
-
-			if (n >=  msg->dmsg->plen) {
-				nbuf = mbuf_get();
-
-				if (nbuf == NULL) {
-					loga("Not enough memory error!!!");
-					return DN_ENOMEM;
-				}
-
-				status = dyn_aes_decrypt(mbuf->start, mbuf->last - mbuf->start, nbuf, msg->owner->aes_key);
-				if (status == DN_OK) {
-					int remain = n - msg->dmsg->plen;
-					uint8_t *pos = mbuf->last - remain;
-					mbuf_copy(nbuf, pos, remain);
-				}
-
-			} else if (mbuf->end_extra == mbuf->last) {
-				nbuf = mbuf_get();
-
-				if (nbuf == NULL) {
-					loga("Not enough memory error!!!");
-					return DN_ENOMEM;
-				}
-
-				status = dyn_aes_decrypt(mbuf->start, mbuf->last - mbuf->start, nbuf, msg->owner->aes_key);
-			}
-
-			if (status != DN_ERROR && nbuf != NULL) {
-				nbuf->read_flip = 1;
-				mbuf_remove(&msg->mhdr, mbuf);
-				mbuf_insert(&msg->mhdr, nbuf);
-				msg->pos = nbuf->start;
-
-				msg->mlen -= mbuf->last - mbuf->start;
-				msg->mlen += nbuf->last - nbuf->start;
-
-				mbuf_put(mbuf);
-			} else { //clean up the mess and recover it
-				mbuf_insert(&msg->mhdr, nbuf);
-				msg->pos = nbuf->last;
-				msg->dyn_error = BAD_FORMAT;
-			}
-		}
-
-		msg->dmsg->plen -= n;
-	}
-
 	for (;;) {
 		status = msg_parse(ctx, conn, msg);
 		if (status != DN_OK) {
@@ -944,7 +981,10 @@ msg_recv(struct context *ctx, struct conn *conn)
     rstatus_t status;
     struct msg *msg;
 
-    ASSERT(conn->recv_active);
+    /* a client paused by admission control may still be in this event batch */
+    if (!conn->recv_active) {
+        return DN_OK;
+    }
     conn->recv_ready = 1;
 
     do {
@@ -958,7 +998,7 @@ msg_recv(struct context *ctx, struct conn *conn)
             return status;
         }
 
-    } while (conn->recv_ready);
+    } while ((conn->recv_ready || !STAILQ_EMPTY(&conn->inflate_q)) && conn->recv_active);
 
     return DN_OK;
 }
@@ -1031,11 +1071,12 @@ msg_send_chain(struct context *ctx, struct conn *conn, struct msg *msg)
         }
     }
 
-    ASSERT(!TAILQ_EMPTY(&send_msgq) && nsend != 0);
+    ASSERT(!TAILQ_EMPTY(&send_msgq));
 
     conn->smsg = NULL;
 
-    n = conn_sendv(conn, &sendv, nsend);
+    /* replies emptied by coalescing have nothing to send */
+    n = (nsend != 0) ? conn_sendv(conn, &sendv, nsend) : 0;
 
     nsent = n > 0 ? (size_t)n : 0;
 
@@ -1083,7 +1124,7 @@ msg_send_chain(struct context *ctx, struct conn *conn, struct msg *msg)
 
     ASSERT(TAILQ_EMPTY(&send_msgq));
 
-    if (n > 0) {
+    if (n > 0 || nsend == 0) {
         return DN_OK;
     }
 
@@ -1111,12 +1152,6 @@ msg_send(struct context *ctx, struct conn *conn)
             return status;
         }
 
-        if (conn->omsg_count > MAX_CONN_QUEUE_SIZE) {
-            conn->send_ready = 0;
-            conn->err = ENOTRECOVERABLE;
-            loga("Setting ENOTRECOVERABLE happens here!");
-        }
-
     } while (conn->send_ready);
 
     return DN_OK;
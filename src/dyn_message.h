@@ -22,6 +22,7 @@
 
 #include "dyn_core.h"
 #include "dyn_dnode_msg.h"
+#include "dyn_token.h"
 
 
 #ifndef _DYN_MESSAGE_H_
@@ -33,14 +34,13 @@
 #define MAX_ALLOWABLE_PROCESSED_MSGS  500
 
 typedef void (*msg_parse_t)(struct msg *);
-typedef rstatus_t (*msg_post_splitcopy_t)(struct msg *);
+typedef rstatus_t (*msg_fragment_t)(struct msg *, struct msg *, uint32_t);
 typedef void (*msg_coalesce_t)(struct msg *r);
 
 typedef enum msg_parse_result {
     MSG_PARSE_OK,                         /* parsing ok */
     MSG_PARSE_ERROR,                      /* parsing error */
     MSG_PARSE_REPAIR,                     /* more to parse -> repair parsed & unparsed data */
-    MSG_PARSE_FRAGMENT,                   /* multi-vector request -> fragment */
     MSG_PARSE_AGAIN,                      /* incomplete -> parse again */
     MSG_OOM_ERROR
 } msg_parse_result_t;
@@ -60,6 +60,11 @@ typedef enum msg_type {
     MSG_REQ_MC_DECR,
     MSG_REQ_MC_TOUCH,                     /* memcache touch request */
     MSG_REQ_MC_QUIT,                      /* memcache quit request */
+    MSG_REQ_MC_NOOP,                      /* memcache noop request (binary) */
+    MSG_REQ_MC_MG,                        /* memcache meta requests */
+    MSG_REQ_MC_MS,
+    MSG_REQ_MC_MD,
+    MSG_REQ_MC_MN,
     MSG_RSP_MC_NUM,                       /* memcache arithmetic response */
     MSG_RSP_MC_STORED,                    /* memcache cas and storage response */
     MSG_RSP_MC_NOT_STORED,
@@ -72,6 +77,10 @@ typedef enum msg_type {
     MSG_RSP_MC_ERROR,                     /* memcache error responses */
     MSG_RSP_MC_CLIENT_ERROR,
     MSG_RSP_MC_SERVER_ERROR,
+    MSG_RSP_MC_VA,                        /* memcache meta responses */
+    MSG_RSP_MC_HD,
+    MSG_RSP_MC_EN,
+    MSG_RSP_MC_MN,
     MSG_REQ_REDIS_DEL,                    /* redis commands - keys */
     MSG_REQ_REDIS_EXISTS,
     MSG_REQ_REDIS_EXPIRE,
@@ -179,9 +188,16 @@ typedef enum dyn_error {
     UNKNOWN_ERROR,
     PEER_CONNECTION_REFUSE,
     STORAGE_CONNECTION_REFUSE,
-    BAD_FORMAT
+    BAD_FORMAT,
+    QUORUM_NOT_REACHED,
+    SERVER_OVERLOADED
 } dyn_error_t;
 
+struct keypos {
+    uint8_t              *start;          /* key start */
+    uint8_t              *end;            /* key end */
+};
+
 struct msg {
     TAILQ_ENTRY(msg)     c_tqe;           /* link in client q */
     TAILQ_ENTRY(msg)     s_tqe;           /* link in server q */
@@ -191,10 +207,12 @@ struct msg {
     struct msg           *peer;           /* message peer */
     struct conn          *owner;          /* message owner - client | server */
     int64_t              stime_in_microsec;  /* start time in microsec */
+    int64_t              qtime_in_microsec;  /* time queued to a server or peer in microsec */
 
-    struct rbnode        tmo_rbe;         /* entry in rbtree */
+    struct twnode        tmo_node;        /* entry in timing wheel */
 
     struct mhdr          mhdr;            /* message mbuf header */
+    struct mhdr          plain;           /* plaintext of an encrypted request */
     uint32_t             mlen;            /* message length */
 
     int                  state;           /* current parser state */
@@ -204,8 +222,7 @@ struct msg {
     msg_parse_t          parser;          /* message parser */
     msg_parse_result_t   result;          /* message parsing result */
 
-    mbuf_copy_t          pre_splitcopy;   /* message pre-split copy */
-    msg_post_splitcopy_t post_splitcopy;  /* message post-split copy */
+    msg_fragment_t       fragment;        /* message fragment */
     msg_coalesce_t       pre_coalesce;    /* message pre-coalesce */
     msg_coalesce_t       post_coalesce;   /* message post-coalesce */
 
@@ -213,20 +230,27 @@ struct msg {
 
     uint8_t              *key_start;      /* key start */
     uint8_t              *key_end;        /* key end */
+    uint8_t              *key_buf;        /* decoded key that key_start points into, or NULL */
+    struct dyn_token     key_token;       /* token of the routing key */
+    struct array         *keys;           /* keypos of each key of a multi-key request */
 
     uint32_t             vlen;            /* value length (memcache) */
     uint8_t              *end;            /* end marker (memcache) */
+    uint32_t             bin_opaque;      /* opaque of the last frame (memcache binary) */
+    uint8_t              bin_opcode;      /* opcode of the last frame as sent by the client (memcache binary) */
 
     uint8_t              *narg_start;     /* narg start (redis) */
     uint8_t              *narg_end;       /* narg end (redis) */
     uint32_t             narg;            /* # arguments (redis) */
     uint32_t             rnarg;           /* running # arg used by parsing fsa (redis) */
     uint32_t             rlen;            /* running length in parsing fsa (redis) */
+    uint32_t             vlen_rem;        /* bytes of a value being parsed yet to come */
     uint32_t             integer;         /* integer reply value (redis) */
 
     struct msg           *frag_owner;     /* owner of fragment message */
     uint32_t             nfrag;           /* # fragment */
     uint64_t             frag_id;         /* id of fragmented message */
+    struct array         *frag_map;       /* fragment of each key, in request order */
 
     err_t                err;             /* errno on error? */
     unsigned             error:1;         /* error? */
@@ -240,11 +264,17 @@ struct msg {
     unsigned             last_fragment:1; /* last fragment? */
     unsigned             swallow:1;       /* swallow response? */
     unsigned             redis:1;         /* redis? */
+    unsigned             binary:1;        /* memcache binary protocol? */
+    unsigned             quiet:1;         /* drop the reply on success? (memcache) */
+    unsigned             charged:1;       /* counted against the peer's rate budgets? */
+    unsigned             key_hashed:1;    /* key_token set? */
     
     //dynomite
     struct dmsg          *dmsg;          /* dyn message */
     int                  dyn_state;
     dyn_error_t          dyn_error;      /* error code for dynomite */
+    struct response_mgr  *rspmgr;        /* quorum replies, shared with replicas */
+    uint64_t             cache_epoch;    /* near cache epoch of a read that missed, 0 if not to be cached */
     uint8_t              msg_type;       /* for special message types
                                               0 : normal,
                                               1 : local cmd only no matter what
@@ -260,23 +290,30 @@ TAILQ_HEAD(msg_tqh, msg);
 
 uint32_t msg_free_queue_size(void);
 
-struct msg *msg_tmo_min(void);
+struct msg *msg_tmo_expire(int64_t now);
+int64_t msg_tmo_next(void);
 void msg_tmo_insert(struct msg *msg, struct conn *conn);
 void msg_tmo_delete(struct msg *msg);
 
 void msg_init(void);
 rstatus_t msg_clone(struct msg *src, struct mbuf *mbuf_start, struct msg *target);
+struct dyn_token *msg_key_token(struct server_pool *pool, struct msg *msg, uint8_t *key, uint32_t keylen);
+rstatus_t msg_add_key(struct msg *msg, uint8_t *start, uint8_t *end);
+uint8_t *msg_reserve(struct msg *msg, size_t n);
+uint64_t msg_gen_frag_id(void);
 void msg_deinit(void);
 struct msg *msg_get(struct conn *conn, bool request, bool redis);
 void msg_put(struct msg *msg);
 uint32_t msg_mbuf_size(struct msg *msg);
 uint32_t msg_length(struct msg *msg);
-struct msg *msg_get_error(bool redis, dyn_error_t dyn_err, err_t err);
+struct msg *msg_get_error(struct msg *req, bool redis, dyn_error_t dyn_err, err_t err);
 void msg_dump(struct msg *msg);
 bool msg_empty(struct msg *msg);
 rstatus_t msg_recv(struct context *ctx, struct conn *conn);
 rstatus_t msg_send(struct context *ctx, struct conn *conn);
 uint32_t msg_alloc_msgs(void);
+void msg_set_pool_max(uint32_t max);
+uint32_t msg_shrink(uint32_t n);
 
 struct msg *req_get(struct conn *conn);
 void req_put(struct msg *msg);
@@ -331,6 +368,8 @@ void dnode_rsp_gos_syn(struct context *ctx, struct conn *p_conn, struct msg *msg
 void remote_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg,
 		                struct rack *rack, uint8_t *key, uint32_t keylen);
 void local_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg, uint8_t *key, uint32_t keylen);
+void req_cache_invalidate(struct msg *msg);
+void req_forward_hedge(struct context *ctx, struct response_mgr *mgr);
 void dnode_peer_req_forward(struct context *ctx, struct conn *c_conn, struct conn *p_conn,
 		                struct msg *msg, struct rack *rack, uint8_t *key, uint32_t keylen);
 
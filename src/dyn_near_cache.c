@@ -0,0 +1,348 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#include "dyn_core.h"
+#include "dyn_near_cache.h"
+
+static size_t ncache_max;                       /* byte budget, 0 if off */
+static int ncache_ttl;                          /* msec an entry lives */
+static size_t ncache_nused;                     /* bytes taken by entries */
+static struct ncache_entry_tqh ncache_lruq;     /* entries, most recently read first */
+static struct ncache_entry **ncache_bucket;     /* hash buckets, NULL until first read */
+static uint8_t *ncache_sketch;                  /* NCACHE_DEPTH rows of read counters */
+static uint32_t ncache_mask;                    /* # buckets and counters per row - 1 */
+static uint32_t ncache_nread;                   /* reads counted since the sketch halved */
+static uint64_t ncache_nwrite;                  /* # writes seen + 1 */
+static uint64_t ncache_stamp[NCACHE_NSTAMP];    /* ncache_nwrite at the last write to each slot */
+
+
+void
+ncache_init(void)
+{
+    ncache_max = 0;
+    ncache_ttl = 0;
+    ncache_nused = 0;
+    TAILQ_INIT(&ncache_lruq);
+    ncache_bucket = NULL;
+    ncache_sketch = NULL;
+    ncache_mask = 0;
+    ncache_nread = 0;
+    ncache_nwrite = 1;
+    memset(ncache_stamp, 0, sizeof(ncache_stamp));
+}
+
+
+static void
+ncache_free(struct ncache_entry *e)
+{
+    ASSERT(ncache_nused >= sizeof(*e) + e->keylen + e->vlen);
+
+    ncache_nused -= sizeof(*e) + e->keylen + e->vlen;
+    TAILQ_REMOVE(&ncache_lruq, e, lru_tqe);
+    dn_free(e);
+}
+
+
+void
+ncache_deinit(void)
+{
+    while (!TAILQ_EMPTY(&ncache_lruq)) {
+        ncache_free(TAILQ_FIRST(&ncache_lruq));
+    }
+    ASSERT(ncache_nused == 0);
+
+    if (ncache_bucket != NULL) {
+        dn_free(ncache_bucket);
+        ncache_bucket = NULL;
+    }
+    if (ncache_sketch != NULL) {
+        dn_free(ncache_sketch);
+        ncache_sketch = NULL;
+    }
+    ncache_mask = 0;
+    ncache_nread = 0;
+}
+
+
+/* cache up to max_bytes of replies for ttl msec each; 0 bytes turns it off */
+void
+ncache_set_budget(size_t max_bytes, int ttl)
+{
+    ncache_deinit();
+
+    ncache_max = (ttl > 0) ? max_bytes : 0;
+    ncache_ttl = ttl;
+}
+
+
+/* size the buckets and the sketch to the budget */
+static rstatus_t
+ncache_alloc(void)
+{
+    uint32_t width;
+
+    ASSERT(ncache_bucket == NULL && ncache_max > 0);
+
+    for (width = NCACHE_MIN_WIDTH;
+         width < NCACHE_MAX_WIDTH && width < ncache_max / NCACHE_ENTRY_SIZE_EST;
+         width <<= 1) {
+        ;
+    }
+
+    ncache_bucket = dn_zalloc(width * sizeof(*ncache_bucket));
+    if (ncache_bucket == NULL) {
+        return DN_ENOMEM;
+    }
+
+    ncache_sketch = dn_zalloc(NCACHE_DEPTH * width);
+    if (ncache_sketch == NULL) {
+        dn_free(ncache_bucket);
+        ncache_bucket = NULL;
+        return DN_ENOMEM;
+    }
+
+    ncache_mask = width - 1;
+    ncache_nread = 0;
+
+    return DN_OK;
+}
+
+
+static inline uint8_t *
+ncache_counter(uint32_t hash, uint32_t row)
+{
+    uint32_t h2 = ((hash >> 17) | (hash << 15)) | 1;
+
+    return &ncache_sketch[row * (ncache_mask + 1) + ((hash + row * h2) & ncache_mask)];
+}
+
+
+/* estimated # recent reads of the key with hash */
+static uint8_t
+ncache_frequency(uint32_t hash)
+{
+    uint8_t freq, *c;
+    uint32_t row;
+
+    for (freq = NCACHE_COUNTER_MAX, row = 0; row < NCACHE_DEPTH; row++) {
+        c = ncache_counter(hash, row);
+        freq = MIN(freq, *c);
+    }
+
+    return freq;
+}
+
+
+/* count a read; the counts are halved every so often so that old reads fade */
+static void
+ncache_record(uint32_t hash)
+{
+    uint8_t *c;
+    uint32_t row, i;
+
+    for (row = 0; row < NCACHE_DEPTH; row++) {
+        c = ncache_counter(hash, row);
+        if (*c < NCACHE_COUNTER_MAX) {
+            (*c)++;
+        }
+    }
+
+    if (++ncache_nread >= NCACHE_SAMPLE_FACTOR * (ncache_mask + 1)) {
+        for (i = 0; i < NCACHE_DEPTH * (ncache_mask + 1); i++) {
+            ncache_sketch[i] >>= 1;
+        }
+        ncache_nread /= 2;
+    }
+}
+
+
+static struct ncache_entry **
+ncache_lookup(uint8_t *key, uint32_t keylen, uint32_t hash)
+{
+    struct ncache_entry **pe, *e;
+
+    for (pe = &ncache_bucket[hash & ncache_mask]; (e = *pe) != NULL; pe = &e->next) {
+        if (e->hash == hash && e->keylen == keylen &&
+            memcmp(ncache_key(e), key, keylen) == 0) {
+            break;
+        }
+    }
+
+    return pe;
+}
+
+
+static void
+ncache_remove(struct ncache_entry **pe)
+{
+    struct ncache_entry *e = *pe;
+
+    *pe = e->next;
+    ncache_free(e);
+}
+
+
+/*
+ * Entry for key that has not expired by now, NULL if none. The read is
+ * counted either way, so that a key read often enough is let in once its
+ * reply comes back.
+ */
+struct ncache_entry *
+ncache_get(uint8_t *key, uint32_t keylen, int64_t now)
+{
+    struct ncache_entry **pe, *e;
+    uint32_t hash;
+
+    if (ncache_max == 0) {
+        return NULL;
+    }
+
+    if (ncache_bucket == NULL && ncache_alloc() != DN_OK) {
+        return NULL;
+    }
+
+    hash = dictGenHashFunction(key, (int)keylen);
+    ncache_record(hash);
+
+    pe = ncache_lookup(key, keylen, hash);
+    e = *pe;
+    if (e == NULL) {
+        return NULL;
+    }
+
+    if (e->expire <= now) {
+        ncache_remove(pe);
+        return NULL;
+    }
+
+    TAILQ_REMOVE(&ncache_lruq, e, lru_tqe);
+    TAILQ_INSERT_HEAD(&ncache_lruq, e, lru_tqe);
+
+    return e;
+}
+
+
+/*
+ * Keep rsp as the reply for key, read when the cache was at epoch. It is not
+ * kept if the key may have been written since, or if making room for it
+ * would evict an entry read at least as often.
+ */
+bool
+ncache_put(uint8_t *key, uint32_t keylen, struct msg *rsp, uint64_t epoch, int64_t now)
+{
+    struct ncache_entry **pe, *e;
+    struct mbuf *mbuf;
+    uint8_t *p, freq;
+    uint32_t hash, vlen;
+    size_t size, need;
+
+    ASSERT(!rsp->request);
+
+    if (ncache_max == 0 || ncache_bucket == NULL) {
+        return false;
+    }
+
+    hash = dictGenHashFunction(key, (int)keylen);
+    if (ncache_stamp[hash % NCACHE_NSTAMP] > epoch) {
+        return false;
+    }
+
+    vlen = 0;
+    STAILQ_FOREACH(mbuf, &rsp->mhdr, next) {
+        vlen += mbuf_length(mbuf);
+    }
+
+    size = sizeof(*e) + keylen + vlen;
+    if (size > ncache_max / NCACHE_MAX_SHARE) {
+        return false;
+    }
+
+    pe = ncache_lookup(key, keylen, hash);
+    if (*pe != NULL) {
+        ncache_remove(pe);
+    }
+
+    /* the candidate has to beat every live entry it would evict */
+    freq = ncache_frequency(hash);
+    need = (ncache_nused + size > ncache_max) ? ncache_nused + size - ncache_max : 0;
+    for (e = TAILQ_LAST(&ncache_lruq, ncache_entry_tqh); e != NULL && need > 0;
+         e = TAILQ_PREV(e, ncache_entry_tqh, lru_tqe)) {
+        if (e->expire > now && ncache_frequency(e->hash) >= freq) {
+            return false;
+        }
+        need -= MIN(need, sizeof(*e) + e->keylen + e->vlen);
+    }
+
+    while (ncache_nused + size > ncache_max) {
+        e = TAILQ_LAST(&ncache_lruq, ncache_entry_tqh);
+        ncache_remove(ncache_lookup(ncache_key(e), e->keylen, e->hash));
+    }
+
+    e = dn_alloc(size);
+    if (e == NULL) {
+        return false;
+    }
+
+    e->expire = now + ncache_ttl;
+    e->hash = hash;
+    e->keylen = keylen;
+    e->vlen = vlen;
+    e->type = rsp->type;
+
+    dn_memcpy(ncache_key(e), key, keylen);
+    p = ncache_value(e);
+    STAILQ_FOREACH(mbuf, &rsp->mhdr, next) {
+        dn_memcpy(p, mbuf->pos, mbuf_length(mbuf));
+        p += mbuf_length(mbuf);
+    }
+
+    pe = &ncache_bucket[hash & ncache_mask];
+    e->next = *pe;
+    *pe = e;
+    TAILQ_INSERT_HEAD(&ncache_lruq, e, lru_tqe);
+    ncache_nused += size;
+
+    return true;
+}
+
+
+/* drop key, and keep replies to reads of it already sent out of the cache */
+void
+ncache_invalidate(uint8_t *key, uint32_t keylen)
+{
+    struct ncache_entry **pe;
+    uint32_t hash;
+
+    if (ncache_max == 0) {
+        return;
+    }
+
+    hash = dictGenHashFunction(key, (int)keylen);
+    ncache_stamp[hash % NCACHE_NSTAMP] = ++ncache_nwrite;
+
+    if (ncache_bucket == NULL) {
+        return;
+    }
+
+    pe = ncache_lookup(key, keylen, hash);
+    if (*pe != NULL) {
+        ncache_remove(pe);
+    }
+}
+
+
+/* stamp a read that missed with; 0 if the cache is off */
+uint64_t
+ncache_epoch(void)
+{
+    return (ncache_max == 0) ? 0 : ncache_nwrite;
+}
+
+
+size_t
+ncache_used(void)
+{
+    return ncache_nused;
+}
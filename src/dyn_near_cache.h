@@ -0,0 +1,54 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#ifndef _DYN_NEAR_CACHE_H_
+#define _DYN_NEAR_CACHE_H_
+
+/*
+ * Bounded cache of the replies to single-key client GETs, kept in front of
+ * the peers so that a hot key is not sent to its owners on every read.
+ * Entries live for a short TTL and are dropped as soon as a write for their
+ * key passes through this node. Once the byte budget is spent, a new key
+ * only gets in if a count-min sketch of recent reads (TinyLFU) says it is
+ * read more often than the least recently used entries it would evict.
+ */
+
+#define NCACHE_DEPTH            4       /* rows of the frequency sketch */
+#define NCACHE_COUNTER_MAX      15      /* sketch counters saturate here */
+#define NCACHE_SAMPLE_FACTOR    10      /* sketch halves after this many reads per counter */
+#define NCACHE_ENTRY_SIZE_EST   256     /* bytes per entry the sketch is sized for */
+#define NCACHE_MIN_WIDTH        1024    /* sketch counters per row, and buckets */
+#define NCACHE_MAX_WIDTH        (1 << 22)
+#define NCACHE_MAX_SHARE        8       /* an entry takes at most 1/8 of the budget */
+#define NCACHE_NSTAMP           4096    /* slots of the write stamps */
+
+struct ncache_entry;
+
+TAILQ_HEAD(ncache_entry_tqh, ncache_entry);
+
+struct ncache_entry {
+    TAILQ_ENTRY(ncache_entry) lru_tqe;  /* link in lru q */
+    struct ncache_entry       *next;    /* next in hash bucket */
+    int64_t                   expire;   /* expiry in msec */
+    uint32_t                  hash;     /* hash of key */
+    uint32_t                  keylen;   /* key length */
+    uint32_t                  vlen;     /* reply length */
+    msg_type_t                type;     /* reply type */
+    /* key, then reply bytes */
+};
+
+#define ncache_key(_e)      ((uint8_t *)((_e) + 1))
+#define ncache_value(_e)    (ncache_key(_e) + (_e)->keylen)
+
+void ncache_init(void);
+void ncache_deinit(void);
+void ncache_set_budget(size_t max_bytes, int ttl);
+uint64_t ncache_epoch(void);
+struct ncache_entry *ncache_get(uint8_t *key, uint32_t keylen, int64_t now);
+bool ncache_put(uint8_t *key, uint32_t keylen, struct msg *rsp, uint64_t epoch, int64_t now);
+void ncache_invalidate(uint8_t *key, uint32_t keylen);
+size_t ncache_used(void);
+
+#endif
@@ -143,3 +143,105 @@ char *hostname_to_private_ip4(char *hostname)
 {
    return  hostname_to_ip(hostname);
 }
+
+
+/*
+ * Dynamic snitch: each server keeps an ewma of its response latency and a
+ * count of the requests queued to it. A server that stops getting traffic
+ * has its latency halved every SNITCH_DECAY_USEC so it is tried again.
+ */
+void snitch_update(struct server *server, int64_t sent, int64_t now)
+{
+	int64_t latency = now - sent;
+
+	if (sent == 0 || latency < 0)
+		return;
+
+	if (server->latency_at == 0)
+		server->latency = latency;
+	else
+		server->latency += (latency - server->latency) / SNITCH_EWMA_WEIGHT;
+
+	server->latency_at = now;
+}
+
+
+static uint64_t snitch_score(struct server_pool *sp, struct server *server, int64_t now)
+{
+	int64_t latency, idle;
+
+	/* requests for this node are served by its datastore */
+	if (server->is_local)
+		server = array_get(&sp->server, 0);
+
+	latency = server->latency;
+	idle = (now - server->latency_at) / SNITCH_DECAY_USEC;
+	if (idle > 0)
+		latency = (idle < 63) ? latency >> idle : 0;
+
+	return (uint64_t)(latency + 1) * (server->outstanding + 1);
+}
+
+
+/*
+ * Rack of the local dc whose replica of key looks fastest. Without exclude
+ * that is rack unless another one scores SNITCH_BADNESS percent better;
+ * with it, the best of the other racks, or NULL if none is up.
+ */
+struct rack *snitch_read_rack(struct server_pool *sp, struct rack *rack,
+		struct msg *msg, uint8_t *key, uint32_t keylen, bool exclude)
+{
+	struct datacenter *dc;
+	struct rack *r, *best;
+	struct server *server;
+	struct dyn_token *token;
+	uint64_t score, best_score, rack_score;
+	uint32_t i, idx;
+	int64_t now;
+
+	dc = server_get_dc(sp, &sp->dc);
+	if (dc == NULL || keylen == 0)
+		return exclude ? NULL : rack;
+
+	token = msg_key_token(sp, msg, key, keylen);
+	if (token == NULL)
+		return exclude ? NULL : rack;
+
+	now = dn_usec_now();
+	best = NULL;
+	best_score = rack_score = UINT64_MAX;
+
+	for (i = 0; i < array_n(&dc->racks); i++) {
+		r = array_get(&dc->racks, i);
+		if (r->ncontinuum == 0)
+			continue;
+
+		idx = vnode_rack_dispatch(r, token);
+		server = array_get(&sp->peers, idx);
+		if (server->state == DOWN)
+			continue;
+
+		score = snitch_score(sp, server, now);
+		if (r == rack) {
+			rack_score = score;
+			if (exclude)
+				continue;
+		}
+
+		if (score < best_score) {
+			best = r;
+			best_score = score;
+		}
+	}
+
+	if (exclude)
+		return best;
+
+	if (best == NULL || rack_score == UINT64_MAX)
+		return (best != NULL) ? best : rack;
+
+	if (best_score * (100 + SNITCH_BADNESS) < rack_score * 100)
+		return best;
+
+	return rack;
+}
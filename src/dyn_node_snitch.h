@@ -12,4 +12,12 @@ char *get_public_ip4(struct server_pool *sp);
 char *get_private_ip4(struct server_pool *sp);
 char *hostname_to_private_ip4(char *hostname);
 
+#define SNITCH_EWMA_WEIGHT      8           /* a sample moves the ewma by 1/8 */
+#define SNITCH_DECAY_USEC       1000000LL   /* idle servers' latency halves this often */
+#define SNITCH_BADNESS          10          /* % a rack must beat the local one by */
+
+void snitch_update(struct server *server, int64_t sent, int64_t now);
+struct rack *snitch_read_rack(struct server_pool *sp, struct rack *rack,
+		struct msg *msg, uint8_t *key, uint32_t keylen, bool exclude);
+
 #endif /* _DYN_SNITCH_H_s */
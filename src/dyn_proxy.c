@@ -97,15 +97,26 @@ static rstatus_t
 proxy_reuse(struct conn *p)
 {
     rstatus_t status;
+    struct server_pool *pool = p->owner;
     struct sockaddr_un *un;
 
     switch (p->family) {
     case AF_INET:
     case AF_INET6:
         status = dn_set_reuseaddr(p->sd);
+        if (status == DN_OK && pool->ctx->nworkers > 1) {
+            status = dn_set_reuseport(p->sd);
+        }
         break;
 
     case AF_UNIX:
+        if (pool->ctx->nworkers > 1) {
+            /* workers cannot share a unix domain socket path */
+            errno = EINVAL;
+            status = DN_ERROR;
+            break;
+        }
+
         /*
          * bind() will fail if the pathname already exist. So, we call unlink()
          * to delete the pathname, in case it already exists. If it does not
@@ -337,6 +348,8 @@ proxy_accept(struct context *ctx, struct conn *p)
         return status;
     }
 
+    server_pool_admit_client(ctx, c);
+
     log_debug(LOG_NOTICE, "accepted c %d on p %d from '%s'", c->sd, p->sd,
               dn_unresolve_peer_desc(c->sd));
 
@@ -23,6 +23,10 @@
 #include "dyn_core.h"
 #include "dyn_server.h"
 #include "dyn_dnode_peer.h"
+#include "dyn_node_snitch.h"
+#include "hashkit/dyn_hashkit.h"
+
+static void req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg);
 
 
 struct msg *
@@ -57,6 +61,8 @@ req_put(struct msg *msg)
 
     msg_tmo_delete(msg);
 
+    rspmgr_detach(msg);
+
     msg_put(msg);
 }
 
@@ -252,6 +258,8 @@ req_server_enqueue_imsgq(struct context *ctx, struct conn *conn, struct msg *msg
     }
 
     TAILQ_INSERT_TAIL(&conn->imsg_q, msg, s_tqe);
+    server_outstanding_incr(conn);
+    msg->qtime_in_microsec = dn_usec_now();
 
     if (!conn->dyn_mode) {
        stats_server_incr(ctx, conn->owner, in_queue);
@@ -270,6 +278,7 @@ req_server_dequeue_imsgq(struct context *ctx, struct conn *conn, struct msg *msg
     ASSERT(!conn->client && !conn->proxy);
 
     TAILQ_REMOVE(&conn->imsg_q, msg, s_tqe);
+    server_outstanding_decr(conn);
 
     stats_server_decr(ctx, conn->owner, in_queue);
     stats_server_decr_by(ctx, conn->owner, in_queue_bytes, msg->mlen);
@@ -292,6 +301,7 @@ req_server_enqueue_omsgq(struct context *ctx, struct conn *conn, struct msg *msg
     ASSERT(!conn->client && !conn->proxy);
 
     TAILQ_INSERT_TAIL(&conn->omsg_q, msg, s_tqe);
+    server_outstanding_incr(conn);
 
     stats_server_incr(ctx, conn->owner, out_queue);
     stats_server_incr_by(ctx, conn->owner, out_queue_bytes, msg->mlen);
@@ -317,6 +327,7 @@ req_server_dequeue_omsgq(struct context *ctx, struct conn *conn, struct msg *msg
     msg_tmo_delete(msg);
 
     TAILQ_REMOVE(&conn->omsg_q, msg, s_tqe);
+    server_outstanding_decr(conn);
 
     stats_server_decr(ctx, conn->owner, out_queue);
     stats_server_decr_by(ctx, conn->owner, out_queue_bytes, msg->mlen);
@@ -445,6 +456,18 @@ req_forward_error(struct context *ctx, struct conn *conn, struct msg *msg)
         }
     }
 
+    rspmgr_submit(ctx, msg);
+}
+
+/* turn away a request for an overloaded server or peer; the client may retry it */
+static void
+req_forward_overload(struct context *ctx, struct conn *c_conn, struct msg *msg)
+{
+    stats_pool_incr(ctx, c_conn->owner, client_overload_requests);
+
+    msg->dyn_error = SERVER_OVERLOADED;
+    errno = EBUSY;
+    req_forward_error(ctx, c_conn, msg);
 }
 
 static void
@@ -466,6 +489,7 @@ local_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg,
 		               uint8_t *key, uint32_t keylen)
 {
     rstatus_t status;
+    struct server_pool *pool = c_conn->owner;
     struct conn *s_conn;
 
     if (log_loggable(LOG_VVERB)) {
@@ -474,8 +498,11 @@ local_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg,
 
     ASSERT((c_conn->client || c_conn->dnode_client) && !c_conn->proxy && !c_conn->dnode_server);
 
-    /* enqueue message (request) into client outq, if response is expected */
-    if (!msg->noreply) {
+    /*
+     * enqueue message (request) into client outq, if response is expected;
+     * a replica's response goes to its response_mgr instead
+     */
+    if (!msg->noreply && !rspmgr_is_replica(msg)) {
         c_conn->enqueue_outq(ctx, c_conn, msg);
     }
 
@@ -486,6 +513,11 @@ local_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg,
     }
     ASSERT(!s_conn->client && !s_conn->proxy);
 
+    if (!server_admit(s_conn->owner, pool->timeout)) {
+        req_forward_overload(ctx, c_conn, msg);
+        return;
+    }
+
     if (log_loggable(LOG_DEBUG)) {
        log_debug(LOG_DEBUG, "forwarding request from client conn '%s' to storage conn '%s'",
   		      	dn_unresolve_peer_desc(c_conn->sd), dn_unresolve_peer_desc(s_conn->sd));
@@ -554,7 +586,7 @@ admin_local_req_forward(struct context *ctx, struct conn *c_conn, struct msg *ms
 
 	ASSERT(c_conn->client || c_conn->dnode_client);
 
-	p_conn = dnode_peer_pool_conn(ctx, c_conn->owner, rack, key, keylen, msg->msg_type);
+	p_conn = dnode_peer_pool_conn(ctx, c_conn->owner, rack, msg, key, keylen);
 	if (p_conn == NULL) {
 		c_conn->err = EHOSTDOWN;
 		req_forward_error(ctx, c_conn, msg);
@@ -585,11 +617,12 @@ void
 remote_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg, 
                         struct rack *rack, uint8_t *key, uint32_t keylen)
 {
+    struct server_pool *pool = c_conn->owner;
     struct conn *p_conn;
 
     ASSERT(c_conn->client || c_conn->dnode_client);
 
-    p_conn = dnode_peer_pool_conn(ctx, c_conn->owner, rack, key, keylen, msg->msg_type);
+    p_conn = dnode_peer_pool_conn(ctx, c_conn->owner, rack, msg, key, keylen);
     if (p_conn == NULL) {
         c_conn->err = EHOSTDOWN;
         req_forward_error(ctx, c_conn, msg);
@@ -602,12 +635,519 @@ remote_req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg,
     if (peer->is_local) {
         local_req_forward(ctx, c_conn, msg, key, keylen);
         return;
+    } else if (!server_admit(peer, pool->d_timeout)) {
+        if (msg->swallow) {
+            stats_pool_incr(ctx, pool, client_overload_requests);
+            req_put(msg);
+            return;
+        }
+        if (!msg->noreply && !rspmgr_is_replica(msg)) {
+            c_conn->enqueue_outq(ctx, c_conn, msg);
+        }
+        req_forward_overload(ctx, c_conn, msg);
     } else {
         dnode_peer_req_forward(ctx, c_conn, p_conn, msg, rack, key, keylen);
     }
 }
 
 
+/*
+ * Fan the request out to a replica in every rack of the local DC, to be
+ * answered by their response_mgr. The request itself waits in the client
+ * outq. Returns false, without having sent anything, if the request is to be
+ * served at DC_ONE.
+ */
+static bool
+req_forward_quorum(struct context *ctx, struct conn *c_conn, struct msg *msg,
+                   struct mbuf *orig_mbuf, uint8_t *key, uint32_t keylen)
+{
+	struct server_pool *pool = c_conn->owner;
+	struct msg *rack_msg[RSPMGR_MAX_REPLICA];
+	struct response_mgr *mgr;
+	struct datacenter *dc;
+	struct rack *rack;
+	consistency_t consistency;
+	uint32_t rack_cnt, i;
+
+	consistency = msg->is_read ? pool->read_consistency : pool->write_consistency;
+	if (consistency == DC_ONE || msg->noreply || msg->frag_id != 0 || msg->msg_type != 0) {
+		return false;
+	}
+
+	dc = server_get_dc(pool, &pool->dc);
+	rack_cnt = (dc != NULL) ? array_n(&dc->racks) : 0;
+	if (rack_cnt < 2 || rack_cnt > RSPMGR_MAX_REPLICA) {
+		return false;
+	}
+
+	mgr = rspmgr_get(msg, consistency);
+	if (mgr == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < rack_cnt; i++) {
+		rack_msg[i] = msg_get(c_conn, msg->request, msg->redis);
+		if (rack_msg[i] == NULL) {
+			break;
+		}
+
+		if (msg_clone(msg, orig_mbuf, rack_msg[i]) != DN_OK) {
+			req_put(rack_msg[i]);
+			break;
+		}
+
+		rspmgr_add_replica(mgr, rack_msg[i]);
+	}
+
+	if (i < rack_cnt) {
+		log_debug(LOG_VERB, "no replicas for req %"PRIu64", falling back to dc_one", msg->id);
+		rspmgr_detach(msg);
+		while (i-- > 0) {
+			req_put(rack_msg[i]);
+		}
+		return false;
+	}
+
+	c_conn->enqueue_outq(ctx, c_conn, msg);
+
+	for (i = 0; i < rack_cnt; i++) {
+		/* the replies so far may have decided the request already */
+		if (rack_msg[i]->rspmgr == NULL) {
+			req_put(rack_msg[i]);
+			continue;
+		}
+
+		rack = array_get(&dc->racks, i);
+		if (log_loggable(LOG_DEBUG)) {
+			log_debug(LOG_DEBUG, "forwarding replica of req %"PRIu64" to rack '%.*s'",
+					  msg->id, rack->name->len, rack->name->data);
+		}
+		remote_req_forward(ctx, c_conn, rack_msg[i], rack, key, keylen);
+	}
+
+	return true;
+}
+
+
+/*
+ * msec to give a read before it is hedged, from the pool's percentile of
+ * the client latency histogram; 0 until there is data. Looked up at most
+ * once a second.
+ */
+static int
+req_hedge_delay(struct context *ctx, struct server_pool *pool)
+{
+	int64_t now = dn_msec_now();
+	uint64_t usec;
+
+	if (now >= pool->read_hedge_refresh) {
+		usec = stats_histo_latency_percentile(ctx, pool->read_hedge_percentile / 100.0);
+		if (usec == (uint64_t)-1) {
+			usec = 0;
+		}
+		pool->read_hedge_delay = (int)MIN((usec + 999) / 1000, (uint64_t)INT_MAX);
+		pool->read_hedge_refresh = now + 1000;
+	}
+
+	return pool->read_hedge_delay;
+}
+
+
+/*
+ * Send a read to its rack as a replica that can be hedged to another rack
+ * of the local DC if it is slow. Returns false, without having sent
+ * anything, if the read is not to be hedged.
+ */
+static bool
+req_forward_hedged(struct context *ctx, struct conn *c_conn, struct msg *msg,
+                   struct rack *rack, uint8_t *key, uint32_t keylen)
+{
+	struct server_pool *pool = c_conn->owner;
+	struct response_mgr *mgr;
+	struct datacenter *dc;
+	struct rack *hedge_rack;
+	struct msg *replica;
+	uint32_t rack_cnt, i;
+	int delay;
+
+	if (pool->read_hedge_percentile == 0 || msg->noreply || msg->frag_id != 0 ||
+		msg->msg_type != 0) {
+		return false;
+	}
+
+	dc = server_get_dc(pool, &pool->dc);
+	rack_cnt = (dc != NULL) ? array_n(&dc->racks) : 0;
+	if (rack_cnt < 2) {
+		return false;
+	}
+
+	delay = req_hedge_delay(ctx, pool);
+	if (delay <= 0) {
+		return false;
+	}
+
+	/* any rack of the dc but the read's own */
+	if (pool->dyn_snitch) {
+		hedge_rack = snitch_read_rack(pool, rack, msg, key, keylen, true);
+		if (hedge_rack == NULL) {
+			return false;
+		}
+	} else {
+		i = (uint32_t)rand() % (rack_cnt - 1);
+		hedge_rack = array_get(&dc->racks, i);
+		if (hedge_rack == rack) {
+			hedge_rack = array_get(&dc->racks, rack_cnt - 1);
+		}
+	}
+
+	mgr = rspmgr_get(msg, DC_ONE);
+	if (mgr == NULL) {
+		return false;
+	}
+
+	replica = msg_get(c_conn, msg->request, msg->redis);
+	if (replica == NULL) {
+		rspmgr_detach(msg);
+		return false;
+	}
+
+	if (msg_clone(msg, STAILQ_FIRST(&msg->mhdr), replica) != DN_OK) {
+		rspmgr_detach(msg);
+		req_put(replica);
+		return false;
+	}
+
+	rspmgr_add_replica(mgr, replica);
+	rspmgr_hedge_insert(mgr, hedge_rack, key, keylen, delay);
+
+	c_conn->enqueue_outq(ctx, c_conn, msg);
+	remote_req_forward(ctx, c_conn, replica, rack, key, keylen);
+
+	return true;
+}
+
+
+/* the read has not been answered in time: send it to the hedge rack too */
+void
+req_forward_hedge(struct context *ctx, struct response_mgr *mgr)
+{
+	struct msg *msg = mgr->msg;
+	struct conn *c_conn = msg->owner;
+	struct msg *replica;
+
+	ASSERT(!mgr->done);
+
+	replica = msg_get(c_conn, msg->request, msg->redis);
+	if (replica == NULL) {
+		return;
+	}
+
+	if (msg_clone(msg, STAILQ_FIRST(&msg->mhdr), replica) != DN_OK ||
+		rspmgr_add_replica(mgr, replica) != DN_OK) {
+		req_put(replica);
+		return;
+	}
+
+	stats_pool_incr(ctx, c_conn->owner, client_hedged_requests);
+
+	if (log_loggable(LOG_DEBUG)) {
+		log_debug(LOG_DEBUG, "hedging req %"PRIu64" to rack '%.*s'", msg->id,
+				  mgr->hedge_rack->name->len, mgr->hedge_rack->name->data);
+	}
+
+	remote_req_forward(ctx, c_conn, replica, mgr->hedge_rack, mgr->key, mgr->keylen);
+}
+
+
+/* the part of key [start, end) that is hashed: its hash tag if it has one */
+static uint8_t *
+req_routing_key(struct server_pool *pool, uint8_t *start, uint8_t *end,
+                uint32_t *keylen)
+{
+	if (!string_empty(&pool->hash_tag)) {
+		struct string *tag = &pool->hash_tag;
+		uint8_t *tag_start, *tag_end;
+
+		tag_start = dn_strchr(start, end, tag->data[0]);
+		if (tag_start != NULL) {
+			tag_end = dn_strchr(tag_start + 1, end, tag->data[1]);
+			if (tag_end != NULL && tag_end > tag_start + 1) {
+				*keylen = (uint32_t)(tag_end - tag_start - 1);
+				return tag_start + 1;
+			}
+		}
+	}
+
+	*keylen = (uint32_t)(end - start);
+	return start;
+}
+
+
+/*
+ * Split a multi-key request - redis 'mget' or 'del', memcache 'get' or
+ * 'gets' - into one fragment per set of owners of its keys rather than one
+ * per key. Keys go in the same fragment when the same peer owns them in every
+ * rack the request is sent to: each rack of the local dc for a read, of every
+ * dc for a write. The fragments follow each other in the client outq and
+ * point to the first one through frag_owner; its frag_map tells which
+ * fragment each key went in, so that the replies can be put back in key
+ * order.
+ *
+ * Returns false, having done nothing, if all keys have the same owners and
+ * msg can go as it is.
+ */
+static bool
+req_forward_scatter(struct context *ctx, struct conn *c_conn, struct msg *msg)
+{
+	struct server_pool *pool = c_conn->owner;
+	struct datacenter *dc, *local_dc;
+	struct rack *rack;
+	struct keypos *kpos;
+	struct dyn_token token;
+	struct msg **frag;
+	struct array *map;
+	uint32_t *owner, *first, *fid;
+	uint32_t nkey, nrack, nfrag, i, j, k, d, keylen;
+	uint64_t id;
+	uint8_t *key;
+
+	nkey = array_n(msg->keys);
+	local_dc = server_get_dc(pool, &pool->dc);
+
+	for (nrack = 0, d = 0; d < array_n(&pool->datacenters); d++) {
+		dc = array_get(&pool->datacenters, d);
+		if (msg->is_read && dc != local_dc) {
+			continue;
+		}
+		nrack += array_n(&dc->racks);
+	}
+
+	if (nrack == 0) {
+		return false;
+	}
+
+	/* the owner of each key in each rack, then the first key of each fragment */
+	owner = dn_alloc((nkey * nrack + nkey) * sizeof(*owner));
+	if (owner == NULL) {
+		goto enomem;
+	}
+	first = owner + nkey * nrack;
+
+	if (msg->frag_map == NULL) {
+		msg->frag_map = array_create(nkey, sizeof(uint32_t));
+		if (msg->frag_map == NULL) {
+			dn_free(owner);
+			goto enomem;
+		}
+	}
+	msg->frag_map->nelem = 0;
+
+	for (nfrag = 0, i = 0; i < nkey; i++) {
+		kpos = array_get(msg->keys, i);
+		key = req_routing_key(pool, kpos->start, kpos->end, &keylen);
+
+		init_dyn_token(&token);
+		if (pool->key_hash((char *)key, keylen, &token) != DN_OK) {
+			dn_free(owner);
+			return false;
+		}
+
+		for (k = 0, d = 0; d < array_n(&pool->datacenters); d++) {
+			dc = array_get(&pool->datacenters, d);
+			if (msg->is_read && dc != local_dc) {
+				continue;
+			}
+			for (j = 0; j < array_n(&dc->racks); j++, k++) {
+				rack = array_get(&dc->racks, j);
+				owner[i * nrack + k] = (rack->ncontinuum > 0) ?
+									   vnode_rack_dispatch(rack, &token) : 0;
+			}
+		}
+
+		for (j = 0; j < nfrag; j++) {
+			if (memcmp(&owner[first[j] * nrack], &owner[i * nrack],
+					   nrack * sizeof(*owner)) == 0) {
+				break;
+			}
+		}
+		if (j == nfrag) {
+			first[nfrag++] = i;
+		}
+
+		fid = array_push(msg->frag_map);
+		*fid = j;
+	}
+
+	dn_free(owner);
+
+	if (nfrag == 1) {
+		return false;
+	}
+
+	frag = dn_zalloc(nfrag * sizeof(*frag));
+	if (frag == NULL) {
+		goto enomem;
+	}
+
+	id = msg_gen_frag_id();
+	for (j = 0; j < nfrag; j++) {
+		frag[j] = msg_get(c_conn, true, msg->redis);
+		if (frag[j] == NULL || msg->fragment(msg, frag[j], j) != DN_OK) {
+			for (k = 0; k <= j; k++) {
+				if (frag[k] != NULL) {
+					req_put(frag[k]);
+				}
+			}
+			dn_free(frag);
+			goto enomem;
+		}
+
+		frag[j]->type = msg->type;
+		frag[j]->is_read = msg->is_read;
+		frag[j]->msg_type = msg->msg_type;
+		frag[j]->frag_id = id;
+		frag[j]->frag_owner = frag[0];
+		frag[j]->first_fragment = (j == 0) ? 1 : 0;
+		frag[j]->last_fragment = (j == nfrag - 1) ? 1 : 0;
+	}
+	frag[0]->nfrag = nfrag;
+
+	/* the owner takes the map; msg keeps an allocation to reuse */
+	map = frag[0]->frag_map;
+	frag[0]->frag_map = msg->frag_map;
+	msg->frag_map = map;
+
+	stats_pool_incr_by(ctx, pool, fragments, nfrag);
+
+	if (log_loggable(LOG_VERB)) {
+		log_debug(LOG_VERB, "split req %"PRIu64" with %"PRIu32" keys into %"PRIu32
+				  " fragments with frag id %"PRIu64"", msg->id, nkey, nfrag, id);
+	}
+
+	req_put(msg);
+
+	for (j = 0; j < nfrag; j++) {
+		req_forward(ctx, c_conn, frag[j]);
+	}
+	dn_free(frag);
+
+	return true;
+
+enomem:
+	if (!msg->noreply) {
+		c_conn->enqueue_outq(ctx, c_conn, msg);
+	}
+	errno = ENOMEM;
+	req_forward_error(ctx, c_conn, msg);
+	return true;
+}
+
+
+/* a single-key GET, whose reply can be kept in the near cache */
+static bool
+req_cacheable(struct msg *msg)
+{
+	if (msg->type != MSG_REQ_REDIS_GET && msg->type != MSG_REQ_MC_GET) {
+		return false;
+	}
+
+	if (msg->binary || msg->frag_id != 0 || msg->key_end <= msg->key_start) {
+		return false;
+	}
+
+	return msg->keys == NULL || array_n(msg->keys) <= 1;
+}
+
+
+/* drop the keys of a write from the near cache */
+void
+req_cache_invalidate(struct msg *msg)
+{
+	struct keypos *kpos;
+	uint32_t i;
+
+	ASSERT(msg->request && !msg->is_read);
+
+	if (msg->keys == NULL || array_n(msg->keys) == 0) {
+		if (msg->key_end > msg->key_start) {
+			ncache_invalidate(msg->key_start, (uint32_t)(msg->key_end - msg->key_start));
+		}
+		return;
+	}
+
+	for (i = 0; i < array_n(msg->keys); i++) {
+		kpos = array_get(msg->keys, i);
+		ncache_invalidate(kpos->start, (uint32_t)(kpos->end - kpos->start));
+	}
+}
+
+
+/*
+ * Answer a single-key GET from the near cache. On a miss msg is stamped so
+ * that its reply is kept once it comes back, and false is returned.
+ */
+static bool
+req_forward_cached(struct context *ctx, struct conn *c_conn, struct msg *msg)
+{
+	rstatus_t status;
+	struct ncache_entry *e;
+	struct msg *rsp;
+	struct mbuf *mbuf;
+	uint8_t *pos;
+	uint32_t n, len;
+
+	if (!req_cacheable(msg)) {
+		return false;
+	}
+
+	e = ncache_get(msg->key_start, (uint32_t)(msg->key_end - msg->key_start),
+				   dn_msec_now());
+	if (e == NULL) {
+		msg->cache_epoch = ncache_epoch();
+		return false;
+	}
+
+	rsp = msg_get(c_conn, false, msg->redis);
+	if (rsp == NULL) {
+		return false;
+	}
+
+	for (pos = ncache_value(e), n = e->vlen; n > 0; pos += len, n -= len) {
+		mbuf = mbuf_get_size(n);
+		if (mbuf == NULL) {
+			msg_put(rsp);
+			return false;
+		}
+		len = MIN(n, mbuf_size(mbuf));
+		mbuf_copy(mbuf, pos, len);
+		mbuf_insert(&rsp->mhdr, mbuf);
+	}
+	rsp->mlen = e->vlen;
+	rsp->type = e->type;
+
+	c_conn->enqueue_outq(ctx, c_conn, msg);
+	msg->peer = rsp;
+	rsp->peer = msg;
+	msg->done = 1;
+
+	stats_pool_incr(ctx, c_conn->owner, client_cached_requests);
+
+	if (log_loggable(LOG_VERB)) {
+		log_debug(LOG_VERB, "near cache hit for req %"PRIu64" from c %d with "
+				  "%"PRIu32" byte reply", msg->id, c_conn->sd, rsp->mlen);
+	}
+
+	if (req_done(c_conn, TAILQ_FIRST(&c_conn->omsg_q))) {
+		status = event_add_out(ctx->evb, c_conn);
+		if (status != DN_OK) {
+			c_conn->err = errno;
+		}
+	}
+
+	return true;
+}
+
+
 static void
 req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg)
 {
@@ -617,31 +1157,29 @@ req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg)
 
 	ASSERT(c_conn->client && !c_conn->proxy);
 
+	if (msg->frag_id == 0 && !msg->is_read) {
+		req_cache_invalidate(msg);
+	}
+
+	if (msg->frag_id == 0 && msg->keys != NULL && array_n(msg->keys) > 1 &&
+		req_forward_scatter(ctx, c_conn, msg)) {
+		return;
+	}
+
 	if (msg->is_read)
 		stats_pool_incr(ctx, pool, client_read_requests);
 	else
 		stats_pool_incr(ctx, pool, client_write_requests);
 
-	key = NULL;
-	keylen = 0;
-
-	if (!string_empty(&pool->hash_tag)) {
-		struct string *tag = &pool->hash_tag;
-		uint8_t *tag_start, *tag_end;
-
-		tag_start = dn_strchr(msg->key_start, msg->key_end, tag->data[0]);
-		if (tag_start != NULL) {
-			tag_end = dn_strchr(tag_start + 1, msg->key_end, tag->data[1]);
-			if (tag_end != NULL) {
-				key = tag_start + 1;
-				keylen = (uint32_t)(tag_end - key);
-			}
-		}
+	if (msg->is_read && req_forward_cached(ctx, c_conn, msg)) {
+		return;
 	}
 
-	if (keylen == 0) {
-		key = msg->key_start;
-		keylen = (uint32_t)(msg->key_end - msg->key_start);
+	key = req_routing_key(pool, msg->key_start, msg->key_end, &keylen);
+
+	/* hash once, before msg is cloned for every rack and dc */
+	if (keylen != 0) {
+		IGNORE_RET_VAL(msg_key_token(pool, msg, key, keylen));
 	}
 
 	// need to capture the initial mbuf location as once we add in the dynomite headers (as mbufs to the src msg),
@@ -667,6 +1205,10 @@ req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg)
 			}
 
 			if (string_compare(dc->name, &pool->dc) == 0) { //send to all local racks
+				if (req_forward_quorum(ctx, c_conn, msg, orig_mbuf, key, keylen)) {
+					continue;
+				}
+
 				//log_debug(LOG_DEBUG, "dc name  '%.*s'", dc->name->len, dc->name->data);
 				uint32_t rack_cnt = array_n(&dc->racks);
 				uint32_t rack_index;
@@ -719,7 +1261,18 @@ req_forward(struct context *ctx, struct conn *c_conn, struct msg *msg)
 			}
 		}
 	} else { //for read only requests
+		if (req_forward_quorum(ctx, c_conn, msg, orig_mbuf, key, keylen)) {
+			return;
+		}
+
 		struct rack * rack = server_get_rack_by_dc_rack(pool, &pool->rack, &pool->dc);
+		if (pool->dyn_snitch) {
+			rack = snitch_read_rack(pool, rack, msg, key, keylen, false);
+		}
+
+		if (req_forward_hedged(ctx, c_conn, msg, rack, key, keylen)) {
+			return;
+		}
 		remote_req_forward(ctx, c_conn, msg, rack, key, keylen);
 	}
 }
@@ -22,6 +22,7 @@
 
 #include "dyn_core.h"
 #include "dyn_server.h"
+#include "dyn_node_snitch.h"
 
 struct msg *
 rsp_get(struct conn *conn)
@@ -85,7 +86,7 @@ rsp_make_error(struct context *ctx, struct conn *conn, struct msg *msg)
         rsp_put(pmsg);
     }
 
-    return msg_get_error(conn->redis, msg->dyn_error, err);
+    return msg_get_error(msg, conn->redis, msg->dyn_error, err);
 }
 
 struct msg *
@@ -237,6 +238,8 @@ rsp_forward(struct context *ctx, struct conn *s_conn, struct msg *msg)
     s_conn->dequeue_outq(ctx, s_conn, pmsg);
     pmsg->done = 1;
 
+    snitch_update(s_conn->owner, pmsg->qtime_in_microsec, dn_usec_now());
+
     /* establish msg <-> pmsg (response <-> request) link */
     pmsg->peer = msg;
     msg->peer = pmsg;
@@ -254,6 +257,8 @@ rsp_forward(struct context *ctx, struct conn *s_conn, struct msg *msg)
     }
 
     rsp_forward_stats(ctx, s_conn->owner, msg);
+
+    rspmgr_submit(ctx, pmsg);
 }
 
 void
@@ -276,6 +281,23 @@ rsp_recv_done(struct context *ctx, struct conn *conn, struct msg *msg,
     rsp_forward(ctx, conn, msg);
 }
 
+/* a GET reply - a value or a miss - that can be kept in the near cache */
+static bool
+rsp_cacheable(struct msg *msg)
+{
+    switch (msg->type) {
+    case MSG_RSP_REDIS_BULK:
+    case MSG_RSP_MC_VALUE:
+    case MSG_RSP_MC_END:
+        return true;
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
 struct msg *
 rsp_send_next(struct context *ctx, struct conn *conn)
 {
@@ -328,6 +350,11 @@ rsp_send_next(struct context *ctx, struct conn *conn)
         }
     } else {
         msg = pmsg->peer;
+        if (pmsg->cache_epoch != 0 && rsp_cacheable(msg)) {
+            IGNORE_RET_VAL(ncache_put(pmsg->key_start,
+                                      (uint32_t)(pmsg->key_end - pmsg->key_start),
+                                      msg, pmsg->cache_epoch, dn_msec_now()));
+        }
     }
     ASSERT(!msg->request);
 
@@ -0,0 +1,387 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#include "dyn_core.h"
+#include "dyn_response_mgr.h"
+
+static uint32_t nfree_rspmgrq;                 /* # free response_mgr q */
+static struct response_mgr_tqh free_rspmgrq;   /* free response_mgr q */
+static struct twheel hedge_wheel;              /* hedged reads by due time */
+
+
+void
+rspmgr_init(void)
+{
+    nfree_rspmgrq = 0;
+    TAILQ_INIT(&free_rspmgrq);
+    twheel_init(&hedge_wheel, dn_msec_now());
+}
+
+
+void
+rspmgr_deinit(void)
+{
+    struct response_mgr *mgr, *nmgr;
+
+    for (mgr = TAILQ_FIRST(&free_rspmgrq); mgr != NULL;
+         mgr = nmgr, nfree_rspmgrq--) {
+        ASSERT(nfree_rspmgrq > 0);
+        nmgr = TAILQ_NEXT(mgr, m_tqe);
+        dn_free(mgr);
+    }
+    ASSERT(nfree_rspmgrq == 0);
+}
+
+
+struct response_mgr *
+rspmgr_get(struct msg *msg, consistency_t consistency)
+{
+    struct response_mgr *mgr;
+
+    ASSERT(msg->request && msg->rspmgr == NULL);
+
+    if (!TAILQ_EMPTY(&free_rspmgrq)) {
+        ASSERT(nfree_rspmgrq > 0);
+
+        mgr = TAILQ_FIRST(&free_rspmgrq);
+        nfree_rspmgrq--;
+        TAILQ_REMOVE(&free_rspmgrq, mgr, m_tqe);
+    } else {
+        mgr = dn_alloc(sizeof(*mgr));
+        if (mgr == NULL) {
+            return NULL;
+        }
+    }
+
+    mgr->msg = msg;
+    mgr->nreplica = 0;
+    mgr->nrsp = 0;
+    mgr->nerror = 0;
+    mgr->quorum = 0;
+    mgr->consistency = consistency;
+    mgr->err = 0;
+    mgr->done = 0;
+
+    twnode_init(&mgr->hedge_node);
+    mgr->hedge_node.data = mgr;
+    mgr->hedge_rack = NULL;
+    mgr->key = NULL;
+    mgr->keylen = 0;
+
+    msg->rspmgr = mgr;
+
+    return mgr;
+}
+
+
+static void
+rspmgr_put(struct response_mgr *mgr)
+{
+    ASSERT(mgr->nreplica == 0 && mgr->nrsp == 0);
+
+    nfree_rspmgrq++;
+    TAILQ_INSERT_HEAD(&free_rspmgrq, mgr, m_tqe);
+}
+
+
+/* register a replica of the client request; the quorum is a majority of them */
+rstatus_t
+rspmgr_add_replica(struct response_mgr *mgr, struct msg *replica)
+{
+    ASSERT(replica->request && replica->rspmgr == NULL);
+
+    if (mgr->nreplica == RSPMGR_MAX_REPLICA) {
+        return DN_ERROR;
+    }
+
+    mgr->replica[mgr->nreplica++] = replica;
+    if (mgr->consistency == DC_ONE) {
+        mgr->quorum = 1;
+    } else {
+        mgr->quorum = (uint8_t)(mgr->nreplica / 2 + 1);
+    }
+    replica->rspmgr = mgr;
+
+    return DN_OK;
+}
+
+
+bool
+rspmgr_is_replica(struct msg *msg)
+{
+    return msg->rspmgr != NULL && msg->rspmgr->msg != msg;
+}
+
+
+static void
+rspmgr_remove_replica(struct response_mgr *mgr, struct msg *replica)
+{
+    uint8_t i;
+
+    for (i = 0; i < mgr->nreplica; i++) {
+        if (mgr->replica[i] == replica) {
+            mgr->replica[i] = mgr->replica[--mgr->nreplica];
+            break;
+        }
+    }
+
+    replica->rspmgr = NULL;
+}
+
+
+/* do two responses carry the same bytes? */
+static bool
+rspmgr_match(struct msg *a, struct msg *b)
+{
+    struct mbuf *abuf, *bbuf;
+    uint8_t *apos, *bpos;
+    size_t n;
+
+    abuf = STAILQ_FIRST(&a->mhdr);
+    bbuf = STAILQ_FIRST(&b->mhdr);
+    apos = (abuf != NULL) ? abuf->pos : NULL;
+    bpos = (bbuf != NULL) ? bbuf->pos : NULL;
+
+    for (;;) {
+        while (abuf != NULL && apos == abuf->last) {
+            abuf = STAILQ_NEXT(abuf, next);
+            apos = (abuf != NULL) ? abuf->pos : NULL;
+        }
+        while (bbuf != NULL && bpos == bbuf->last) {
+            bbuf = STAILQ_NEXT(bbuf, next);
+            bpos = (bbuf != NULL) ? bbuf->pos : NULL;
+        }
+
+        if (abuf == NULL || bbuf == NULL) {
+            return abuf == bbuf;
+        }
+
+        n = MIN((size_t)(abuf->last - apos), (size_t)(bbuf->last - bpos));
+        if (memcmp(apos, bpos, n) != 0) {
+            return false;
+        }
+        apos += n;
+        bpos += n;
+    }
+}
+
+
+static void
+rspmgr_add_rsp(struct response_mgr *mgr, struct msg *rsp)
+{
+    uint8_t i, k;
+
+    k = mgr->nrsp++;
+    mgr->rsp[k] = rsp;
+    mgr->nmatch[k] = 1;
+
+    for (i = 0; i < k; i++) {
+        if (rspmgr_match(mgr->rsp[i], rsp)) {
+            mgr->nmatch[i]++;
+            mgr->nmatch[k]++;
+        }
+    }
+}
+
+
+/* drop the replies and let the outstanding replicas be swallowed */
+static void
+rspmgr_release(struct response_mgr *mgr, struct msg *keep)
+{
+    struct msg *replica;
+    uint8_t i;
+
+    twheel_delete(&hedge_wheel, &mgr->hedge_node);
+
+    for (i = 0; i < mgr->nrsp; i++) {
+        if (mgr->rsp[i] != keep) {
+            rsp_put(mgr->rsp[i]);
+        }
+    }
+    mgr->nrsp = 0;
+
+    for (i = 0; i < mgr->nreplica; i++) {
+        replica = mgr->replica[i];
+        replica->rspmgr = NULL;
+        replica->swallow = 1;
+    }
+    mgr->nreplica = 0;
+}
+
+
+static void
+rspmgr_finish(struct context *ctx, struct response_mgr *mgr, struct msg *rsp)
+{
+    struct msg *msg = mgr->msg;
+    struct conn *c_conn = msg->owner;
+    rstatus_t status;
+
+    ASSERT(!msg->done && msg->peer == NULL);
+
+    log_debug(LOG_VERB, "req %"PRIu64" %s with %"PRIu8" of %"PRIu8" replies, "
+              "%"PRIu8" errors", msg->id, rsp != NULL ? "reached quorum" : "failed quorum",
+              mgr->nrsp, mgr->quorum, mgr->nerror);
+
+    mgr->done = 1;
+    rspmgr_release(mgr, rsp);
+
+    if (rsp != NULL) {
+        msg->peer = rsp;
+        rsp->peer = msg;
+    } else {
+        msg->error = 1;
+        msg->err = mgr->err;
+        msg->dyn_error = QUORUM_NOT_REACHED;
+    }
+    msg->done = 1;
+
+    if (req_done(c_conn, TAILQ_FIRST(&c_conn->omsg_q))) {
+        status = event_add_out(ctx->evb, c_conn);
+        if (status != DN_OK) {
+            c_conn->err = errno;
+        }
+    }
+}
+
+
+/*
+ * Answer the client once the request is decided. Under DC_QUORUM the reply
+ * agreed on by most replicas is taken as soon as a quorum has answered;
+ * DC_SAFE_QUORUM needs a quorum of equal replies.
+ */
+static void
+rspmgr_check(struct context *ctx, struct response_mgr *mgr)
+{
+    uint8_t i, best, nreply;
+
+    if (mgr->done) {
+        return;
+    }
+
+    for (best = 0, i = 1; i < mgr->nrsp; i++) {
+        if (mgr->nmatch[i] > mgr->nmatch[best]) {
+            best = i;
+        }
+    }
+
+    if (mgr->consistency == DC_SAFE_QUORUM) {
+        nreply = (mgr->nrsp > 0) ? mgr->nmatch[best] : 0;
+    } else {
+        nreply = mgr->nrsp;
+    }
+
+    if (nreply >= mgr->quorum) {
+        rspmgr_finish(ctx, mgr, mgr->rsp[best]);
+    } else if (nreply + mgr->nreplica < mgr->quorum) {
+        rspmgr_finish(ctx, mgr, NULL);
+    }
+}
+
+
+/*
+ * Hand a replica that is done over to its response_mgr, which takes its
+ * reply and frees it. Returns false if req is not a replica.
+ */
+bool
+rspmgr_submit(struct context *ctx, struct msg *req)
+{
+    struct response_mgr *mgr = req->rspmgr;
+    struct msg *rsp;
+
+    if (mgr == NULL || mgr->msg == req) {
+        return false;
+    }
+
+    ASSERT(req->done && !mgr->done);
+
+    rspmgr_remove_replica(mgr, req);
+
+    rsp = req->peer;
+    if (rsp != NULL) {
+        req->peer = NULL;
+        rsp->peer = NULL;
+    }
+
+    if (req->error || rsp == NULL) {
+        mgr->nerror++;
+        mgr->err = req->err;
+        if (rsp != NULL) {
+            rsp_put(rsp);
+        }
+    } else {
+        rspmgr_add_rsp(mgr, rsp);
+    }
+
+    req_put(req);
+
+    rspmgr_check(ctx, mgr);
+
+    return true;
+}
+
+
+/*
+ * Called as a request is freed. Freeing the client request drops its
+ * response_mgr; a replica freed before it is done counts as failed.
+ */
+void
+rspmgr_detach(struct msg *msg)
+{
+    struct response_mgr *mgr = msg->rspmgr;
+
+    if (mgr == NULL) {
+        return;
+    }
+
+    if (mgr->msg != msg) {
+        rspmgr_remove_replica(mgr, msg);
+        mgr->nerror++;
+        rspmgr_check(conn_to_ctx(mgr->msg->owner), mgr);
+        return;
+    }
+
+    rspmgr_release(mgr, msg->peer);
+    msg->rspmgr = NULL;
+    rspmgr_put(mgr);
+}
+
+
+/* send a second replica of the read to rack if none has answered in delay msec */
+void
+rspmgr_hedge_insert(struct response_mgr *mgr, struct rack *rack,
+                    uint8_t *key, uint32_t keylen, int delay)
+{
+    ASSERT(mgr->consistency == DC_ONE && delay > 0);
+
+    mgr->hedge_rack = rack;
+    mgr->key = key;
+    mgr->keylen = keylen;
+
+    mgr->hedge_node.key = dn_msec_now() + delay;
+    twheel_insert(&hedge_wheel, &mgr->hedge_node);
+}
+
+
+/* next read due to be hedged by now, NULL if none */
+struct response_mgr *
+rspmgr_hedge_expire(int64_t now)
+{
+    struct twnode *node;
+
+    node = twheel_expire(&hedge_wheel, now);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    return node->data;
+}
+
+
+/* earliest msec a read is due to be hedged at, -1 if none */
+int64_t
+rspmgr_hedge_next(void)
+{
+    return twheel_next(&hedge_wheel);
+}
@@ -0,0 +1,68 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#ifndef _DYN_RESPONSE_MGR_H_
+#define _DYN_RESPONSE_MGR_H_
+
+#define RSPMGR_MAX_REPLICA      8   /* max racks in the local dc under quorum */
+
+#define CONSISTENCY_CODEC(ACTION)                    \
+    ACTION( DC_ONE,             dc_one             ) \
+    ACTION( DC_QUORUM,          dc_quorum          ) \
+    ACTION( DC_SAFE_QUORUM,     dc_safe_quorum     ) \
+
+#define DEFINE_ACTION(_cons, _name) _cons,
+typedef enum consistency {
+    CONSISTENCY_CODEC( DEFINE_ACTION )
+    CONSISTENCY_SENTINEL
+} consistency_t;
+#undef DEFINE_ACTION
+
+/*
+ * Collects the replies of the replicas a client request was fanned out to.
+ * The request itself is never sent; it waits in the client outq until a
+ * quorum of replicas has answered (DC_QUORUM) or agreed (DC_SAFE_QUORUM),
+ * or until the quorum can no longer be reached. Replicas still outstanding
+ * at that point are swallowed.
+ *
+ * A DC_ONE read may be hedged: if its replica has not answered when the
+ * hedge node expires, a second replica goes to hedge_rack and the first
+ * reply wins.
+ */
+struct response_mgr {
+    TAILQ_ENTRY(response_mgr) m_tqe;                        /* link in free q */
+    struct msg                *msg;                         /* client request */
+    struct msg                *replica[RSPMGR_MAX_REPLICA]; /* outstanding replicas */
+    struct msg                *rsp[RSPMGR_MAX_REPLICA];     /* replies received */
+    uint8_t                   nmatch[RSPMGR_MAX_REPLICA];   /* # replies equal to rsp[i] */
+    uint8_t                   nreplica;                     /* # outstanding replicas */
+    uint8_t                   nrsp;                         /* # replies received */
+    uint8_t                   nerror;                       /* # replicas that failed */
+    uint8_t                   quorum;                       /* # replies needed */
+    consistency_t             consistency;                  /* consistency level */
+    err_t                     err;                          /* last replica error */
+    unsigned                  done:1;                       /* decided? */
+
+    struct twnode             hedge_node;                   /* entry in hedge wheel */
+    struct rack               *hedge_rack;                  /* rack to hedge a read to */
+    uint8_t                   *key;                         /* routing key in msg */
+    uint32_t                  keylen;                       /* routing key length */
+};
+
+TAILQ_HEAD(response_mgr_tqh, response_mgr);
+
+void rspmgr_init(void);
+void rspmgr_deinit(void);
+struct response_mgr *rspmgr_get(struct msg *msg, consistency_t consistency);
+rstatus_t rspmgr_add_replica(struct response_mgr *mgr, struct msg *replica);
+bool rspmgr_is_replica(struct msg *msg);
+bool rspmgr_submit(struct context *ctx, struct msg *req);
+void rspmgr_detach(struct msg *msg);
+void rspmgr_hedge_insert(struct response_mgr *mgr, struct rack *rack,
+                         uint8_t *key, uint32_t keylen, int delay);
+struct response_mgr *rspmgr_hedge_expire(int64_t now);
+int64_t rspmgr_hedge_next(void);
+
+#endif
@@ -12,6 +12,62 @@
 #include "dyn_token.h"
 
 
+struct ring_queue C2G_InQ;
+struct ring_queue C2G_OutQ;
+
+
+void
+ring_queue_init(struct ring_queue *q)
+{
+	q->put = 0;
+	q->get = 0;
+}
+
+
+/* producer side; returns false if q is full */
+bool
+ring_queue_push(struct ring_queue *q, void *elem)
+{
+	uint32_t put = __atomic_load_n(&q->put, __ATOMIC_RELAXED);
+	uint32_t get = __atomic_load_n(&q->get, __ATOMIC_ACQUIRE);
+
+	if (put - get == RING_QUEUE_SIZE)
+		return false;
+
+	q->entry[put & RING_QUEUE_MASK] = elem;
+	__atomic_store_n(&q->put, put + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+/* consumer side; returns NULL if q is empty */
+void *
+ring_queue_pop(struct ring_queue *q)
+{
+	uint32_t get = __atomic_load_n(&q->get, __ATOMIC_RELAXED);
+	uint32_t put = __atomic_load_n(&q->put, __ATOMIC_ACQUIRE);
+	void *elem;
+
+	if (get == put)
+		return NULL;
+
+	elem = q->entry[get & RING_QUEUE_MASK];
+	__atomic_store_n(&q->get, get + 1, __ATOMIC_RELEASE);
+
+	return elem;
+}
+
+
+/* # entries in q; exact only from the producer or consumer thread */
+uint32_t
+ring_queue_len(struct ring_queue *q)
+{
+	return __atomic_load_n(&q->put, __ATOMIC_ACQUIRE) -
+	       __atomic_load_n(&q->get, __ATOMIC_ACQUIRE);
+}
+
+
 //should use pooling to store struct ring_message so that we can reuse
 struct ring_msg *
 create_ring_msg(void)
@@ -11,32 +11,30 @@
 #define _DYN_RING_QUEUE_
 
 
-#define C2G_InQ_SIZE     256
-#define C2G_OutQ_SIZE    256
-
-#define C2S_InQ_SIZE     256
-#define C2S_OutQ_SIZE    256
+#define RING_QUEUE_SIZE       256    /* power of 2 */
+#define RING_QUEUE_MASK       (RING_QUEUE_SIZE - 1)
+#define RING_QUEUE_CACHELINE  64
 
 struct node;
 
 typedef rstatus_t (*callback_t)(void *msg);
 typedef void (*data_func_t)(void *);
 
-volatile struct
-{
-     long     m_getIdx;
-     long     m_putIdx;
-     void*    m_entry[C2G_InQ_SIZE];
-} C2G_InQ;
-
-
+/*
+ * Lock-free ring of pointers from one producer thread to one consumer
+ * thread. Each index is only written by its own side: the producer publishes
+ * an entry with a release store of put, and the consumer hands the slot back
+ * with a release store of get; each side reads the other's index with an
+ * acquire load. The indices sit on separate cache lines.
+ */
+struct ring_queue {
+    uint32_t  put __attribute__((aligned(RING_QUEUE_CACHELINE)));  /* next slot to push, producer only */
+    uint32_t  get __attribute__((aligned(RING_QUEUE_CACHELINE)));  /* next slot to pop, consumer only */
+    void      *entry[RING_QUEUE_SIZE] __attribute__((aligned(RING_QUEUE_CACHELINE)));
+};
 
-volatile struct
-{
-     long     m_getIdx;
-     long     m_putIdx;
-     void*    m_entry[C2G_OutQ_SIZE];
-} C2G_OutQ;
+extern struct ring_queue C2G_InQ;    /* core to gossip */
+extern struct ring_queue C2G_OutQ;   /* gossip to core */
 
 
 
@@ -52,23 +50,6 @@ struct ring_msg {
 
 
 
-volatile struct
-{
-     long     m_getIdx;
-     long     m_putIdx;
-     void*    m_entry[C2S_InQ_SIZE];
-} C2S_InQ;
-
-
-
-volatile struct
-{
-     long     m_getIdx;
-     long     m_putIdx;
-     void*    m_entry[C2S_OutQ_SIZE];
-} C2S_OutQ;
-
-
 struct stat_msg {
 	void*         cb;
 	void*         post_cb;
@@ -79,6 +60,11 @@ struct stat_msg {
 
 
 
+void ring_queue_init(struct ring_queue *q);
+bool ring_queue_push(struct ring_queue *q, void *elem);
+void *ring_queue_pop(struct ring_queue *q);
+uint32_t ring_queue_len(struct ring_queue *q);
+
 struct ring_msg *create_ring_msg(void);
 struct ring_msg *create_ring_msg_with_data(int capacity);
 struct ring_msg *create_ring_msg_with_size(uint32_t size, bool init_node);
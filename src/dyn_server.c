@@ -382,6 +382,8 @@ server_close(struct context *ctx, struct conn *conn)
 					"len %"PRIu32" type %d from c %d%c %s", conn->sd, msg->id,
 					msg->mlen, msg->type, c_conn->sd, conn->err ? ':' : ' ',
 							conn->err ? strerror(conn->err): " ");
+
+			rspmgr_submit(ctx, msg);
 		}
 
 		stats_server_incr(ctx, conn->owner, server_dropped_requests);
@@ -414,6 +416,8 @@ server_close(struct context *ctx, struct conn *conn)
 					"len %"PRIu32" type %d from c %d%c %s", conn->sd, msg->id,
 					msg->mlen, msg->type, c_conn->sd, conn->err ? ':' : ' ',
 							conn->err ? strerror(conn->err): " ");
+
+			rspmgr_submit(ctx, msg);
 		}
 	}
 	ASSERT(TAILQ_EMPTY(&conn->omsg_q));
@@ -544,6 +548,119 @@ server_connected(struct context *ctx, struct conn *conn)
         }
 }
 
+/*
+ * Admission control. A server or peer is overloaded once the requests
+ * queued to it reach the pool's queue_high_watermark, and stays so until
+ * they drain to queue_low_watermark. While the datastore is overloaded the
+ * clients of the pool are not read from, so the backlog is left in their
+ * socket buffers instead of our queues.
+ */
+static void
+server_pause_clients(struct server_pool *pool, bool pause)
+{
+	struct context *ctx = pool->ctx;
+	struct conn *conn;
+
+	if (pool->clients_paused == (pause ? 1 : 0)) {
+		return;
+	}
+
+	pool->clients_paused = pause ? 1 : 0;
+	if (pause) {
+		stats_pool_incr(ctx, pool, client_paused);
+	}
+
+	TAILQ_FOREACH(conn, &pool->c_conn_q, conn_tqe) {
+		if (!conn->client || conn->sd < 0) {
+			continue;
+		}
+
+		if (pause) {
+			event_del_in(ctx->evb, conn);
+		} else {
+			event_add_in(ctx->evb, conn);
+		}
+	}
+}
+
+static void
+server_overload(struct conn *conn, bool overloaded)
+{
+	struct server *server = conn->owner;
+	struct server_pool *pool = server->owner;
+
+	server->overloaded = overloaded ? 1 : 0;
+
+	log_warn("%s '%.*s' %s with %"PRIu32" requests queued",
+			 conn->dyn_mode ? "peer" : "server", server->pname.len,
+			 server->pname.data, overloaded ? "overloaded" : "recovered",
+			 server->outstanding);
+
+	if (!conn->dyn_mode) {
+		server_pause_clients(pool, overloaded);
+	}
+}
+
+/* count a request queued on one of the server's connections */
+void
+server_outstanding_incr(struct conn *conn)
+{
+	struct server *server = conn->owner;
+	struct server_pool *pool = server->owner;
+
+	server->outstanding++;
+
+	if (!server->overloaded && pool->queue_high_watermark > 0 &&
+		server->outstanding >= pool->queue_high_watermark) {
+		server_overload(conn, true);
+	}
+}
+
+void
+server_outstanding_decr(struct conn *conn)
+{
+	struct server *server = conn->owner;
+	struct server_pool *pool = server->owner;
+
+	ASSERT(server->outstanding > 0);
+	server->outstanding--;
+
+	if (server->overloaded && server->outstanding <= pool->queue_low_watermark) {
+		server_overload(conn, false);
+	}
+}
+
+/*
+ * Can another request be queued to server? Not while it is overloaded, nor
+ * while its replies take longer than timeout msec, as whatever is queued
+ * behind them would time out anyway.
+ */
+bool
+server_admit(struct server *server, int timeout)
+{
+	if (server->overloaded) {
+		return false;
+	}
+
+	if (timeout > 0 && server->outstanding > 0 &&
+		server->latency > (int64_t)timeout * 1000LL) {
+		return false;
+	}
+
+	return true;
+}
+
+/* pause the reads of a new client if the pool's clients are paused */
+void
+server_pool_admit_client(struct context *ctx, struct conn *conn)
+{
+	struct server_pool *pool = conn->owner;
+
+	if (pool->clients_paused) {
+		event_del_in(ctx->evb, conn);
+	}
+}
+
 void
 server_ok(struct context *ctx, struct conn *conn)
 {
@@ -839,6 +956,8 @@ rack_init(struct rack *rack)
 	rack->continuum = dn_alloc(sizeof(struct continuum));
 	rack->ncontinuum = 0;
 	rack->nserver_continuum = 0;
+	rack->fast_token = NULL;
+	rack->fast_index = NULL;
 	rack->name = dn_alloc(sizeof(struct string));
 	string_init(rack->name);
 
@@ -856,6 +975,11 @@ rack_deinit(struct rack *rack)
 		dn_free(rack->continuum);
 	}
 
+	if (rack->fast_token != NULL) {
+		dn_free(rack->fast_token);
+		dn_free(rack->fast_index);
+	}
+
 	return DN_OK;
 }
 
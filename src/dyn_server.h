@@ -81,6 +81,10 @@ rstatus_t server_connect(struct context *ctx, struct server *server, struct conn
 void server_close(struct context *ctx, struct conn *conn);
 void server_connected(struct context *ctx, struct conn *conn);
 void server_ok(struct context *ctx, struct conn *conn);
+void server_outstanding_incr(struct conn *conn);
+void server_outstanding_decr(struct conn *conn);
+bool server_admit(struct server *server, int timeout);
+void server_pool_admit_client(struct context *ctx, struct conn *conn);
 
 struct datacenter *server_get_dc(struct server_pool *pool, struct string *dcname);
 struct rack *server_get_rack(struct datacenter *dc, struct string *rackname);
@@ -18,15 +18,56 @@
 #include "dyn_core.h"
 #include "dyn_conf.h"
 
-static uint32_t conn_msg_rate = CONF_DEFAULT_CONN_MSG_RATE;           //conn msgs per sec
+static uint32_t conn_msg_rate = CONF_DEFAULT_CONN_MSG_RATE;           //cross-DC conn msgs per sec
+static uint32_t conn_byte_rate = CONF_DEFAULT_CONN_BYTE_RATE;         //cross-DC conn bytes per sec
+static uint32_t local_conn_msg_rate = CONF_DEFAULT_LOCAL_CONN_MSG_RATE;   //same-DC conn msgs per sec
+static uint32_t local_conn_byte_rate = CONF_DEFAULT_LOCAL_CONN_BYTE_RATE; //same-DC conn bytes per sec
+static uint32_t dyn_batch_size = CONF_DEFAULT_DYN_BATCH_SIZE;         //peer reqs per dnode frame
+static uint32_t dyn_compress_threshold = CONF_DEFAULT_DYN_COMPRESS_THRESHOLD; //min bytes to compress
 
 
-uint32_t msgs_per_sec(void)
+uint32_t msgs_per_sec(bool same_dc)
 {
-   return conn_msg_rate;
+   return same_dc ? local_conn_msg_rate : conn_msg_rate;
 }
 
-void set_msgs_per_sec(uint32_t tokens_per_sec)
+void set_msgs_per_sec(bool same_dc, uint32_t tokens_per_sec)
 {
-	conn_msg_rate = tokens_per_sec;
+	if (same_dc)
+		local_conn_msg_rate = tokens_per_sec;
+	else
+		conn_msg_rate = tokens_per_sec;
+}
+
+uint32_t bytes_per_sec(bool same_dc)
+{
+   return same_dc ? local_conn_byte_rate : conn_byte_rate;
+}
+
+void set_bytes_per_sec(bool same_dc, uint32_t tokens_per_sec)
+{
+	if (same_dc)
+		local_conn_byte_rate = tokens_per_sec;
+	else
+		conn_byte_rate = tokens_per_sec;
+}
+
+uint32_t dnode_batch_size(void)
+{
+   return dyn_batch_size;
+}
+
+void set_dnode_batch_size(uint32_t batch_size)
+{
+	dyn_batch_size = batch_size;
+}
+
+uint32_t dnode_compress_threshold(void)
+{
+   return dyn_compress_threshold;
+}
+
+void set_dnode_compress_threshold(uint32_t threshold)
+{
+	dyn_compress_threshold = threshold;
 }
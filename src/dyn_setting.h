@@ -20,8 +20,14 @@
 #define _DYN_SETTING_H_
 
 
-uint32_t msgs_per_sec(void);
-void set_msgs_per_sec(uint32_t tokens_per_sec);
+uint32_t msgs_per_sec(bool same_dc);
+void set_msgs_per_sec(bool same_dc, uint32_t tokens_per_sec);
+uint32_t bytes_per_sec(bool same_dc);
+void set_bytes_per_sec(bool same_dc, uint32_t tokens_per_sec);
+uint32_t dnode_batch_size(void);
+void set_dnode_batch_size(uint32_t batch_size);
+uint32_t dnode_compress_threshold(void);
+void set_dnode_compress_threshold(uint32_t threshold);
 
 
 #endif
@@ -33,11 +33,16 @@ static struct signal signals[] = {
     { SIGTTOU, "SIGTTOU", 0,                 signal_handler },
     { SIGHUP,  "SIGHUP",  0,                 signal_handler },
     { SIGINT,  "SIGINT",  0,                 signal_handler },
+    { SIGTERM, "SIGTERM", 0,                 signal_handler },
     { SIGSEGV, "SIGSEGV", (int)SA_RESETHAND, signal_handler },
     { SIGPIPE, "SIGPIPE", 0,                 SIG_IGN },
     { 0,        NULL,     0,                 NULL }
 };
 
+static pid_t *worker_pids;    /* worker pids, only set in the master */
+static uint32_t nworker_pids; /* # worker pids */
+static bool worker;           /* true in a worker of a master */
+
 rstatus_t
 signal_init(void)
 {
@@ -68,6 +73,40 @@ signal_deinit(void)
 {
 }
 
+/*
+ * Register the worker processes of a master so that signals received by
+ * the master are relayed to every worker.
+ */
+void
+signal_set_workers(pid_t *pids, uint32_t npids)
+{
+    worker_pids = pids;
+    nworker_pids = npids;
+}
+
+/*
+ * Mark this process as a worker: it then dies of SIGINT and SIGTERM rather
+ * than exiting, so that its master respawns it.
+ */
+void
+signal_set_worker(void)
+{
+    signal_set_workers(NULL, 0);
+    worker = true;
+}
+
+static void
+signal_forward(int signo)
+{
+    uint32_t i;
+
+    for (i = 0; i < nworker_pids; i++) {
+        if (worker_pids[i] > 0) {
+            kill(worker_pids[i], signo);
+        }
+    }
+}
+
 void
 signal_handler(int signo)
 {
@@ -110,6 +149,7 @@ signal_handler(int signo)
         break;
 
     case SIGINT:
+    case SIGTERM:
         done = true;
         actionstr = ", exiting";
         break;
@@ -130,6 +170,17 @@ signal_handler(int signo)
         action();
     }
 
+    if (signo != SIGSEGV) {
+        signal_forward(signo);
+    }
+
+    if (done && worker) {
+        /* delivered again with the default action once we return */
+        signal(signo, SIG_DFL);
+        raise(signo);
+        return;
+    }
+
     if (done) {
         exit(1);
     }
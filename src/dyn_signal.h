@@ -36,6 +36,8 @@ struct signal {
 
 rstatus_t signal_init(void);
 void signal_deinit(void);
+void signal_set_workers(pid_t *pids, uint32_t npids);
+void signal_set_worker(void);
 void signal_handler(int signo);
 
 #endif
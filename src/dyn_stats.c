@@ -30,6 +30,7 @@
 
 #include "dyn_core.h"
 #include "dyn_histogram.h"
+#include "dyn_dnode_msg.h"
 #include "dyn_server.h"
 #include "dyn_node_snitch.h"
 #include "dyn_ring_queue.h"
@@ -406,6 +407,26 @@ stats_create_bufs(struct stats *st)
     size += int32_max_digits;
     size += key_value_extra;
 
+    size += st->free_msgs_str.len;
+    size += int32_max_digits;
+    size += key_value_extra;
+
+    size += st->free_dmsgs_str.len;
+    size += int32_max_digits;
+    size += key_value_extra;
+
+    size += st->free_conns_str.len;
+    size += int32_max_digits;
+    size += key_value_extra;
+
+    size += st->free_mbufs_str.len;
+    size += int32_max_digits;
+    size += key_value_extra;
+
+    size += st->mbuf_slabs_str.len;
+    size += int32_max_digits;
+    size += key_value_extra;
+
     /* server pools */
     for (i = 0; i < array_n(&st->sum); i++) {
         struct stats_pool *stp = array_get(&st->sum, i);
@@ -567,6 +588,17 @@ stats_add_header(struct stats *st)
                  (int64_t)st->payload_size_histo.mean));
     THROW_STATUS(stats_add_num(&st->buf, &st->alloc_msgs_str,
                  (int64_t)st->alloc_msgs));
+    //free pool occupancy
+    THROW_STATUS(stats_add_num(&st->buf, &st->free_msgs_str,
+                 (int64_t)st->free_msgs));
+    THROW_STATUS(stats_add_num(&st->buf, &st->free_dmsgs_str,
+                 (int64_t)st->free_dmsgs));
+    THROW_STATUS(stats_add_num(&st->buf, &st->free_conns_str,
+                 (int64_t)st->free_conns));
+    THROW_STATUS(stats_add_num(&st->buf, &st->free_mbufs_str,
+                 (int64_t)st->free_mbufs));
+    THROW_STATUS(stats_add_num(&st->buf, &st->mbuf_slabs_str,
+                 (int64_t)st->mbuf_slabs));
 
     return DN_OK;
 }
@@ -1307,6 +1339,11 @@ stats_create(uint16_t stats_port, char *stats_ip, int stats_interval,
     string_set_text(&st->payload_size_max_str, "payload_size_max");
 
     string_set_text(&st->alloc_msgs_str, "alloc_msgs");
+    string_set_text(&st->free_msgs_str, "free_msgs");
+    string_set_text(&st->free_dmsgs_str, "free_dmsgs");
+    string_set_text(&st->free_conns_str, "free_conns");
+    string_set_text(&st->free_mbufs_str, "free_mbufs");
+    string_set_text(&st->mbuf_slabs_str, "mbuf_slabs");
 
     //only display the first pool
     struct server_pool *sp = (struct server_pool*) array_get(server_pool, 0);
@@ -1325,6 +1362,11 @@ stats_create(uint16_t stats_port, char *stats_ip, int stats_interval,
     histo_init(&st->payload_size_histo);
     st->reset_histogram = 0;
     st->alloc_msgs = 0;
+    st->free_msgs = 0;
+    st->free_dmsgs = 0;
+    st->free_conns = 0;
+    st->free_mbufs = 0;
+    st->mbuf_slabs = 0;
 
     /* map server pool to current (a), shadow (b) and sum (c) */
 
@@ -1402,6 +1444,11 @@ stats_swap(struct stats *st)
     histo_compute(&st->payload_size_histo);
 
     st->alloc_msgs = msg_alloc_msgs();
+    st->free_msgs = msg_free_queue_size();
+    st->free_dmsgs = dmsg_free_queue_size();
+    st->free_conns = conn_free_queue_size();
+    st->free_mbufs = mbuf_free_queue_size();
+    st->mbuf_slabs = mbuf_slab_count();
 
     array_swap(&st->current, &st->shadow);
 
@@ -1723,6 +1770,13 @@ void stats_histo_add_latency(struct context *ctx, uint64_t val)
     ctx->stats->updated = 1;
 }
 
+/* latency in usec below which the given fraction of requests completed */
+uint64_t stats_histo_latency_percentile(struct context *ctx, double percentile)
+{
+    struct stats *st = ctx->stats;
+    return histo_percentile((struct histogram *)&st->latency_histo, percentile);
+}
+
 void stats_histo_add_payloadsize(struct context *ctx, uint64_t val)
 {
     struct stats *st = ctx->stats;
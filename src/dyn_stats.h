@@ -37,6 +37,10 @@
     ACTION( client_read_requests,         STATS_COUNTER,      "# client read requests")                                   \
     ACTION( client_write_requests,        STATS_COUNTER,      "# client write responses")                                 \
     ACTION( client_dropped_requests,      STATS_COUNTER,      "# client dropped requests")                                \
+    ACTION( client_hedged_requests,       STATS_COUNTER,      "# client reads hedged to a second rack")                   \
+    ACTION( client_overload_requests,     STATS_COUNTER,      "# requests turned away from an overloaded server or peer") \
+    ACTION( client_paused,                STATS_COUNTER,      "# times client reads were paused on datastore overload")   \
+    ACTION( client_cached_requests,       STATS_COUNTER,      "# client reads answered from the near cache")              \
     /* pool behavior */                                                                                                   \
     ACTION( server_ejects,                STATS_COUNTER,      "# times backend server was ejected")                       \
     /* dnode client behavior */                                                                                           \
@@ -196,6 +200,11 @@ struct stats {
     struct string             payload_size_max_str;
 
     struct string             alloc_msgs_str;
+    struct string             free_msgs_str;
+    struct string             free_dmsgs_str;
+    struct string             free_conns_str;
+    struct string             free_mbufs_str;
+    struct string             mbuf_slabs_str;
 
     struct string             rack_str;
     struct string             rack;
@@ -209,6 +218,11 @@ struct stats {
     volatile struct histogram latency_histo;
     volatile struct histogram payload_size_histo;
     volatile uint32_t         alloc_msgs;
+    volatile uint32_t         free_msgs;
+    volatile uint32_t         free_dmsgs;
+    volatile uint32_t         free_conns;
+    volatile uint32_t         free_mbufs;
+    volatile uint32_t         mbuf_slabs;
 
 };
 
@@ -360,6 +374,7 @@ void stats_swap(struct stats *stats);
 
 
 void stats_histo_add_latency(struct context *ctx, uint64_t val);
+uint64_t stats_histo_latency_percentile(struct context *ctx, double percentile);
 void stats_histo_add_payloadsize(struct context *ctx, uint64_t val);
 
 
@@ -16,6 +16,10 @@
 #include "dyn_core.h"
 #include "dyn_conf.h"
 #include "dyn_signal.h"
+#include "dyn_server.h"
+#include "dyn_node_snitch.h"
+#include "hashkit/dyn_hashkit.h"
+#include "proto/dyn_proto.h"
 
 #define TEST_CONF_PATH        "conf/dynomite.yml"
 
@@ -120,6 +124,12 @@ test_set_default_options(struct instance *nci)
     nci->hostname[DN_MAXHOSTNAMELEN - 1] = '\0';
 
     nci->mbuf_chunk_size = TEST_MBUF_SIZE;
+    nci->mbuf_prealloc = 0;
+    nci->mbuf_max_idle = MBUF_MAX_IDLE;
+    nci->mbuf_hugepages = 0;
+
+    nci->nworkers = 1;
+    nci->worker_id = 0;
 }
 
 static rstatus_t
@@ -252,6 +262,10 @@ init_server(struct server *s)
 
     s->next_retry = 0LL;
     s->failure_count = 0;
+    s->latency = 0LL;
+    s->latency_at = 0LL;
+    s->outstanding = 0;
+    s->overloaded = 0;
 
     s->processed = 0;
     s->is_seed = 1;
@@ -467,135 +481,1936 @@ aes_test(void)
     return DN_OK;
 }
 
-/* Inspection test */
+/*
+ * Encryption throughput of full mbuf msgs: cipher set up on every call, as
+ * the per-mbuf CBC path did, vs the conn's cached context.
+ */
+static void
+aes_msg_bench(struct conn *conn)
+{
+    EVP_CIPHER_CTX *ctx;
+    struct msg *msg;
+    struct mbuf *mbuf, *nbuf;
+    uint32_t i, len, nmsg = 4096;
+    int64_t usec;
+    int n;
+
+    ctx = EVP_CIPHER_CTX_new();
+    mbuf = mbuf_get();
+    nbuf = mbuf_get();
+    len = (uint32_t)mbuf_size(mbuf);
+    memset(mbuf->last, 'x', len);
+    mbuf->last += len;
+
+    usec = dn_usec_now();
+    for (i = 0; i < nmsg; i++) {
+        EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, conn->aes_key, conn->aes_key);
+        EVP_EncryptUpdate(ctx, nbuf->start, &n, mbuf->pos, (int)len);
+        EVP_EncryptFinal_ex(ctx, nbuf->start + n, &n);
+    }
+    usec = dn_usec_now() - usec;
+    loga("aes per call setup: %"PRIu32" msgs of %"PRIu32" bytes, %.2f GB/s",
+         nmsg, len, (double)nmsg * len / ((double)MAX(usec, 1) * 1000));
+
+    mbuf_put(nbuf);
+    EVP_CIPHER_CTX_free(ctx);
+
+    msg = msg_get(conn, false, conn->redis);
+    mbuf_insert(&msg->mhdr, mbuf);
+
+    usec = dn_usec_now();
+    for (i = 0; i < nmsg; i++) {
+        dyn_aes_encrypt_msg(msg, conn, i, DMSG_REQ);
+    }
+    usec = dn_usec_now() - usec;
+    loga("aes conn context:   %"PRIu32" msgs of %"PRIu32" bytes, %.2f GB/s",
+         nmsg, len, (double)nmsg * len / ((double)MAX(usec, 1) * 1000));
+
+    msg_put(msg);
+}
+
+/*
+ * A request is encrypted as one stream into new buffers, keeping its
+ * plaintext for clones made after it is sent; a response is encrypted in
+ * place. The stream decrypts in pieces that don't line up with the mbufs.
+ */
 static rstatus_t
 aes_msg_test(struct server *server)
 {
-    //unsigned char* aes_key = generate_aes_key();
     struct conn *conn = conn_get_peer(server, false, true);
     struct msg *msg = msg_get(conn, true, conn->redis);
+    struct msg *clone;
+    struct mbuf *mbuf, *first, *owner;
+    struct string s1 = string("*3\r\n$3\r\nset\r\n$3\r\nfoo\r\n");
+    struct string s2 = string("$21\r\nbar-bar-bar-bar-bar-b\r\n");
+    uint8_t buf[128];
+    uint32_t len, off, n;
+
+    loga("=======================AES MSG======================");
+
+    first = mbuf_get();
+    mbuf_write_string(first, &s1);
+    mbuf_insert(&msg->mhdr, first);
+    msg->key_start = first->pos + s1.len - 5;
+
+    owner = mbuf_get();
+    mbuf_write_string(owner, &s2);
+    mbuf_insert(&msg->mhdr, mbuf_ref(owner));
+
+    len = s1.len + s2.len;
+    if (dyn_aes_encrypt_msg(msg, conn, 7, DMSG_REQ) != (rstatus_t)len ||
+        msg_length(msg) != len) {
+        loga("encrypted msg length changed");
+        return DN_ERROR;
+    }
 
-    struct mbuf *mbuf1 = mbuf_get();
-    struct string s1 = string("abc");
-    mbuf_write_string(mbuf1, &s1);
-    STAILQ_INSERT_HEAD(&msg->mhdr, mbuf1, next);
+    if (memcmp(owner->pos, s2.data, s2.len) != 0 ||
+        memcmp(msg->key_start, "foo", 3) != 0) {
+        loga("request payload encrypted in place");
+        return DN_ERROR;
+    }
 
-    struct mbuf *mbuf2 = mbuf_get();
-    struct string s2 = string("abcabc");
-    mbuf_write_string(mbuf2, &s2);
-    STAILQ_INSERT_TAIL(&msg->mhdr, mbuf2, next);
+    /* a clone made once the owner is sent is plaintext */
+    clone = msg_get(conn, true, conn->redis);
+    msg_clone(msg, first, clone);
+    off = 0;
+    STAILQ_FOREACH(mbuf, &clone->mhdr, next) {
+        memcpy(buf + off, mbuf->pos, mbuf_length(mbuf));
+        off += mbuf_length(mbuf);
+    }
+    msg_put(clone);
+    if (off != len || memcmp(buf, s1.data, s1.len) != 0 ||
+        memcmp(buf + s1.len, s2.data, s2.len) != 0) {
+        loga("clone of an encrypted request is not plaintext");
+        return DN_ERROR;
+    }
 
-    /*
-    loga("dumping the content of the original msg: ");
-    msg_dump(msg);
+    off = 0;
+    STAILQ_FOREACH(mbuf, &msg->mhdr, next) {
+        memcpy(buf + off, mbuf->pos, mbuf_length(mbuf));
+        off += mbuf_length(mbuf);
+    }
 
-    dyn_aes_encrypt_msg(msg, aes_key);
+    if (memcmp(buf, s1.data, s1.len) == 0) {
+        loga("payload not encrypted");
+        return DN_ERROR;
+    }
 
-    loga("dumping the content of encrypted msg");
-    msg_dump(msg);
+    for (off = 0; off < len; off += n) {
+        n = MIN(5, len - off);
+        dyn_aes_decrypt_stream(conn, buf + off, n, off, 7, DMSG_REQ);
+    }
 
-    dyn_aes_decrypt_msg(msg, aes_key);
+    if (memcmp(buf, s1.data, s1.len) != 0 ||
+        memcmp(buf + s1.len, s2.data, s2.len) != 0) {
+        loga("decrypted payload mismatch");
+        return DN_ERROR;
+    }
 
-    loga("dumping the content of decrytped msg");
-    msg_dump(msg);
-    */
+    msg_put(msg);
+    mbuf_put(owner);
+
+    /* a shared value past the default mbuf size is encrypted whole */
+    msg = msg_get(conn, true, conn->redis);
+    owner = mbuf_get_size(100000);
+    memset(owner->last, 'x', 100000);
+    owner->last += 100000;
+    mbuf_insert(&msg->mhdr, mbuf_ref(owner));
+    if (dyn_aes_encrypt_msg(msg, conn, 8, DMSG_REQ) != 100000 ||
+        msg_length(msg) != 100000 || owner->pos[0] != 'x') {
+        loga("shared 100000 byte payload not encrypted");
+        msg_put(msg);
+        mbuf_put(owner);
+        return DN_ERROR;
+    }
+    msg_put(msg);
+    mbuf_put(owner);
+
+    /* a response owns its buffers and is encrypted in place */
+    msg = msg_get(conn, false, conn->redis);
+    mbuf = mbuf_get();
+    mbuf_write_string(mbuf, &s2);
+    mbuf_insert(&msg->mhdr, mbuf);
+    if (dyn_aes_encrypt_msg(msg, conn, 9, DMSG_RES) != (rstatus_t)s2.len ||
+        STAILQ_FIRST(&msg->mhdr) != mbuf || !STAILQ_EMPTY(&msg->plain) ||
+        memcmp(mbuf->pos, s2.data, s2.len) == 0) {
+        loga("response not encrypted in place");
+        msg_put(msg);
+        return DN_ERROR;
+    }
+    msg_put(msg);
+
+    aes_msg_bench(conn);
 
     return DN_OK;
 }
 
-/*
+/* a cloned msg shares the source payload and outlives the source msg */
+static rstatus_t
+msg_clone_test(struct conn *conn)
+{
+    struct msg *src, *dst;
+    struct mbuf *mbuf;
+    struct string s1 = string("*2\r\n$3\r\nget\r\n$3\r\nfoo\r\n");
+    uint32_t nfree;
+
+    loga("=======================CLONE======================");
+
+    src = msg_get(conn, true, conn->redis);
+    dst = msg_get(conn, true, conn->redis);
+
+    mbuf = mbuf_get();
+    mbuf_write_string(mbuf, &s1);
+    mbuf_insert(&src->mhdr, mbuf);
+    src->mlen = mbuf_length(mbuf);
+
+    nfree = mbuf_free_queue_size();
+    msg_clone(src, mbuf, dst);
+
+    if (mbuf_free_queue_size() != nfree || msg_length(dst) != s1.len) {
+        loga("msg_clone copied the payload");
+        return DN_ERROR;
+    }
+
+    /* sending the source must not move the clone's read marker */
+    mbuf->pos = mbuf->last;
+    msg_put(src);
+    if (mbuf_free_queue_size() != nfree) {
+        loga("shared mbuf recycled while still referenced");
+        return DN_ERROR;
+    }
+
+    mbuf = STAILQ_FIRST(&dst->mhdr);
+    if (memcmp(mbuf->pos, s1.data, s1.len) != 0) {
+        loga("clone payload mismatch");
+        return DN_ERROR;
+    }
+
+    msg_put(dst);
+    if (mbuf_free_queue_size() != nfree + 1) {
+        loga("shared mbuf not recycled after last reference");
+        return DN_ERROR;
+    }
+
+    return DN_OK;
+}
+
+static uint32_t key_token_nhash;
 
 static rstatus_t
-aes_msg_test2(struct server *server)
+key_token_test_hash(const char *key, size_t keylen, struct dyn_token *token)
 {
-    unsigned char* aes_key = generate_aes_key();
-    struct conn *conn = conn_get_peer(server, false, true);
-    struct msg *msg = msg_get(conn, true, conn->redis);
+    key_token_nhash++;
+    size_dyn_token(token, 1);
+    set_int_dyn_token(token, (uint32_t)keylen);
 
-    struct mbuf *mbuf1 = mbuf_get();
-    mbuf_write_bytes(mbuf1, data, mbuf_size(mbuf1));
-    STAILQ_INSERT_HEAD(&msg->mhdr, mbuf1, next);
+    return DN_OK;
+}
 
-    struct mbuf *mbuf2 = mbuf_get();
-    mbuf_write_bytes(mbuf2, data + mbuf_size(mbuf2), strlen(data) - mbuf_size(mbuf2));
-    STAILQ_INSERT_TAIL(&msg->mhdr, mbuf2, next);
+/* a request and its clones hash their routing key once */
+static rstatus_t
+key_token_test(struct conn *conn)
+{
+    struct server_pool pool;
+    struct msg *src, *dst;
+    struct dyn_token *token;
+    uint8_t key[] = "foobar";
 
-    loga("dumping the content of the original msg: ");
-    msg_dump(msg);
+    loga("=======================KEY TOKEN======================");
 
-    dyn_aes_encrypt_msg(msg, aes_key);
+    memset(&pool, 0, sizeof(pool));
+    pool.key_hash = key_token_test_hash;
+    key_token_nhash = 0;
 
-    loga("dumping the content of msg after encrypting it: ");
-    msg_dump(msg);
+    src = msg_get(conn, true, conn->redis);
+    dst = msg_get(conn, true, conn->redis);
 
-    dyn_aes_decrypt_msg(msg, aes_key);
+    token = msg_key_token(&pool, src, key, 6);
+    if (token == NULL || token->mag[0] != 6) {
+        loga("key token not hashed");
+        return DN_ERROR;
+    }
 
-    loga("dumping the content after decrypting it: ");
-    msg_dump(msg);
+    msg_clone(src, STAILQ_FIRST(&src->mhdr), dst);
+    token = msg_key_token(&pool, dst, key, 6);
+    if (token == NULL || token->mag[0] != 6 ||
+        msg_key_token(&pool, src, key, 6) == NULL || key_token_nhash != 1) {
+        loga("key rehashed %"PRIu32" times", key_token_nhash);
+        return DN_ERROR;
+    }
+
+    msg_put(dst);
+    msg_put(src);
 
     return DN_OK;
 }
-*/
 
-static void
-init_test(int argc, char **argv)
+/* requests packed in a batched frame are parsed without a header of their own */
+static rstatus_t
+dmsg_batch_test(struct conn *conn)
 {
-    rstatus_t status;
-    struct instance nci;
+    struct msg *msg, *nmsg;
+    struct mbuf *mbuf, *nbuf;
+    struct string s1 = string("*2\r\n$3\r\nget\r\n$3\r\nfoo\r\n");
+    uint32_t i, nreq = 3;
 
-    test_set_default_options(&nci);
+    loga("=======================DNODE BATCH======================");
 
-    status = test_get_options(argc, argv, &nci);
-    if (status != DN_OK) {
-        dn_show_usage();
-        exit(1);
+    msg = msg_get(conn, true, conn->redis);
+    mbuf = mbuf_get();
+    dmsg_write_batch(mbuf, 42, DMSG_REQ, conn, nreq, nreq * s1.len);
+    for (i = 0; i < nreq; i++) {
+        mbuf_write_string(mbuf, &s1);
     }
+    mbuf_insert(&msg->mhdr, mbuf);
+    msg->pos = mbuf->pos;
+    msg->mlen = mbuf_length(mbuf);
 
-    test_pre_run(&nci);
+    for (i = 0; i < nreq; i++) {
+        msg->parser(msg);
+        if (msg->result != MSG_PARSE_OK || msg->dmsg == NULL ||
+            msg->dmsg->id != 42 + i || msg->dmsg->type != DMSG_REQ) {
+            loga("batched req %d not parsed", i);
+            return DN_ERROR;
+        }
 
-    test_mbuf_chunk_size = nci.mbuf_chunk_size;
-    position = 0;
-    mbuf_init(&nci);
-    msg_init();
-    conn_init();
+        if (msg->pos == mbuf->last) {
+            break;
+        }
 
-    crypto_init_for_test();
+        nbuf = mbuf_split(&msg->mhdr, msg->pos, NULL, NULL);
+        nmsg = msg_get(conn, true, conn->redis);
+        mbuf_insert(&nmsg->mhdr, nbuf);
+        nmsg->pos = nbuf->pos;
+        nmsg->mlen = mbuf_length(nbuf);
+        msg_put(msg);
+
+        msg = nmsg;
+        mbuf = nbuf;
+    }
+
+    msg_put(msg);
+    if (i != nreq - 1 || conn->dbatch_cnt != 0) {
+        loga("batched frame unpacked %d of %d reqs", i + 1, nreq);
+        return DN_ERROR;
+    }
+
+    return DN_OK;
 }
 
-int
-main(int argc, char **argv)
+/* a server's latency moves 1/SNITCH_EWMA_WEIGHT of the way to each sample */
+static rstatus_t
+snitch_test(struct server *server)
 {
-    //rstatus_t status;
-    init_test(argc, argv);
+    loga("=======================SNITCH======================");
 
-    struct server *server = malloc(sizeof(struct server));
-    init_server(server);
+    snitch_update(server, 1000, 2000);
+    if (server->latency != 1000 || server->latency_at != 2000) {
+        loga("first sample not taken as is");
+        return DN_ERROR;
+    }
 
-    struct conn *conn = conn_get_peer(server, false, true);
-    struct msg *msg = msg_get(conn, true, conn->redis);
+    snitch_update(server, 3000, 3000 + 1000 + 8 * SNITCH_EWMA_WEIGHT);
+    if (server->latency != 1008) {
+        loga("ewma at %"PRId64", expected 1008", server->latency);
+        return DN_ERROR;
+    }
 
-    //test payload larger than mbuf_size
-    rstatus_t ret = DN_OK;
-    ret = test_msg_recv_chain(conn, msg);
-    if (ret != DN_OK) {
-        loga("Error in testing msg_recv_chain!!!");
-        goto err_out;
+    /* responses that raced the clock are ignored */
+    snitch_update(server, 5000, 4000);
+    if (server->latency != 1008) {
+        loga("negative sample taken");
+        return DN_ERROR;
     }
-    ret = rsa_test();
-    if (ret != DN_OK) {
-        loga("Error in testing RSA !!!");
-        goto err_out;
+
+    return DN_OK;
+}
+
+/* mbufs come in size classes, and a large value asks for a class to fit its rest */
+static rstatus_t
+mbuf_class_test(struct conn *conn)
+{
+    struct string s1 = string("*3\r\n$3\r\nset\r\n$3\r\nfoo\r\n$100000\r\nbar");
+    struct msg *msg;
+    struct mbuf *mbuf, *nbuf;
+    uint32_t size;
+
+    loga("=======================MBUF CLASS======================");
+
+    mbuf = mbuf_get_size(100);
+    size = mbuf_size(mbuf);
+    mbuf_put(mbuf);
+    if (size < 100 || size >= 4096) {
+        loga("100 bytes got an mbuf of %"PRIu32" bytes", size);
+        return DN_ERROR;
     }
 
-    ret = aes_test();
-    if (ret != DN_OK) {
-        loga("Error in testing AES !!!");
-        goto err_out;
+    mbuf = mbuf_get_size(100000);
+    size = mbuf_size(mbuf);
+    mbuf_put(mbuf);
+    if (size < 100000 || size >= 1048576) {
+        loga("100000 bytes got an mbuf of %"PRIu32" bytes", size);
+        return DN_ERROR;
     }
 
-    ret = aes_msg_test(server);
-    if (ret != DN_OK) {
-        loga("Error in testing aes_msg_test !!!");
+    msg = msg_get(conn, true, true);
+    mbuf = mbuf_get();
+    mbuf_write_string(mbuf, &s1);
+    mbuf_insert(&msg->mhdr, mbuf);
+    msg->pos = mbuf->pos;
+    msg->mlen = mbuf_length(mbuf);
+
+    redis_parse_req(msg);
+    if (msg->result != MSG_PARSE_AGAIN || msg->vlen_rem != 100000 - 3 + CRLF_LEN) {
+        loga("value of 100000 bytes left %"PRIu32" to come", msg->vlen_rem);
+        msg_put(msg);
+        return DN_ERROR;
+    }
+
+    msg_put(msg);
+
+    /* a tail longer than a default mbuf is split off into one that holds it */
+    msg = msg_get(conn, true, true);
+    mbuf = mbuf_get_size(100000);
+    mbuf->last += 100000;
+    mbuf_insert(&msg->mhdr, mbuf);
+    nbuf = mbuf_split(&msg->mhdr, mbuf->pos + 10, NULL, NULL);
+    if (nbuf == NULL || mbuf_length(nbuf) != 100000 - 10 || mbuf_length(mbuf) != 10) {
+        loga("split of a 100000 byte mbuf kept %"PRIu32" bytes", mbuf_length(mbuf));
+        if (nbuf != NULL) {
+            mbuf_put(nbuf);
+        }
+        msg_put(msg);
+        return DN_ERROR;
+    }
+    mbuf_put(nbuf);
+    msg_put(msg);
+
+    return DN_OK;
+}
+
+/*
+ * Parse len bytes at buf as a redis or memcache msg, handing them to the
+ * parser whole or one byte more at a time
+ */
+static struct msg *
+parse_test_msg(struct conn *conn, bool request, bool redis, uint8_t *buf, uint32_t len,
+               bool bytewise)
+{
+    struct msg *msg;
+    struct mbuf *mbuf;
+    uint8_t *last;
+
+    msg = msg_get(conn, request, redis);
+    mbuf = mbuf_get();
+    mbuf_copy(mbuf, buf, len);
+    mbuf_insert(&msg->mhdr, mbuf);
+    msg->pos = mbuf->pos;
+    msg->mlen = len;
+
+    last = mbuf->last;
+    mbuf->last = bytewise ? mbuf->pos + 1 : last;
+    for (;;) {
+        if (redis) {
+            if (request) {
+                redis_parse_req(msg);
+            } else {
+                redis_parse_rsp(msg);
+            }
+        } else {
+            if (request) {
+                memcache_parse_req(msg);
+            } else {
+                memcache_parse_rsp(msg);
+            }
+        }
+        if (msg->result != MSG_PARSE_AGAIN || mbuf->last == last) {
+            break;
+        }
+        mbuf->last++;
+    }
+    mbuf->last = last;
+
+    return msg;
+}
+
+/* an mget split per owner gets its bulks back in key order */
+static rstatus_t
+mget_scatter_test(struct conn *conn)
+{
+    struct string req = string("*4\r\n$4\r\nmget\r\n$1\r\na\r\n$2\r\nbb\r\n$3\r\nccc\r\n");
+    struct string frag0 = string("*3\r\n$4\r\nmget\r\n$1\r\na\r\n$3\r\nccc\r\n");
+    struct string rsp0 = string("*2\r\n$1\r\nA\r\n$3\r\nCCC\r\n");
+    struct string rsp1 = string("*1\r\n$-1\r\n");
+    struct string out = string("*3\r\n$1\r\nA\r\n$-1\r\n$3\r\nCCC\r\n");
+    struct msg *msg, *frag[2], *rsp[2];
+    struct msg_tqh q;
+    struct mbuf *mbuf;
+    uint8_t buf[128];
+    uint32_t i, len, *fid;
+    rstatus_t status = DN_ERROR;
+
+    loga("=======================MGET SCATTER======================");
+
+    msg = parse_test_msg(conn, true, true, req.data, req.len, false);
+    if (msg->result != MSG_PARSE_OK || msg->keys == NULL || array_n(msg->keys) != 3) {
+        loga("mget keys not recorded");
+        msg_put(msg);
+        return DN_ERROR;
+    }
+
+    /* keys a and ccc go to one peer, bb to another */
+    msg->frag_map = array_create(3, sizeof(uint32_t));
+    for (i = 0; i < 3; i++) {
+        fid = array_push(msg->frag_map);
+        *fid = (i == 1) ? 1 : 0;
+    }
+
+    TAILQ_INIT(&q);
+    for (i = 0; i < 2; i++) {
+        frag[i] = msg_get(conn, true, true);
+        msg->fragment(msg, frag[i], i);
+        frag[i]->type = msg->type;
+        frag[i]->frag_id = 1;
+        frag[i]->frag_owner = frag[0];
+        frag[i]->first_fragment = (i == 0);
+        frag[i]->last_fragment = (i == 1);
+        TAILQ_INSERT_TAIL(&q, frag[i], c_tqe);
+    }
+    frag[0]->nfrag = 2;
+    frag[0]->frag_map = msg->frag_map;
+    msg->frag_map = NULL;
+
+    mbuf = STAILQ_FIRST(&frag[0]->mhdr);
+    if (mbuf_length(mbuf) != frag0.len || memcmp(mbuf->pos, frag0.data, frag0.len) != 0 ||
+        frag[0]->key_end - frag[0]->key_start != 1 || *frag[0]->key_start != 'a') {
+        loga("bad mget fragment");
+        goto done;
+    }
+
+    rsp[0] = parse_test_msg(conn, false, true, rsp0.data, rsp0.len, false);
+    rsp[1] = parse_test_msg(conn, false, true, rsp1.data, rsp1.len, false);
+    for (i = 0; i < 2; i++) {
+        frag[i]->peer = rsp[i];
+        rsp[i]->peer = frag[i];
+        frag[i]->done = 1;
+        redis_pre_coalesce(rsp[i]);
+    }
+    redis_post_coalesce(frag[0]);
+
+    len = 0;
+    for (i = 0; i < 2; i++) {
+        STAILQ_FOREACH(mbuf, &rsp[i]->mhdr, next) {
+            memcpy(buf + len, mbuf->pos, mbuf_length(mbuf));
+            len += mbuf_length(mbuf);
+        }
+    }
+
+    if (frag[0]->error || len != out.len || memcmp(buf, out.data, len) != 0 ||
+        rsp[0]->mlen != out.len || rsp[1]->mlen != 0) {
+        loga("mget replies not coalesced in key order: '%.*s'", len, buf);
+        goto done;
+    }
+
+    status = DN_OK;
+
+done:
+    for (i = 0; i < 2; i++) {
+        TAILQ_REMOVE(&q, frag[i], c_tqe);
+        req_put(frag[i]);
+    }
+    msg_put(msg);
+
+    return status;
+}
+
+/* the word-wide digit and CR scans agree with the byte-wise fsa */
+static rstatus_t
+redis_scan_test(struct conn *conn)
+{
+    struct string req = string("*3\r\n$3\r\nset\r\n$12\r\nkey:12345678\r\n$20\r\n01234567890123456789\r\n");
+    struct string err = string("-ERR a status line longer than sixteen bytes\r\n");
+    struct string mbulk = string("*3\r\n$11\r\nhello world\r\n:12345678\r\n$-1\r\n");
+    struct string bulk = string("$123456789\r\nab");
+    struct msg *msg;
+    uint32_t i;
+    bool bytewise;
+
+    loga("=======================REDIS SCAN======================");
+
+    for (i = 0; i < 2; i++) {
+        bytewise = (i == 1);
+
+        msg = parse_test_msg(conn, true, true, req.data, req.len, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_REDIS_SET ||
+            msg->narg != 3 || msg->key_end - msg->key_start != 12) {
+            loga("set parsed to result %d narg %"PRIu32" bytewise %d",
+                 msg->result, msg->narg, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, false, true, err.data, err.len, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_RSP_REDIS_ERROR ||
+            msg->pos != STAILQ_LAST(&msg->mhdr, mbuf, next)->last) {
+            loga("error reply parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, false, true, mbulk.data, mbulk.len, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_RSP_REDIS_MULTIBULK ||
+            msg->narg != 3) {
+            loga("multibulk reply parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, false, true, bulk.data, bulk.len, bytewise);
+        if (msg->result != MSG_PARSE_AGAIN || msg->vlen_rem != 123456789) {
+            loga("bulk of 123456789 bytes left %"PRIu32" to come bytewise %d",
+                 msg->vlen_rem, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+    }
+
+    return DN_OK;
+}
+
+/* write a memcache binary frame at p and return its length */
+static uint32_t
+binary_test_frame(uint8_t *p, uint8_t magic, uint8_t opcode, const char *key,
+                  uint8_t extlen, const char *value, uint32_t opaque)
+{
+    uint16_t keylen = (uint16_t)strlen(key), nkeylen;
+    uint32_t vlen = (uint32_t)strlen(value), bodylen;
+
+    memset(p, 0, MEMCACHE_BINARY_HEADER_LEN + extlen);
+    p[0] = magic;
+    p[1] = opcode;
+    nkeylen = htons(keylen);
+    dn_memcpy(p + 2, &nkeylen, 2);
+    p[4] = extlen;
+    bodylen = htonl(extlen + keylen + vlen);
+    dn_memcpy(p + 8, &bodylen, 4);
+    dn_memcpy(p + 12, &opaque, 4);
+    dn_memcpy(p + MEMCACHE_BINARY_HEADER_LEN + extlen, key, keylen);
+    dn_memcpy(p + MEMCACHE_BINARY_HEADER_LEN + extlen + keylen, value, vlen);
+
+    return MEMCACHE_BINARY_HEADER_LEN + (uint32_t)extlen + keylen + vlen;
+}
+
+/*
+ * A run of binary quiet gets is one request split per owner, closed by a
+ * noop or by a loud get that goes out last; a quiet set goes out loud and
+ * is answered only on error
+ */
+static rstatus_t
+memcache_binary_test(struct conn *conn)
+{
+    uint8_t req[512], rsp[256], frag0[256], getk[256], gfrag0[256], gfrag1[256];
+    uint32_t len, rlen, flen, set, glen, g0len, g1len, i, j, *fid;
+    struct msg *msg, *frag;
+    struct mbuf *mbuf;
+    bool bytewise;
+    rstatus_t status = DN_ERROR;
+
+    loga("=======================MEMCACHE BINARY======================");
+
+    len = binary_test_frame(req, 0x80, 0x0d, "k1", 0, "", 1);               /* getkq */
+    flen = 0;
+    dn_memcpy(frag0 + flen, req, len);
+    flen += len;
+    len += binary_test_frame(req + len, 0x80, 0x0d, "k22", 0, "", 2);       /* getkq */
+    i = binary_test_frame(req + len, 0x80, 0x09, "k333", 0, "", 3);         /* getq */
+    dn_memcpy(frag0 + flen, req + len, i);
+    flen += i;
+    len += i;
+    i = binary_test_frame(req + len, 0x80, 0x0a, "", 0, "", 4);             /* noop */
+    dn_memcpy(frag0 + flen, req + len, i);
+    flen += i;
+    len += i;
+    set = len;
+    len += binary_test_frame(req + len, 0x80, 0x11, "k4", 8, "value", 5);   /* setq */
+
+    rlen = binary_test_frame(rsp, 0x81, 0x0d, "k1", 4, "hit", 1);
+    rlen += binary_test_frame(rsp + rlen, 0x81, 0x0a, "", 0, "", 4);
+
+    /* getkq k1, getkq k22, getk k333: k1 and k333 go to one peer */
+    glen = binary_test_frame(getk, 0x80, 0x0d, "k1", 0, "", 6);
+    dn_memcpy(gfrag1, getk, glen);
+    g1len = glen;
+    g0len = binary_test_frame(gfrag0, 0x80, 0x0d, "k22", 0, "", 7);
+    dn_memcpy(getk + glen, gfrag0, g0len);
+    glen += g0len;
+    i = binary_test_frame(getk + glen, 0x80, 0x0c, "k333", 0, "", 8);
+    dn_memcpy(gfrag1 + g1len, getk + glen, i);
+    g1len += i;
+    glen += i;
+    g0len += binary_test_frame(gfrag0 + g0len, 0x80, 0x0a, "", 0, "", 8);
+
+    for (i = 0; i < 2; i++) {
+        bytewise = (i == 1);
+
+        msg = parse_test_msg(conn, true, false, req, len, bytewise);
+        if (msg->result != MSG_PARSE_OK || !msg->binary || msg->type != MSG_REQ_MC_GET ||
+            msg->keys == NULL || array_n(msg->keys) != 3 || msg->bin_opaque != 4 ||
+            msg->pos != STAILQ_FIRST(&msg->mhdr)->pos + set) {
+            loga("quiet gets parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+
+        /* keys k1 and k333 go to one peer */
+        msg->frag_map = array_create(3, sizeof(uint32_t));
+        for (j = 0; j < 3; j++) {
+            fid = array_push(msg->frag_map);
+            *fid = (j == 1) ? 1 : 0;
+        }
+
+        frag = msg_get(conn, true, false);
+        status = msg->fragment(msg, frag, 0);
+        mbuf = STAILQ_FIRST(&frag->mhdr);
+        if (status != DN_OK || frag->mlen != flen || memcmp(mbuf->pos, frag0, flen) != 0 ||
+            frag->key_end - frag->key_start != 2) {
+            loga("quiet gets fragment of %"PRIu32" bytes", frag->mlen);
+            msg_put(frag);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(frag);
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, true, false, req + set, len - set, bytewise);
+        mbuf = STAILQ_FIRST(&msg->mhdr);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_MC_SET ||
+            msg->bin_opcode != 0x11 || mbuf->pos[1] != 0x01 ||
+            msg->key_end - msg->key_start != 2 || msg->pos != mbuf->last) {
+            loga("quiet set parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+
+        frag = msg_get_error(msg, false, STORAGE_CONNECTION_REFUSE, ECONNREFUSED);
+        mbuf = STAILQ_FIRST(&frag->mhdr);
+        if (frag->mlen <= MEMCACHE_BINARY_HEADER_LEN || mbuf->pos[0] != 0x81 ||
+            mbuf->pos[1] != 0x11 || memcmp(mbuf->pos + 12, req + set + 12, 4) != 0) {
+            loga("binary error reply of %"PRIu32" bytes", frag->mlen);
+            msg_put(frag);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(frag);
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, false, false, rsp, rlen, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_RSP_MC_END ||
+            msg->end != STAILQ_FIRST(&msg->mhdr)->pos + rlen - MEMCACHE_BINARY_HEADER_LEN) {
+            loga("quiet gets reply parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, true, false, getk, glen, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_MC_GET ||
+            msg->keys == NULL || array_n(msg->keys) != 3 || msg->bin_opcode != 0x0c ||
+            msg->pos != STAILQ_FIRST(&msg->mhdr)->pos + glen) {
+            loga("quiet gets closed by a getk parsed to result %d bytewise %d",
+                 msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+
+        msg->frag_map = array_create(3, sizeof(uint32_t));
+        for (j = 0; j < 3; j++) {
+            fid = array_push(msg->frag_map);
+            *fid = (j == 1) ? 1 : 0;
+        }
+
+        /* the getk closes the last fragment, the other one gets a noop */
+        frag = msg_get(conn, true, false);
+        status = msg->fragment(msg, frag, 0);
+        mbuf = STAILQ_FIRST(&frag->mhdr);
+        if (status != DN_OK || frag->mlen != g0len || memcmp(mbuf->pos, gfrag0, g0len) != 0) {
+            loga("getk run fragment 0 of %"PRIu32" bytes", frag->mlen);
+            msg_put(frag);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(frag);
+
+        frag = msg_get(conn, true, false);
+        status = msg->fragment(msg, frag, 1);
+        mbuf = STAILQ_FIRST(&frag->mhdr);
+        if (status != DN_OK || frag->mlen != g1len || memcmp(mbuf->pos, gfrag1, g1len) != 0 ||
+            frag->bin_opcode != 0x0c || frag->bin_opaque != 8 ||
+            frag->key_end - frag->key_start != 2) {
+            loga("getk run fragment 1 of %"PRIu32" bytes", frag->mlen);
+            msg_put(frag);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(frag);
+        msg_put(msg);
+    }
+
+    return DN_OK;
+}
+
+/*
+ * Meta commands pass their flags through, but q is stripped and the reply
+ * it would have suppressed is dropped here instead
+ */
+static rstatus_t
+memcache_meta_test(struct conn *conn)
+{
+    uint8_t mg[] = "mg key v t q O123\r\n";
+    uint8_t ms[] = "ms key 5 T10 q\r\nhello\r\n";
+    uint8_t mn[] = "mn\r\n";
+    uint8_t va[] = "VA 5 t10\r\nhello\r\n";
+    uint8_t hd[] = "HD\r\n";
+    uint8_t msb[] = "ms Zm9v 5 b\r\nhello\r\n";
+    uint8_t mgb[] = "mg Zm9vYg== b v\r\n";
+    uint8_t mgbad[] = "mg Zm9v* b v\r\n";
+    struct msg *msg, *rsp;
+    uint8_t *pos;
+    uint32_t i;
+    bool bytewise;
+
+    loga("=======================MEMCACHE META========================");
+
+    for (i = 0; i < 2; i++) {
+        bytewise = (i == 1);
+
+        msg = parse_test_msg(conn, true, false, mg, sizeof(mg) - 1, bytewise);
+        pos = STAILQ_FIRST(&msg->mhdr)->pos;
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_MC_MG ||
+            !msg->is_read || !msg->quiet || msg->key_end - msg->key_start != 3 ||
+            memcmp(pos, "mg key v t   O123\r\n", sizeof(mg) - 1) != 0) {
+            loga("mg parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, true, false, ms, sizeof(ms) - 1, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_MC_MS ||
+            msg->is_read || !msg->quiet || msg->pos != STAILQ_FIRST(&msg->mhdr)->last) {
+            loga("ms parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+
+        rsp = parse_test_msg(conn, false, false, hd, sizeof(hd) - 1, bytewise);
+        rsp->peer = msg;
+        memcache_pre_coalesce(rsp);
+        if (rsp->result != MSG_PARSE_OK || rsp->type != MSG_RSP_MC_HD || rsp->mlen != 0) {
+            loga("quiet ms reply of %"PRIu32" bytes", rsp->mlen);
+            rsp->peer = NULL;
+            msg_put(rsp);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        rsp->peer = NULL;
+        msg_put(rsp);
+        msg_put(msg);
+
+        /* a b flag key is routed and invalidated by what it decodes to */
+        msg = parse_test_msg(conn, true, false, msb, sizeof(msb) - 1, bytewise);
+        rsp = msg_get(conn, true, false);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_MC_MS ||
+            msg->key_end - msg->key_start != 3 || memcmp(msg->key_start, "foo", 3) != 0 ||
+            memcmp(STAILQ_FIRST(&msg->mhdr)->pos, msb, sizeof(msb) - 1) != 0 ||
+            msg_clone(msg, STAILQ_FIRST(&msg->mhdr), rsp) != DN_OK ||
+            rsp->key_start == msg->key_start || memcmp(rsp->key_start, "foo", 3) != 0) {
+            loga("ms with b parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(rsp);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(rsp);
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, true, false, mgb, sizeof(mgb) - 1, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->key_end - msg->key_start != 4 ||
+            memcmp(msg->key_start, "foob", 4) != 0) {
+            loga("mg with b parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, true, false, mgbad, sizeof(mgbad) - 1, bytewise);
+        if (msg->result != MSG_PARSE_ERROR) {
+            loga("mg with a bad b key parsed to result %d", msg->result);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, true, false, mn, sizeof(mn) - 1, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_REQ_MC_MN) {
+            loga("mn parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+
+        msg = parse_test_msg(conn, false, false, va, sizeof(va) - 1, bytewise);
+        if (msg->result != MSG_PARSE_OK || msg->type != MSG_RSP_MC_VA ||
+            msg->pos != STAILQ_FIRST(&msg->mhdr)->last) {
+            loga("VA parsed to result %d bytewise %d", msg->result, bytewise);
+            msg_put(msg);
+            return DN_ERROR;
+        }
+        msg_put(msg);
+    }
+
+    return DN_OK;
+}
+
+/*
+ * The near cache keeps a reply for its TTL, never one read before a write to
+ * its key, and once full lets in only keys read more than those it evicts
+ */
+static rstatus_t
+near_cache_test(struct conn *conn)
+{
+    uint8_t value[] = "VALUE k 0 5\r\nhello\r\nEND\r\n";
+    uint8_t key[8];
+    struct ncache_entry *e;
+    struct msg *rsp;
+    uint64_t epoch;
+    uint32_t i, j;
+    rstatus_t status = DN_ERROR;
+
+    loga("=======================NEAR CACHE======================");
+
+    rsp = parse_test_msg(conn, false, false, value, sizeof(value) - 1, false);
+    if (rsp->result != MSG_PARSE_OK || rsp->type != MSG_RSP_MC_VALUE) {
+        loga("cached reply parsed to result %d", rsp->result);
+        msg_put(rsp);
+        return DN_ERROR;
+    }
+
+    ncache_set_budget(1024, 100);
+
+    if (ncache_get((uint8_t *)"k1", 2, 1000) != NULL) {
+        loga("near cache hit on an empty cache");
+        goto done;
+    }
+    epoch = ncache_epoch();
+    if (!ncache_put((uint8_t *)"k1", 2, rsp, epoch, 1000)) {
+        loga("near cache did not keep a reply with room to spare");
+        goto done;
+    }
+
+    e = ncache_get((uint8_t *)"k1", 2, 1099);
+    if (e == NULL || e->vlen != sizeof(value) - 1 || e->type != MSG_RSP_MC_VALUE ||
+        memcmp(ncache_value(e), value, e->vlen) != 0) {
+        loga("near cache lost a live reply");
+        goto done;
+    }
+    if (ncache_get((uint8_t *)"k1", 2, 1100) != NULL) {
+        loga("near cache kept a reply past its ttl");
+        goto done;
+    }
+
+    /* a write while the read is out keeps its reply out of the cache */
+    epoch = ncache_epoch();
+    ncache_invalidate((uint8_t *)"k1", 2);
+    if (ncache_put((uint8_t *)"k1", 2, rsp, epoch, 1000)) {
+        loga("near cache kept a reply read before a write");
+        goto done;
+    }
+    epoch = ncache_epoch();
+    if (!ncache_put((uint8_t *)"k1", 2, rsp, epoch, 1000)) {
+        loga("near cache did not keep a reply read after a write");
+        goto done;
+    }
+    ncache_invalidate((uint8_t *)"k1", 2);
+    if (ncache_get((uint8_t *)"k1", 2, 1000) != NULL || ncache_used() != 0) {
+        loga("near cache kept a written key");
+        goto done;
+    }
+
+    /* fill it with keys read 3 times each */
+    for (i = 0; i < 64; i++) {
+        dn_snprintf(key, sizeof(key), "h%02"PRIu32, i);
+        for (j = 0; j < 3; j++) {
+            IGNORE_RET_VAL(ncache_get(key, 3, 1000));
+        }
+        IGNORE_RET_VAL(ncache_put(key, 3, rsp, ncache_epoch(), 1000));
+        if (ncache_used() > 1024) {
+            loga("near cache of %zu bytes went over its budget", ncache_used());
+            goto done;
+        }
+    }
+
+    IGNORE_RET_VAL(ncache_get((uint8_t *)"c1", 2, 1000));
+    if (ncache_put((uint8_t *)"c1", 2, rsp, ncache_epoch(), 1000)) {
+        loga("near cache let in a key read once");
+        goto done;
+    }
+
+    for (j = 0; j < 5; j++) {
+        IGNORE_RET_VAL(ncache_get((uint8_t *)"w1", 2, 1000));
+    }
+    if (!ncache_put((uint8_t *)"w1", 2, rsp, ncache_epoch(), 1000) ||
+        ncache_get((uint8_t *)"w1", 2, 1000) == NULL) {
+        loga("near cache turned away a key read more than the rest");
+        goto done;
+    }
+
+    status = DN_OK;
+
+done:
+    ncache_set_budget(0, 0);
+    msg_put(rsp);
+    return status;
+}
+
+/* a shrink frees at most its batch, and only the free msgs past the cap */
+static rstatus_t
+pool_shrink_test(struct conn *conn)
+{
+    struct msg *msg[8];
+    uint32_t i, nfree, nalloc;
+
+    loga("=======================POOL SHRINK======================");
+
+    for (i = 0; i < 8; i++) {
+        msg[i] = msg_get(conn, true, conn->redis);
+    }
+    for (i = 0; i < 8; i++) {
+        msg_put(msg[i]);
+    }
+
+    nfree = msg_free_queue_size();
+    nalloc = msg_alloc_msgs();
+    msg_set_pool_max(nfree - 5);
+
+    if (msg_shrink(2) != 2 || msg_free_queue_size() != nfree - 2) {
+        loga("shrink freed more than its batch");
+        return DN_ERROR;
+    }
+
+    if (msg_shrink(100) != 3 || msg_shrink(100) != 0 ||
+        msg_free_queue_size() != nfree - 5 || msg_alloc_msgs() != nalloc - 5) {
+        loga("shrink did not stop at the cap");
+        return DN_ERROR;
+    }
+
+    msg_set_pool_max(CONF_DEFAULT_MSG_POOL_MAX);
+
+    return DN_OK;
+}
+
+/*
+ * A peer turns requests away from the high watermark until it drains to the
+ * low one, and while its replies are slower than the timeout.
+ */
+static rstatus_t
+admission_test(struct conn *conn)
+{
+    struct server *server = conn->owner;
+    struct server_pool *owner = server->owner;
+    struct server_pool pool;
+    uint32_t i;
+
+    loga("=======================ADMISSION======================");
+
+    memset(&pool, 0, sizeof(pool));
+    TAILQ_INIT(&pool.c_conn_q);
+    pool.queue_high_watermark = 4;
+    pool.queue_low_watermark = 2;
+    server->owner = &pool;
+
+    for (i = 0; i < 4; i++) {
+        server_outstanding_incr(conn);
+    }
+    if (!server->overloaded || server_admit(server, 0)) {
+        loga("server admits requests past the high watermark");
+        return DN_ERROR;
+    }
+
+    server_outstanding_decr(conn);
+    if (server_admit(server, 0)) {
+        loga("server recovered above the low watermark");
+        return DN_ERROR;
+    }
+
+    server_outstanding_decr(conn);
+    if (server->overloaded || !server_admit(server, 0)) {
+        loga("server did not recover at the low watermark");
+        return DN_ERROR;
+    }
+
+    server->latency = 5000;
+    if (server_admit(server, 1)) {
+        loga("server admits requests slower than the timeout");
+        return DN_ERROR;
+    }
+
+    server_outstanding_decr(conn);
+    server_outstanding_decr(conn);
+    if (!server_admit(server, 1)) {
+        loga("idle server turns requests away");
+        return DN_ERROR;
+    }
+
+    server->latency = 0;
+    server->owner = owner;
+
+    return DN_OK;
+}
+
+#define RING_QUEUE_TEST_N   100000
+
+static void *
+ring_queue_test_producer(void *arg)
+{
+    struct ring_queue *q = arg;
+    uintptr_t i;
+
+    for (i = 1; i <= RING_QUEUE_TEST_N; ) {
+        if (ring_queue_push(q, (void *)i)) {
+            i++;
+        }
+    }
+
+    return NULL;
+}
+
+/* a full ring turns pushes away, and entries cross threads in order */
+static rstatus_t
+ring_queue_test(void)
+{
+    static struct ring_queue q;
+    pthread_t tid;
+    uintptr_t i, expect;
+    void *elem;
+
+    loga("=======================RING QUEUE======================");
+
+    ring_queue_init(&q);
+    for (i = 1; i <= RING_QUEUE_SIZE; i++) {
+        if (!ring_queue_push(&q, (void *)i)) {
+            loga("ring full at %"PRIuPTR" entries", i - 1);
+            return DN_ERROR;
+        }
+    }
+    if (ring_queue_push(&q, (void *)i) || ring_queue_len(&q) != RING_QUEUE_SIZE) {
+        loga("push past the ring size taken");
+        return DN_ERROR;
+    }
+    for (i = 1; (elem = ring_queue_pop(&q)) != NULL; i++) {
+        if ((uintptr_t)elem != i) {
+            loga("popped %"PRIuPTR", expected %"PRIuPTR"", (uintptr_t)elem, i);
+            return DN_ERROR;
+        }
+    }
+
+    if (pthread_create(&tid, NULL, ring_queue_test_producer, &q) != 0) {
+        return DN_ERROR;
+    }
+
+    for (expect = 1; expect <= RING_QUEUE_TEST_N; ) {
+        elem = ring_queue_pop(&q);
+        if (elem == NULL) {
+            continue;
+        }
+        if ((uintptr_t)elem != expect) {
+            loga("popped %"PRIuPTR" across threads, expected %"PRIuPTR"",
+                 (uintptr_t)elem, expect);
+            pthread_join(tid, NULL);
+            return DN_ERROR;
+        }
+        expect++;
+    }
+
+    pthread_join(tid, NULL);
+
+    return DN_OK;
+}
+
+static int event_wakeup_test_ncb;
+
+static int
+event_wakeup_test_cb(void *arg, uint32_t events)
+{
+    event_wakeup_test_ncb++;
+    return 0;
+}
+
+static void *
+event_wakeup_test_thread(void *arg)
+{
+    usleep(10000);
+    event_wakeup(arg);
+    return NULL;
+}
+
+/* a wakeup from another thread ends event_wait long before its timeout */
+static rstatus_t
+event_wakeup_test(void)
+{
+    struct event_base *evb;
+    pthread_t tid;
+    int64_t start;
+    rstatus_t ret = DN_OK;
+
+    loga("=======================EVENT WAKEUP======================");
+
+    evb = event_base_create(EVENT_SIZE, event_wakeup_test_cb);
+    if (evb == NULL) {
+        return DN_ERROR;
+    }
+
+    start = dn_msec_now();
+    if (pthread_create(&tid, NULL, event_wakeup_test_thread, evb) != 0) {
+        event_base_destroy(evb);
+        return DN_ERROR;
+    }
+    event_wait(evb, 5000);
+    pthread_join(tid, NULL);
+
+    /* a wakeup posted before the wait is not lost */
+    event_wakeup(evb);
+    event_wait(evb, 5000);
+
+    if (dn_msec_now() - start >= 5000 || event_wakeup_test_ncb != 0) {
+        loga("event_wait not woken up");
+        ret = DN_ERROR;
+    }
+
+    event_base_destroy(evb);
+
+    return ret;
+}
+
+/* a bucket refills by the usec up to its burst, and overdrafts are paid back */
+static rstatus_t
+token_bucket_test(void)
+{
+    struct token_bucket tb;
+
+    loga("=======================TOKEN BUCKET======================");
+
+    token_bucket_init(&tb);
+    if (token_bucket_wait(&tb, 0, 1000) != 0) {
+        loga("unlimited bucket ran out");
+        return DN_ERROR;
+    }
+
+    /* 1000 per sec holds 10 tokens; 15 taken leave a debt of 5 msec */
+    if (token_bucket_wait(&tb, 1000, 1000) != 0) {
+        loga("new bucket is not full");
+        return DN_ERROR;
+    }
+    token_bucket_take(&tb, 1000, 15);
+    if (token_bucket_wait(&tb, 1000, 1000) != 5001) {
+        loga("overdrawn bucket did not wait out its debt");
+        return DN_ERROR;
+    }
+    if (token_bucket_wait(&tb, 1000, 1000 + 5001) != 0) {
+        loga("bucket not refilled after its wait");
+        return DN_ERROR;
+    }
+
+    token_bucket_wait(&tb, 1000, 1000000000LL);
+    if (tb.credit != 10 * TB_UNIT) {
+        loga("idle bucket filled past its burst");
+        return DN_ERROR;
+    }
+
+    return DN_OK;
+}
+
+/* recycled chunks go out first, and slabs past the idle limit are unmapped */
+static rstatus_t
+mbuf_slab_test(void)
+{
+    struct mhdr mhdr;
+    struct mbuf *mbuf, *last;
+    uint32_t nslab, max_idle;
+
+    loga("=======================MBUF SLAB======================");
+
+    STAILQ_INIT(&mhdr);
+    nslab = mbuf_slab_count();
+    max_idle = (MBUF_MAX_IDLE << 20) / MBUF_SLAB_SIZE;
+
+    while (mbuf_slab_count() < nslab + max_idle + 2) {
+        mbuf = mbuf_get();
+        if (mbuf == NULL) {
+            loga("failed to map mbuf slab");
+            return DN_ERROR;
+        }
+        mbuf_insert(&mhdr, mbuf);
+    }
+
+    last = STAILQ_LAST(&mhdr, mbuf, next);
+    mbuf_remove(&mhdr, last);
+    mbuf_put(last);
+    mbuf = mbuf_get();
+    mbuf_insert(&mhdr, mbuf);
+    if (mbuf != last) {
+        loga("put mbuf not handed out first");
+        return DN_ERROR;
+    }
+
+    while (!STAILQ_EMPTY(&mhdr)) {
+        mbuf = STAILQ_FIRST(&mhdr);
+        mbuf_remove(&mhdr, mbuf);
+        mbuf_put(mbuf);
+    }
+
+    if (mbuf_slab_count() > nslab + max_idle) {
+        loga("%"PRIu32" mbuf slabs still mapped", mbuf_slab_count());
+        return DN_ERROR;
+    }
+
+    return DN_OK;
+}
+
+static struct msg *
+test_rspmgr_reply(struct msg *req, struct string *s)
+{
+    struct msg *rsp = msg_get(req->owner, false, req->redis);
+    struct mbuf *mbuf = mbuf_get();
+
+    mbuf_write_string(mbuf, s);
+    mbuf_insert(&rsp->mhdr, mbuf);
+    rsp->mlen = mbuf_length(mbuf);
+
+    req->done = 1;
+    req->peer = rsp;
+    rsp->peer = req;
+
+    return rsp;
+}
+
+/*
+ * DC_SAFE_QUORUM waits out a disagreeing replica for a quorum of equal
+ * replies; DC_QUORUM fails as soon as a quorum can't answer.
+ */
+static rstatus_t
+rspmgr_test(struct conn *conn)
+{
+    struct response_mgr *mgr;
+    struct msg *msg, *replica[3];
+    struct string s1 = string("$3\r\nbar\r\n");
+    struct string s2 = string("$-1\r\n");
+    uint32_t i;
+
+    loga("=======================RESPONSE MGR======================");
+
+    msg = msg_get(conn, true, conn->redis);
+    mgr = rspmgr_get(msg, DC_SAFE_QUORUM);
+    for (i = 0; i < 3; i++) {
+        replica[i] = msg_get(conn, true, conn->redis);
+        rspmgr_add_replica(mgr, replica[i]);
+    }
+
+    test_rspmgr_reply(replica[0], &s1);
+    rspmgr_submit(NULL, replica[0]);
+    test_rspmgr_reply(replica[1], &s2);
+    rspmgr_submit(NULL, replica[1]);
+    if (msg->done) {
+        loga("safe quorum decided on disagreeing replies");
+        return DN_ERROR;
+    }
+
+    test_rspmgr_reply(replica[2], &s1);
+    rspmgr_submit(NULL, replica[2]);
+    if (!msg->done || msg->error || msg->peer == NULL ||
+        memcmp(STAILQ_FIRST(&msg->peer->mhdr)->pos, s1.data, s1.len) != 0) {
+        loga("safe quorum did not pick the agreed reply");
+        return DN_ERROR;
+    }
+    req_put(msg);
+
+    msg = msg_get(conn, true, conn->redis);
+    mgr = rspmgr_get(msg, DC_QUORUM);
+    for (i = 0; i < 3; i++) {
+        replica[i] = msg_get(conn, true, conn->redis);
+        rspmgr_add_replica(mgr, replica[i]);
+    }
+
+    for (i = 0; i < 2; i++) {
+        replica[i]->done = 1;
+        replica[i]->error = 1;
+        rspmgr_submit(NULL, replica[i]);
+    }
+    if (!msg->done || !msg->error || msg->dyn_error != QUORUM_NOT_REACHED ||
+        replica[2]->rspmgr != NULL || !replica[2]->swallow) {
+        loga("quorum failure not reported");
+        return DN_ERROR;
+    }
+
+    req_put(replica[2]);
+    req_put(msg);
+
+    /* a hedged read is answered by whichever replica is first */
+    msg = msg_get(conn, true, conn->redis);
+    mgr = rspmgr_get(msg, DC_ONE);
+    replica[0] = msg_get(conn, true, conn->redis);
+    rspmgr_add_replica(mgr, replica[0]);
+    rspmgr_hedge_insert(mgr, NULL, NULL, 0, 5);
+
+    if (rspmgr_hedge_expire(dn_msec_now()) != NULL ||
+        rspmgr_hedge_expire(dn_msec_now() + 10) != mgr) {
+        loga("hedge not due after its delay");
+        return DN_ERROR;
+    }
+
+    replica[1] = msg_get(conn, true, conn->redis);
+    rspmgr_add_replica(mgr, replica[1]);
+    test_rspmgr_reply(replica[1], &s2);
+    rspmgr_submit(NULL, replica[1]);
+    if (!msg->done || msg->peer == NULL || !replica[0]->swallow) {
+        loga("hedged read not answered by the hedge");
+        return DN_ERROR;
+    }
+
+    req_put(replica[0]);
+    req_put(msg);
+
+    return DN_OK;
+}
+
+/* copy len bytes to the tail of the msg */
+static void
+test_msg_append(struct msg *msg, uint8_t *pos, size_t len)
+{
+    struct mbuf *mbuf;
+    size_t n;
+
+    while (len > 0) {
+        mbuf = STAILQ_LAST(&msg->mhdr, mbuf, next);
+        if (mbuf == NULL || mbuf_full(mbuf)) {
+            mbuf = mbuf_get();
+            mbuf_insert(&msg->mhdr, mbuf);
+        }
+
+        n = MIN(len, mbuf_size(mbuf));
+        mbuf_copy(mbuf, pos, n);
+        msg->mlen += (uint32_t)n;
+        pos += n;
+        len -= n;
+    }
+}
+
+/*
+ * Deflate a large cross-DC request, then receive it in mbuf sized pieces
+ * behind a compressed dnode header and with another request right after it.
+ */
+static rstatus_t
+dmsg_compress_test(struct conn *conn)
+{
+    struct msg *msg, *rmsg;
+    struct mbuf *mbuf;
+    struct string head = string("*3\r\n$3\r\nset\r\n$3\r\nfoo\r\n$8000\r\n");
+    struct string tail = string("*1\r\n$4\r\nping\r\n");
+    uint8_t value[8002], *wire, *p;
+    uint32_t i, len, clen, wlen, left;
+    ssize_t n;
+    bool payload;
+    rstatus_t status = DN_ERROR;
+
+    loga("=======================DNODE COMPRESS======================");
+
+    for (i = 0; i < 8000; i++) {
+        value[i] = (uint8_t)"{\"user\":42,\"name\":\"dynomite\"},"[i % 30];
+    }
+    value[8000] = CR;
+    value[8001] = LF;
+
+    set_dnode_compress_threshold(64);
+    conn->dnode_compress = 1;
+
+    msg = msg_get(conn, true, conn->redis);
+    test_msg_append(msg, head.data, head.len);
+    test_msg_append(msg, value, sizeof(value));
+    len = msg_length(msg);
+
+    if (dyn_compress_msg(conn, msg) != DN_OK) {
+        loga("payload of %d bytes not compressed", len);
+        msg_put(msg);
+        goto out;
+    }
+    clen = msg_length(msg);
+    loga("deflated %d bytes to %d", len, clen);
+
+    //header, compressed payload and the next request as they come off the wire
+    mbuf = mbuf_get();
+    dmsg_write(mbuf, 7, DMSG_REQ_FORWARD, conn, clen, DMSG_BIT_COMPRESSED);
+    mbuf_insert_head(&msg->mhdr, mbuf);
+    wlen = msg_length(msg) + tail.len;
+    wire = dn_alloc(wlen);
+    for (p = wire, mbuf = STAILQ_FIRST(&msg->mhdr); mbuf != NULL;
+         mbuf = STAILQ_NEXT(mbuf, next)) {
+        dn_memcpy(p, mbuf->pos, mbuf_length(mbuf));
+        p += mbuf_length(mbuf);
+    }
+    dn_memcpy(p, tail.data, tail.len);
+    msg_put(msg);
+
+    rmsg = msg_get(conn, true, conn->redis);
+    for (p = wire; ; ) {
+        mbuf = STAILQ_LAST(&rmsg->mhdr, mbuf, next);
+        if (mbuf == NULL || mbuf_full(mbuf)) {
+            mbuf = mbuf_get();
+            mbuf_insert(&rmsg->mhdr, mbuf);
+            rmsg->pos = mbuf->pos;
+        }
+
+        payload = rmsg->dyn_state == DYN_POST_DONE &&
+                  (rmsg->dmsg->bit_field & DMSG_BIT_COMPRESSED) &&
+                  rmsg->dmsg->pdone < rmsg->dmsg->plen;
+
+        if (!STAILQ_EMPTY(&conn->inflate_q)) {
+            n = dyn_inflate_q_recv(conn, mbuf->last, mbuf_size(mbuf));
+        } else {
+            n = (ssize_t)MIN(mbuf_size(mbuf), (size_t)(wire + wlen - p));
+            dn_memcpy(mbuf->last, p, (size_t)n);
+            p += n;
+        }
+
+        if (n == 0) {
+            loga("compressed req not parsed");
+            break;
+        }
+
+        if (payload) {
+            dmsg_payload_recv(rmsg, mbuf->last, (uint32_t)n);
+        }
+        mbuf->last += n;
+        rmsg->mlen += (uint32_t)n;
+
+        rmsg->parser(rmsg);
+        if (rmsg->result != MSG_PARSE_AGAIN) {
+            break;
+        }
+    }
+
+    if (rmsg->result == MSG_PARSE_OK && rmsg->type == MSG_REQ_REDIS_SET) {
+        //what follows the set is the next request
+        left = (uint32_t)(mbuf->last - rmsg->pos);
+        len += left;
+        left += (uint32_t)(wire + wlen - p);
+        STAILQ_FOREACH(mbuf, &conn->inflate_q, next) {
+            left += mbuf_length(mbuf);
+        }
+
+        clen = 0;
+        STAILQ_FOREACH(mbuf, &rmsg->mhdr, next) {
+            clen += mbuf_length(mbuf);
+        }
+
+        if (clen == len && left == tail.len) {
+            status = DN_OK;
+        } else {
+            loga("inflated req has %d bytes, %d left over", clen, left);
+        }
+    }
+
+    msg_put(rmsg);
+    dn_free(wire);
+    dyn_compress_conn_deinit(conn);
+
+out:
+    set_dnode_compress_threshold(0);
+    conn->dnode_compress = 0;
+    return status;
+}
+
+/* nodes come off the timing wheel no earlier and no later than due */
+static rstatus_t
+twheel_test(void)
+{
+    struct twheel wheel;
+    struct twnode nodes[200], *node;
+    int64_t base = 1000, now, next, min;
+    uint32_t i, nnode = 200, nfired = 0, nlive = 0;
+
+    loga("=======================TIMING WHEEL======================");
+
+    twheel_init(&wheel, base);
+    for (i = 0; i < nnode; i++) {
+        twnode_init(&nodes[i]);
+        nodes[i].key = base + (i < 10 ? (int64_t)i * 255 : random() % 100000);
+        nodes[i].data = &nodes[i];
+        twheel_insert(&wheel, &nodes[i]);
+    }
+
+    //way past the last level
+    nodes[nnode - 1].key = base + (1LL << 34);
+    twheel_delete(&wheel, &nodes[nnode - 1]);
+    twheel_insert(&wheel, &nodes[nnode - 1]);
+
+    for (i = 0; i < nnode; i += 5) {
+        twheel_delete(&wheel, &nodes[i]);
+    }
+
+    for (now = base; now <= base + 100000; now += 7) {
+        min = -1;
+        for (i = 0; i < nnode; i++) {
+            if (nodes[i].head != NULL && (min < 0 || nodes[i].key < min)) {
+                min = nodes[i].key;
+            }
+        }
+
+        next = twheel_next(&wheel);
+        if (next > min) {
+            loga("wheel says next expiry at %lld, a node expires at %lld", next, min);
+            return DN_ERROR;
+        }
+
+        while ((node = twheel_expire(&wheel, now)) != NULL) {
+            if (node->key > now || node->key <= now - 7 || node->head != NULL) {
+                loga("node due at %lld expired at %lld", node->key, now);
+                return DN_ERROR;
+            }
+            nfired++;
+        }
+    }
+
+    for (i = 0; i < nnode; i++) {
+        if (nodes[i].head != NULL) {
+            nlive++;
+        }
+    }
+
+    if (nfired != nnode - nnode / 5 - 1 || nlive != 1 || wheel.count != 1) {
+        loga("%d nodes expired, %d left", nfired, nlive);
+        return DN_ERROR;
+    }
+
+    return DN_OK;
+}
+
+static int
+vnode_test_token_cmp(const void *t1, const void *t2)
+{
+    const struct dyn_token *a = t1, *b = t2;
+
+    return cmp_dyn_token((struct dyn_token *)a, (struct dyn_token *)b);
+}
+
+/* eytzinger fast path must map every token like the generic search */
+static rstatus_t
+vnode_dispatch_test(void)
+{
+    struct dyn_token tokens[97], token, wide;
+    struct continuum continuum[97];
+    struct rack rack;
+    uint32_t i, ntoken = 97;
+
+    loga("=======================VNODE======================");
+
+    init_dyn_token(&token);
+    size_dyn_token(&token, 1);
+
+    for (i = 0; i < ntoken; i++) {
+        init_dyn_token(&tokens[i]);
+        size_dyn_token(&tokens[i], 1);
+        set_int_dyn_token(&tokens[i], (uint32_t)random() | 1);
+    }
+    qsort(tokens, ntoken, sizeof(tokens[0]), vnode_test_token_cmp);
+
+    rack_init(&rack);
+    dn_free(rack.continuum);
+    rack.continuum = continuum;
+    rack.ncontinuum = ntoken;
+    for (i = 0; i < ntoken; i++) {
+        continuum[i].index = i;
+        continuum[i].value = 0;
+        continuum[i].token = &tokens[i];
+    }
+
+    vnode_rack_verify_continuum(&rack, NULL);
+    if (rack.fast_token == NULL) {
+        loga("vnode fast path was not built");
+        return DN_ERROR;
+    }
+
+    for (i = 0; i < 100000; i++) {
+        uint32_t val;
+
+        switch (i % 4) {
+        case 0:
+            val = tokens[(i / 4) % ntoken].mag[0];
+            break;
+        case 1:
+            val = tokens[(i / 4) % ntoken].mag[0] + 1;
+            break;
+        case 2:
+            val = (i / 4) % 2 ? 0 : UINT32_MAX;
+            break;
+        default:
+            val = (uint32_t)random();
+            break;
+        }
+        set_int_dyn_token(&token, val);
+
+        if (vnode_rack_dispatch(&rack, &token) !=
+            vnode_dispatch(continuum, ntoken, &token)) {
+            loga("vnode dispatch mismatch for token %"PRIu32, val);
+            return DN_ERROR;
+        }
+    }
+
+    /* a wide token joining the rack turns the fast path off */
+    init_dyn_token(&wide);
+    size_dyn_token(&wide, 2);
+    wide.mag[1] = 1;
+    wide.signum = 1;
+    continuum[ntoken - 1].token = &wide;
+    vnode_rack_verify_continuum(&rack, NULL);
+    if (rack.fast_token != NULL || rack.fast_index != NULL) {
+        loga("vnode fast path kept with a wide token");
+        return DN_ERROR;
+    }
+
+    /* and comes back once the rack is all narrow again */
+    for (i = 0; i < ntoken; i++) {
+        continuum[i].index = i;
+        continuum[i].token = &tokens[i];
+    }
+    vnode_rack_verify_continuum(&rack, NULL);
+    if (rack.fast_token == NULL || rack.fast_index == NULL ||
+        vnode_rack_dispatch(&rack, &tokens[1]) != vnode_dispatch(continuum, ntoken, &tokens[1])) {
+        loga("vnode fast path not rebuilt for a narrow rack");
+        return DN_ERROR;
+    }
+
+    dn_free(rack.fast_token);
+    dn_free(rack.fast_index);
+
+    return DN_OK;
+}
+
+/*
+
+static rstatus_t
+aes_msg_test2(struct server *server)
+{
+    unsigned char* aes_key = generate_aes_key();
+    struct conn *conn = conn_get_peer(server, false, true);
+    struct msg *msg = msg_get(conn, true, conn->redis);
+
+    struct mbuf *mbuf1 = mbuf_get();
+    mbuf_write_bytes(mbuf1, data, mbuf_size(mbuf1));
+    STAILQ_INSERT_HEAD(&msg->mhdr, mbuf1, next);
+
+    struct mbuf *mbuf2 = mbuf_get();
+    mbuf_write_bytes(mbuf2, data + mbuf_size(mbuf2), strlen(data) - mbuf_size(mbuf2));
+    STAILQ_INSERT_TAIL(&msg->mhdr, mbuf2, next);
+
+    loga("dumping the content of the original msg: ");
+    msg_dump(msg);
+
+    dyn_aes_encrypt_msg(msg, aes_key);
+
+    loga("dumping the content of msg after encrypting it: ");
+    msg_dump(msg);
+
+    dyn_aes_decrypt_msg(msg, aes_key);
+
+    loga("dumping the content after decrypting it: ");
+    msg_dump(msg);
+
+    return DN_OK;
+}
+*/
+
+static void
+init_test(int argc, char **argv)
+{
+    rstatus_t status;
+    struct instance nci;
+
+    test_set_default_options(&nci);
+
+    status = test_get_options(argc, argv, &nci);
+    if (status != DN_OK) {
+        dn_show_usage();
+        exit(1);
+    }
+
+    test_pre_run(&nci);
+
+    test_mbuf_chunk_size = nci.mbuf_chunk_size;
+    position = 0;
+    mbuf_init(&nci);
+    msg_init();
+    conn_init();
+
+    crypto_init_for_test();
+}
+
+int
+main(int argc, char **argv)
+{
+    //rstatus_t status;
+    init_test(argc, argv);
+
+    struct server *server = malloc(sizeof(struct server));
+    init_server(server);
+
+    struct conn *conn = conn_get_peer(server, false, true);
+    struct msg *msg = msg_get(conn, true, conn->redis);
+
+    //test payload larger than mbuf_size
+    rstatus_t ret = DN_OK;
+    ret = test_msg_recv_chain(conn, msg);
+    if (ret != DN_OK) {
+        loga("Error in testing msg_recv_chain!!!");
+        goto err_out;
+    }
+    ret = rsa_test();
+    if (ret != DN_OK) {
+        loga("Error in testing RSA !!!");
+        goto err_out;
+    }
+
+    ret = aes_test();
+    if (ret != DN_OK) {
+        loga("Error in testing AES !!!");
+        goto err_out;
+    }
+
+    ret = aes_msg_test(server);
+    if (ret != DN_OK) {
+        loga("Error in testing aes_msg_test !!!");
+        goto err_out;
+    }
+
+    ret = msg_clone_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing msg_clone !!!");
+        goto err_out;
+    }
+
+    ret = key_token_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing key token !!!");
+        goto err_out;
+    }
+
+    ret = dmsg_batch_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing dnode batch !!!");
+        goto err_out;
+    }
+
+    ret = dmsg_compress_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing dnode compression !!!");
+        goto err_out;
+    }
+
+    ret = snitch_test(server);
+    if (ret != DN_OK) {
+        loga("Error in testing snitch !!!");
+        goto err_out;
+    }
+
+    ret = ring_queue_test();
+    if (ret != DN_OK) {
+        loga("Error in testing ring queue !!!");
+        goto err_out;
+    }
+
+    ret = event_wakeup_test();
+    if (ret != DN_OK) {
+        loga("Error in testing event wakeup !!!");
+        goto err_out;
+    }
+
+    ret = token_bucket_test();
+    if (ret != DN_OK) {
+        loga("Error in testing token bucket !!!");
+        goto err_out;
+    }
+
+    ret = mbuf_slab_test();
+    if (ret != DN_OK) {
+        loga("Error in testing mbuf slabs !!!");
+        goto err_out;
+    }
+
+    ret = mbuf_class_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing mbuf classes !!!");
+        goto err_out;
+    }
+
+    ret = mget_scatter_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing mget scatter !!!");
+        goto err_out;
+    }
+
+    ret = redis_scan_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing redis scan !!!");
+        goto err_out;
+    }
+
+    ret = memcache_binary_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing memcache binary !!!");
+        goto err_out;
+    }
+
+    ret = memcache_meta_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing memcache meta !!!");
+        goto err_out;
+    }
+
+    ret = near_cache_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing near cache !!!");
+        goto err_out;
+    }
+
+    ret = pool_shrink_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing pool shrink !!!");
+        goto err_out;
+    }
+
+    ret = admission_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing admission control !!!");
+        goto err_out;
+    }
+
+    ret = rspmgr_test(conn);
+    if (ret != DN_OK) {
+        loga("Error in testing response mgr !!!");
+        goto err_out;
+    }
+
+    ret = twheel_test();
+    if (ret != DN_OK) {
+        loga("Error in testing timing wheel !!!");
+        goto err_out;
+    }
+
+    ret = vnode_dispatch_test();
+    if (ret != DN_OK) {
+        loga("Error in testing vnode dispatch !!!");
         goto err_out;
     }
 
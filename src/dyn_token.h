@@ -10,9 +10,16 @@
 #define _DYN_TOKEN_H_
 
 
+/* max # of 32-bit words in a token; murmur3 produces 128-bit tokens */
+#define DYN_TOKEN_MAX_LEN 4
+
+/*
+ * The magnitude is stored inline so that a token can live on the stack or
+ * inside another struct and hashing a key never touches the allocator.
+ */
 struct dyn_token {
     uint32_t signum;
-    uint32_t *mag;
+    uint32_t mag[DYN_TOKEN_MAX_LEN];
     uint32_t len;
 };
 
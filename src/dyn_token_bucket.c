@@ -0,0 +1,65 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#include "dyn_core.h"
+#include "dyn_token_bucket.h"
+
+
+void
+token_bucket_init(struct token_bucket *tb)
+{
+    tb->credit = 0;
+    tb->at = 0;
+}
+
+
+static int64_t
+token_bucket_capacity(uint32_t rate)
+{
+    return MAX((int64_t)rate * TB_BURST_USEC, TB_UNIT);
+}
+
+
+/* refill tb up to now; returns the usec to wait for credit, 0 if there is some */
+int64_t
+token_bucket_wait(struct token_bucket *tb, uint32_t rate, int64_t now)
+{
+    int64_t cap, elapsed;
+
+    if (rate == 0) {
+        return 0;
+    }
+
+    cap = token_bucket_capacity(rate);
+
+    if (tb->at == 0) {
+        tb->credit = cap;
+    } else if (now > tb->at) {
+        elapsed = now - tb->at;
+        if (elapsed >= (cap - tb->credit) / rate) {
+            tb->credit = cap;
+        } else {
+            tb->credit += elapsed * rate;
+        }
+    }
+    tb->at = MAX(tb->at, now);
+
+    if (tb->credit > 0) {
+        return 0;
+    }
+
+    return -tb->credit / rate + 1;
+}
+
+
+void
+token_bucket_take(struct token_bucket *tb, uint32_t rate, uint32_t n)
+{
+    if (rate == 0) {
+        return;
+    }
+
+    tb->credit -= (int64_t)n * TB_UNIT;
+}
@@ -0,0 +1,27 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#ifndef _DYN_TOKEN_BUCKET_H_
+#define _DYN_TOKEN_BUCKET_H_
+
+#define TB_UNIT         1000000LL   /* credit units per token, one per usec at rate 1 */
+#define TB_BURST_USEC   10000LL     /* a full bucket holds 10 msec worth of tokens */
+
+/*
+ * Token bucket refilled continuously from a monotonic usec clock. A bucket
+ * with credit left may always be drawn from, even past zero, so a msg larger
+ * than the burst still goes out and the debt is paid off before the next
+ * one. A rate of 0 means unlimited.
+ */
+struct token_bucket {
+    int64_t  credit;   /* tokens available, in TB_UNIT; negative when in debt */
+    int64_t  at;       /* usec of the last refill, 0 if never */
+};
+
+void token_bucket_init(struct token_bucket *tb);
+int64_t token_bucket_wait(struct token_bucket *tb, uint32_t rate, int64_t now);
+void token_bucket_take(struct token_bucket *tb, uint32_t rate, uint32_t n);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#include "dyn_core.h"
+
+void
+twnode_init(struct twnode *node)
+{
+    node->head = NULL;
+    node->key = 0LL;
+    node->data = NULL;
+}
+
+void
+twheel_init(struct twheel *wheel, int64_t now)
+{
+    uint32_t i, l;
+
+    wheel->now = now;
+    wheel->count = 0;
+    TAILQ_INIT(&wheel->expired);
+
+    for (i = 0; i < TWHEEL_SIZE0; i++) {
+        TAILQ_INIT(&wheel->slot0[i]);
+    }
+
+    for (l = 0; l < TWHEEL_LEVELS; l++) {
+        for (i = 0; i < TWHEEL_SIZEN; i++) {
+            TAILQ_INIT(&wheel->slotn[l][i]);
+        }
+    }
+}
+
+/* link a node into the slot that its expiry falls in */
+static void
+twheel_add(struct twheel *wheel, struct twnode *node)
+{
+    struct twnode_tqh *head;
+    int64_t key, delta;
+    uint32_t l, shift;
+
+    key = node->key;
+    delta = key - wheel->now;
+
+    if (delta < 0) {
+        head = &wheel->expired;
+    } else if (delta < TWHEEL_SIZE0) {
+        head = &wheel->slot0[key & TWHEEL_MASK0];
+    } else {
+        for (l = 0; l < TWHEEL_LEVELS - 1; l++) {
+            if (delta < (1LL << (TWHEEL_BITS0 + (l + 1) * TWHEEL_BITSN))) {
+                break;
+            }
+        }
+
+        shift = TWHEEL_BITS0 + l * TWHEEL_BITSN;
+        if (delta >= (1LL << (shift + TWHEEL_BITSN))) {
+            key = wheel->now + (1LL << (shift + TWHEEL_BITSN)) - 1;
+        }
+        head = &wheel->slotn[l][(key >> shift) & TWHEEL_MASKN];
+    }
+
+    TAILQ_INSERT_TAIL(head, node, tqe);
+    node->head = head;
+}
+
+void
+twheel_insert(struct twheel *wheel, struct twnode *node)
+{
+    ASSERT(node->head == NULL);
+
+    twheel_add(wheel, node);
+    wheel->count++;
+}
+
+void
+twheel_delete(struct twheel *wheel, struct twnode *node)
+{
+    if (node->head == NULL) {
+        return;
+    }
+
+    ASSERT(wheel->count > 0);
+
+    TAILQ_REMOVE(node->head, node, tqe);
+    node->head = NULL;
+    wheel->count--;
+}
+
+/*
+ * Spread the slot of a level that the wheel has just reached over the
+ * levels below it. Returns the slot index; 0 means the level wrapped and
+ * the one above is due too.
+ */
+static uint32_t
+twheel_cascade(struct twheel *wheel, uint32_t level)
+{
+    struct twnode_tqh list;
+    struct twnode *node;
+    uint32_t idx;
+
+    idx = (uint32_t)(wheel->now >> (TWHEEL_BITS0 + level * TWHEEL_BITSN)) & TWHEEL_MASKN;
+
+    TAILQ_INIT(&list);
+    TAILQ_CONCAT(&list, &wheel->slotn[level][idx], tqe);
+
+    while (!TAILQ_EMPTY(&list)) {
+        node = TAILQ_FIRST(&list);
+        TAILQ_REMOVE(&list, node, tqe);
+        twheel_add(wheel, node);
+    }
+
+    return idx;
+}
+
+/*
+ * Turn the wheel up to now and take the next expired node off it; NULL when
+ * there is none. Each tick moves its whole slot to the expired q.
+ */
+struct twnode *
+twheel_expire(struct twheel *wheel, int64_t now)
+{
+    struct twnode_tqh *slot;
+    struct twnode *node;
+    uint32_t l;
+
+    while (TAILQ_EMPTY(&wheel->expired) && wheel->now <= now) {
+        if (wheel->count == 0) {
+            wheel->now = now + 1;
+            break;
+        }
+
+        if ((wheel->now & TWHEEL_MASK0) == 0) {
+            for (l = 0; l < TWHEEL_LEVELS && twheel_cascade(wheel, l) == 0; l++) {
+                ;
+            }
+        }
+
+        slot = &wheel->slot0[wheel->now & TWHEEL_MASK0];
+        TAILQ_FOREACH(node, slot, tqe) {
+            node->head = &wheel->expired;
+        }
+        TAILQ_CONCAT(&wheel->expired, slot, tqe);
+
+        wheel->now++;
+    }
+
+    node = TAILQ_FIRST(&wheel->expired);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    twheel_delete(wheel, node);
+
+    return node;
+}
+
+/*
+ * Earliest msec at which a node can expire, or -1 if the wheel is empty.
+ * Only the first level is looked at, so past its last busy slot this is
+ * when the next cascade is due.
+ */
+int64_t
+twheel_next(struct twheel *wheel)
+{
+    int64_t tick;
+
+    if (wheel->count == 0) {
+        return -1;
+    }
+
+    if (!TAILQ_EMPTY(&wheel->expired) || (wheel->now & TWHEEL_MASK0) == 0) {
+        return wheel->now;
+    }
+
+    for (tick = wheel->now; (tick & TWHEEL_MASK0) != 0; tick++) {
+        if (!TAILQ_EMPTY(&wheel->slot0[tick & TWHEEL_MASK0])) {
+            break;
+        }
+    }
+
+    return tick;
+}
@@ -0,0 +1,50 @@
+/*
+ * Dynomite - A thin, distributed replication layer for multi non-distributed storages.
+ * Copyright (C) 2014 Netflix, Inc.
+ */
+
+#ifndef _DYN_TWHEEL_
+#define _DYN_TWHEEL_
+
+/*
+ * Hierarchical timing wheel with a 1 msec tick. The first level has a slot
+ * per tick for the next 256 msec; each of the other levels covers 64 times
+ * the span of the one below it, and its slots are cascaded down as the wheel
+ * turns. Expiries beyond the last level (~18 hours) are clamped to it.
+ */
+
+#define TWHEEL_BITS0        8
+#define TWHEEL_BITSN        6
+#define TWHEEL_SIZE0        (1 << TWHEEL_BITS0)
+#define TWHEEL_SIZEN        (1 << TWHEEL_BITSN)
+#define TWHEEL_MASK0        (TWHEEL_SIZE0 - 1)
+#define TWHEEL_MASKN        (TWHEEL_SIZEN - 1)
+#define TWHEEL_LEVELS       3 /* levels above the first */
+
+struct twnode;
+
+TAILQ_HEAD(twnode_tqh, twnode);
+
+struct twnode {
+    TAILQ_ENTRY(twnode) tqe;     /* link in slot or expired q */
+    struct twnode_tqh   *head;   /* queue we are in, NULL if none */
+    int64_t             key;     /* expiry in msec */
+    void                *data;   /* opaque data */
+};
+
+struct twheel {
+    int64_t             now;                                     /* next tick to run */
+    uint32_t            count;                                   /* # nodes in slots */
+    struct twnode_tqh   expired;                                 /* expired, not taken yet */
+    struct twnode_tqh   slot0[TWHEEL_SIZE0];                     /* first level */
+    struct twnode_tqh   slotn[TWHEEL_LEVELS][TWHEEL_SIZEN];      /* other levels */
+};
+
+void twnode_init(struct twnode *node);
+void twheel_init(struct twheel *wheel, int64_t now);
+void twheel_insert(struct twheel *wheel, struct twnode *node);
+void twheel_delete(struct twheel *wheel, struct twnode *node);
+struct twnode *twheel_expire(struct twheel *wheel, int64_t now);
+int64_t twheel_next(struct twheel *wheel);
+
+#endif
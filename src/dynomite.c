@@ -29,6 +29,7 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/utsname.h>
+#include <sys/wait.h>
 
 #include "dyn_core.h"
 #include "dyn_conf.h"
@@ -50,6 +51,10 @@
 #define DN_MBUF_SIZE        MBUF_SIZE
 #define DN_MBUF_MIN_SIZE    MBUF_MIN_SIZE
 #define DN_MBUF_MAX_SIZE    MBUF_MAX_SIZE
+#define DN_MBUF_MAX_IDLE    MBUF_MAX_IDLE
+
+#define DN_WORKERS          1
+#define DN_MAX_WORKERS      128
 
 static int show_help;
 static int show_version;
@@ -74,12 +79,16 @@ static struct option long_options[] = {
     { "stats-addr",           required_argument,  NULL,   'a' },
     { "pid-file",             required_argument,  NULL,   'p' },
     { "mbuf-size",            required_argument,  NULL,   'm' },
+    { "mbuf-prealloc",        required_argument,  NULL,   'P' },
+    { "mbuf-max-idle",        required_argument,  NULL,   'I' },
+    { "mbuf-hugepages",       no_argument,        NULL,   'H' },
+    { "workers",              required_argument,  NULL,   'w' },
     { "admin-operation",      required_argument,  NULL,   'x' },
     { "admin-param",          required_argument,  NULL,   'y' },
     { NULL,             0,                  NULL,    0  }
 };
 
-static char short_options[] = "hVtdDgv:o:c:s:i:a:p:m:x:y:";
+static char short_options[] = "hVtdDgHv:o:c:s:i:a:p:m:P:I:w:x:y:";
 
 static rstatus_t
 dn_daemonize(int dump_core)
@@ -216,6 +225,7 @@ dn_show_usage(void)
         "Usage: dynomite [-?hVdDt] [-v verbosity level] [-o output file]" CRLF
         "                  [-c conf file] [-s stats port] [-a stats addr]" CRLF
         "                  [-i stats interval] [-p pid file] [-m mbuf size]" CRLF
+        "                  [-w workers]" CRLF
         "");
     log_stderr(
         "Options:" CRLF
@@ -224,7 +234,8 @@ dn_show_usage(void)
         "  -t, --test-conf        : test configuration for syntax errors and exit" CRLF
         "  -g, --gossip           : enable gossip (default: disable)" CRLF
         "  -d, --daemonize        : run as a daemon" CRLF
-        "  -D, --describe-stats   : print stats description and exit");
+        "  -D, --describe-stats   : print stats description and exit" CRLF
+        "  -H, --mbuf-hugepages   : map mbufs in 2MB hugepages");
     log_stderr(
         "  -v, --verbosity=N            : set logging level (default: %d, min: %d, max: %d)" CRLF
         "  -o, --output=S               : set logging file (default: %s)" CRLF
@@ -234,6 +245,9 @@ dn_show_usage(void)
         "  -i, --stats-interval=N       : set stats aggregation interval in msec (default: %d msec)" CRLF
         "  -p, --pid-file=S             : set pid file (default: %s)" CRLF
         "  -m, --mbuf-size=N            : set size of mbuf chunk in bytes (default: %d bytes)" CRLF
+        "  -P, --mbuf-prealloc=N        : set MB of mbufs to preallocate (default: 0 MB)" CRLF
+        "  -I, --mbuf-max-idle=N        : set MB of idle mbufs kept from the OS (default: %d MB)" CRLF
+        "  -w, --workers=N              : set number of worker processes (default: %d)" CRLF
         "  -x, --admin-operation=N      : set size of admin operation (default: %d)" CRLF
         "",
         DN_LOG_DEFAULT, DN_LOG_MIN, DN_LOG_MAX,
@@ -242,6 +256,8 @@ dn_show_usage(void)
         DN_STATS_PORT, DN_STATS_ADDR, DN_STATS_INTERVAL,
         DN_PID_FILE != NULL ? DN_PID_FILE : "off",
         DN_MBUF_SIZE,
+        DN_MBUF_MAX_IDLE,
+        DN_WORKERS,
         0);
 }
 
@@ -310,6 +326,12 @@ dn_set_default_options(struct instance *nci)
     nci->hostname[DN_MAXHOSTNAMELEN - 1] = '\0';
 
     nci->mbuf_chunk_size = DN_MBUF_SIZE;
+    nci->mbuf_prealloc = 0;
+    nci->mbuf_max_idle = DN_MBUF_MAX_IDLE;
+    nci->mbuf_hugepages = 0;
+
+    nci->nworkers = DN_WORKERS;
+    nci->worker_id = 0;
 
     nci->pid = (pid_t)-1;
     nci->pid_filename = NULL;
@@ -429,6 +451,41 @@ dn_get_options(int argc, char **argv, struct instance *nci)
             nci->mbuf_chunk_size = (size_t)value;
             break;
 
+        case 'P':
+            value = dn_atoi(optarg, strlen(optarg));
+            if (value < 0) {
+                log_stderr("dynomite: option -P requires a number");
+                return DN_ERROR;
+            }
+
+            nci->mbuf_prealloc = (size_t)value;
+            break;
+
+        case 'I':
+            value = dn_atoi(optarg, strlen(optarg));
+            if (value < 0) {
+                log_stderr("dynomite: option -I requires a number");
+                return DN_ERROR;
+            }
+
+            nci->mbuf_max_idle = (size_t)value;
+            break;
+
+        case 'H':
+            nci->mbuf_hugepages = 1;
+            break;
+
+        case 'w':
+            value = dn_atoi(optarg, strlen(optarg));
+            if (value <= 0 || value > DN_MAX_WORKERS) {
+                log_stderr("dynomite: option -w requires a number between 1 "
+                           "and %d", DN_MAX_WORKERS);
+                return DN_ERROR;
+            }
+
+            nci->nworkers = (uint32_t)value;
+            break;
+
         case 'x':
             value = dn_atoi(optarg, strlen(optarg));
             if (value <= 0) {
@@ -448,9 +505,12 @@ dn_get_options(int argc, char **argv, struct instance *nci)
                 break;
 
             case 'm':
+            case 'P':
+            case 'I':
             case 'v':
             case 's':
             case 'i':
+            case 'w':
                 log_stderr("dynomite: option -%c requires a number", optopt);
                 break;
 
@@ -575,6 +635,119 @@ dn_run(struct instance *nci)
     core_stop(ctx);
 }
 
+/*
+ * Fork a worker process. Each worker creates its own context, event base,
+ * server pools and SO_REUSEPORT listeners, so the workers share nothing
+ * but the listening addresses. Worker n serves stats on stats_port + n.
+ */
+static pid_t
+dn_spawn_worker(struct instance *nci, uint32_t worker_id)
+{
+    pid_t pid;
+
+    pid = fork();
+    switch (pid) {
+    case -1:
+        log_error("fork() of worker %"PRIu32" failed: %s", worker_id,
+                  strerror(errno));
+        return pid;
+
+    case 0:
+        break;
+
+    default:
+        return pid;
+    }
+
+    signal_set_worker();
+
+    nci->worker_id = worker_id;
+    nci->pid = getpid();
+    nci->pidfile = 0;
+    nci->stats_port = (uint16_t)(nci->stats_port + worker_id);
+
+    loga("worker %"PRIu32" started on pid %d", worker_id, nci->pid);
+
+    dn_run(nci);
+
+    dn_post_run(nci);
+
+    exit(1);
+}
+
+/*
+ * Master loop when running with more than one worker. Workers killed by a
+ * signal are respawned; a worker that exits on its own (e.g. it failed to
+ * bind) brings the whole process down.
+ */
+static void
+dn_run_workers(struct instance *nci)
+{
+    pid_t *pids, pid;
+    uint32_t i;
+    int wstatus;
+
+    pids = dn_zalloc(nci->nworkers * sizeof(*pids));
+    if (pids == NULL) {
+        return;
+    }
+
+    signal_set_workers(pids, nci->nworkers);
+
+    for (i = 0; i < nci->nworkers; i++) {
+        pids[i] = dn_spawn_worker(nci, i);
+        if (pids[i] < 0) {
+            goto done;
+        }
+    }
+
+    for (;;) {
+        pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("waitpid failed: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < nci->nworkers; i++) {
+            if (pids[i] == pid) {
+                break;
+            }
+        }
+        if (i == nci->nworkers) {
+            continue;
+        }
+
+        pids[i] = -1;
+
+        if (!WIFSIGNALED(wstatus)) {
+            log_error("worker %"PRIu32" pid %d exited with status %d", i, pid,
+                      WEXITSTATUS(wstatus));
+            break;
+        }
+
+        log_warn("worker %"PRIu32" pid %d killed by signal %d, respawning", i,
+                 pid, WTERMSIG(wstatus));
+
+        pids[i] = dn_spawn_worker(nci, i);
+        if (pids[i] < 0) {
+            break;
+        }
+    }
+
+done:
+    for (i = 0; i < nci->nworkers; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+
+    signal_set_workers(NULL, 0);
+    dn_free(pids);
+}
+
 static void
 dn_coredump_init(void)
 {
@@ -624,7 +797,11 @@ main(int argc, char **argv)
         exit(1);
     }
 
-    dn_run(&nci);
+    if (nci.nworkers > 1) {
+        dn_run_workers(&nci);
+    } else {
+        dn_run(&nci);
+    }
 
     dn_post_run(&nci);
 
@@ -25,13 +25,14 @@
 #ifdef DN_HAVE_EPOLL
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 struct event_base *
 event_base_create(int nevent, event_cb_t cb)
 {
     struct event_base *evb;
-    int status, ep;
-    struct epoll_event *event;
+    int status, ep, efd;
+    struct epoll_event *event, ev;
 
     ASSERT(nevent > 0);
 
@@ -41,8 +42,17 @@ event_base_create(int nevent, event_cb_t cb)
         return NULL;
     }
 
+    /* other threads write to efd to wake us up; it is tagged with evb */
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        log_error("eventfd failed: %s", strerror(errno));
+        close(ep);
+        return NULL;
+    }
+
     event = dn_calloc(nevent, sizeof(*event));
     if (event == NULL) {
+        close(efd);
         status = close(ep);
         if (status < 0) {
             log_error("close e %d failed, ignored: %s", ep, strerror(errno));
@@ -53,6 +63,7 @@ event_base_create(int nevent, event_cb_t cb)
     evb = dn_alloc(sizeof(*evb));
     if (evb == NULL) {
         dn_free(event);
+        close(efd);
         status = close(ep);
         if (status < 0) {
             log_error("close e %d failed, ignored: %s", ep, strerror(errno));
@@ -60,7 +71,20 @@ event_base_create(int nevent, event_cb_t cb)
         return NULL;
     }
 
+    ev.events = (uint32_t)(EPOLLIN | EPOLLET);
+    ev.data.ptr = evb;
+    status = epoll_ctl(ep, EPOLL_CTL_ADD, efd, &ev);
+    if (status < 0) {
+        log_error("epoll ctl on e %d efd %d failed: %s", ep, efd, strerror(errno));
+        dn_free(evb);
+        dn_free(event);
+        close(efd);
+        close(ep);
+        return NULL;
+    }
+
     evb->ep = ep;
+    evb->efd = efd;
     evb->event = event;
     evb->nevent = nevent;
     evb->cb = cb;
@@ -83,6 +107,12 @@ event_base_destroy(struct event_base *evb)
 
     dn_free(evb->event);
 
+    status = close(evb->efd);
+    if (status < 0) {
+        log_error("close efd %d failed, ignored: %s", evb->efd, strerror(errno));
+    }
+    evb->efd = -1;
+
     status = close(evb->ep);
     if (status < 0) {
         log_error("close e %d failed, ignored: %s", evb->ep, strerror(errno));
@@ -107,7 +137,7 @@ event_add_in(struct event_base *evb, struct conn *c)
         return 0;
     }
 
-    event.events = (uint32_t)(EPOLLIN); // | EPOLLET);
+    event.events = (uint32_t)(c->send_active ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
     event.data.ptr = c;
 
     status = epoll_ctl(ep, EPOLL_CTL_MOD, c->sd, &event);
@@ -124,7 +154,30 @@ event_add_in(struct event_base *evb, struct conn *c)
 int
 event_del_in(struct event_base *evb, struct conn *c)
 {
-    return 0;
+    int status;
+    struct epoll_event event;
+    int ep = evb->ep;
+
+    ASSERT(ep > 0);
+    ASSERT(c != NULL);
+    ASSERT(c->sd > 0);
+
+    if (!c->recv_active) {
+        return 0;
+    }
+
+    event.events = (uint32_t)(c->send_active ? EPOLLOUT : 0);
+    event.data.ptr = c;
+
+    status = epoll_ctl(ep, EPOLL_CTL_MOD, c->sd, &event);
+    if (status < 0) {
+        log_error("epoll ctl on e %d sd %d failed: %s", ep, c->sd,
+                  strerror(errno));
+    } else {
+        c->recv_active = 0;
+    }
+
+    return status;
 }
 
 int
@@ -137,13 +190,13 @@ event_add_out(struct event_base *evb, struct conn *c)
     ASSERT(ep > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
 
     if (c->send_active) {
         return 0;
     }
 
-    event.events = (uint32_t)(EPOLLIN | EPOLLOUT); // | EPOLLET);
+    /* reads of a client paused by admission control stay off */
+    event.events = (uint32_t)(c->recv_active ? (EPOLLIN | EPOLLOUT) : EPOLLOUT);
     event.data.ptr = c;
 
     status = epoll_ctl(ep, EPOLL_CTL_MOD, c->sd, &event);
@@ -167,13 +220,12 @@ event_del_out(struct event_base *evb, struct conn *c)
     ASSERT(ep > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
 
     if (!c->send_active) {
         return 0;
     }
 
-    event.events = (uint32_t)(EPOLLIN | EPOLLET);
+    event.events = (uint32_t)(c->recv_active ? (EPOLLIN | EPOLLET) : 0);
     event.data.ptr = c;
 
     status = epoll_ctl(ep, EPOLL_CTL_MOD, c->sd, &event);
@@ -235,6 +287,18 @@ event_del_conn(struct event_base *evb, struct conn *c)
     return status;
 }
 
+/* wake the thread in event_wait; may be called from any thread */
+void
+event_wakeup(struct event_base *evb)
+{
+    int status;
+
+    status = eventfd_write(evb->efd, 1);
+    if (status < 0) {
+        log_error("eventfd write on efd %d failed: %s", evb->efd, strerror(errno));
+    }
+}
+
 int
 event_wait(struct event_base *evb, int timeout)
 {
@@ -260,6 +324,12 @@ event_wait(struct event_base *evb, int timeout)
                 log_debug(LOG_VVERB, "epoll %04"PRIX32" triggered on conn %p",
                           ev->events, ev->data.ptr);
 
+                if (ev->data.ptr == evb) {
+                    eventfd_t n;
+                    IGNORE_RET_VAL(eventfd_read(evb->efd, &n));
+                    continue;
+                }
+
                 if (ev->events & (EPOLLERR | EPOLLRDHUP)) {
                     events |= EVENT_ERR;
                 }
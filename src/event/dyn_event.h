@@ -61,6 +61,7 @@ event_fd(struct event_base *evb)
 
 struct event_base {
     int                ep;      /* epoll descriptor */
+    int                efd;     /* eventfd that wakes event_wait */
 
     struct epoll_event *event;  /* event[] - events that were triggered */
     int                nevent;  /* # event */
@@ -107,6 +108,7 @@ int event_del_out(struct event_base *evb, struct conn *c);
 int event_add_conn(struct event_base *evb, struct conn *c);
 int event_del_conn(struct event_base *evb, struct conn *c);
 int event_wait(struct event_base *evb, int timeout);
+void event_wakeup(struct event_base *evb);
 void event_loop_stats(event_stats_cb_t cb, void *arg);
 
 #endif /* _DN_EVENT_H */
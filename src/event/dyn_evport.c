@@ -93,39 +93,106 @@ event_base_destroy(struct event_base *evb)
     dn_free(evb);
 }
 
+/* poll events of the interests c has on, 0 if none */
+static int
+event_port_events(struct conn *c)
+{
+    return (c->recv_active ? POLLIN : 0) | (c->send_active ? POLLOUT : 0);
+}
+
+/*
+ * Associate c with the port for the interests it has on; with none left,
+ * dissociate it. ENOENT is expected when c was just returned by port_getn,
+ * which dissociates it.
+ */
+static int
+event_port_update(struct event_base *evb, struct conn *c)
+{
+    int status, events;
+    int evp = evb->evp;
+
+    events = event_port_events(c);
+    if (events != 0) {
+        status = port_associate(evp, PORT_SOURCE_FD, c->sd, events, c);
+        if (status < 0) {
+            log_error("port associate on evp %d sd %d failed: %s", evp, c->sd,
+                      strerror(errno));
+        }
+        return status;
+    }
+
+    status = port_dissociate(evp, PORT_SOURCE_FD, c->sd);
+    if (status < 0 && errno != ENOENT) {
+        log_error("port dissociate evp %d sd %d failed: %s", evp, c->sd,
+                  strerror(errno));
+        return status;
+    }
+
+    return 0;
+}
+
 int
 event_add_in(struct event_base *evb, struct conn *c)
 {
-    return 0;
+    int status;
+
+    ASSERT(evb->evp > 0);
+    ASSERT(c != NULL);
+    ASSERT(c->sd > 0);
+
+    if (c->recv_active) {
+        return 0;
+    }
+
+    c->recv_active = 1;
+    status = event_port_update(evb, c);
+    if (status < 0) {
+        c->recv_active = 0;
+    }
+
+    return status;
 }
 
 int
 event_del_in(struct event_base *evb, struct conn *c)
 {
-    return 0;
+    int status;
+
+    ASSERT(evb->evp > 0);
+    ASSERT(c != NULL);
+    ASSERT(c->sd > 0);
+
+    if (!c->recv_active) {
+        return 0;
+    }
+
+    c->recv_active = 0;
+    status = event_port_update(evb, c);
+    if (status < 0) {
+        c->recv_active = 1;
+    }
+
+    return status;
 }
 
 int
 event_add_out(struct event_base *evb, struct conn *c)
 {
     int status;
-    int evp = evb->evp;
 
-    ASSERT(evp > 0);
+    ASSERT(evb->evp > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
 
     if (c->send_active) {
         return 0;
     }
 
-    status = port_associate(evp, PORT_SOURCE_FD, c->sd, POLLIN | POLLOUT, c);
+    /* reads of a client paused by admission control stay off */
+    c->send_active = 1;
+    status = event_port_update(evb, c);
     if (status < 0) {
-        log_error("port associate on evp %d sd %d failed: %s", evp, c->sd,
-                  strerror(errno));
-    } else {
-        c->send_active = 1;
+        c->send_active = 0;
     }
 
     return status;
@@ -135,23 +202,19 @@ int
 event_del_out(struct event_base *evb, struct conn *c)
 {
     int status;
-    int evp = evb->evp;
 
-    ASSERT(evp > 0);
+    ASSERT(evb->evp > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
 
     if (!c->send_active) {
         return 0;
     }
 
-    status = port_associate(evp, PORT_SOURCE_FD, c->sd, POLLIN, c);
+    c->send_active = 0;
+    status = event_port_update(evb, c);
     if (status < 0) {
-        log_error("port associate on evp %d sd %d failed: %s", evp, c->sd,
-                  strerror(errno));
-    } else {
-        c->send_active = 0;
+        c->send_active = 1;
     }
 
     return status;
@@ -226,12 +289,11 @@ event_reassociate(struct event_base *evb, struct conn *c)
     ASSERT(evp > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
 
-    if (c->send_active) {
-        events = POLLIN | POLLOUT;
-    } else {
-        events = POLLIN;
+    /* a conn with every interest off stays dissociated */
+    events = event_port_events(c);
+    if (events == 0) {
+        return 0;
     }
 
     status = port_associate(evp, PORT_SOURCE_FD, c->sd, events , c);
@@ -243,6 +305,21 @@ event_reassociate(struct event_base *evb, struct conn *c)
     return status;
 }
 
+/*
+ * Wake the thread in event_wait; may be called from any thread. The user
+ * event carries no poll events, so event_wait passes it over.
+ */
+void
+event_wakeup(struct event_base *evb)
+{
+    int status;
+
+    status = port_send(evb->evp, 0, NULL);
+    if (status < 0) {
+        log_error("port send on evp %d failed: %s", evb->evp, strerror(errno));
+    }
+}
+
 int
 event_wait(struct event_base *evb, int timeout)
 {
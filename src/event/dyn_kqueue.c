@@ -71,6 +71,15 @@ event_base_create(int nevent, event_cb_t cb)
         return NULL;
     }
 
+#ifdef EVFILT_USER
+    /* other threads trigger this user event to wake us up */
+    EV_SET(&change[0], 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+    status = kevent(kq, change, 1, NULL, 0, NULL);
+    if (status < 0) {
+        log_error("kevent add user event on kq %d failed: %s", kq, strerror(errno));
+    }
+#endif
+
     evb->kq = kq;
     evb->change = change;
     evb->nchange = 0;
@@ -160,7 +169,6 @@ event_add_out(struct event_base *evb, struct conn *c)
     ASSERT(evb->kq > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
     ASSERT(evb->nchange < evb->nevent);
 
     if (c->send_active) {
@@ -183,7 +191,6 @@ event_del_out(struct event_base *evb, struct conn *c)
     ASSERT(evb->kq > 0);
     ASSERT(c != NULL);
     ASSERT(c->sd > 0);
-    ASSERT(c->recv_active);
     ASSERT(evb->nchange < evb->nevent);
 
     if (!c->send_active) {
@@ -244,6 +251,22 @@ event_del_conn(struct event_base *evb, struct conn *c)
     return 0;
 }
 
+/* wake the thread in event_wait; may be called from any thread */
+void
+event_wakeup(struct event_base *evb)
+{
+#ifdef EVFILT_USER
+    struct kevent ev;
+    int status;
+
+    EV_SET(&ev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+    status = kevent(evb->kq, &ev, 1, NULL, 0, NULL);
+    if (status < 0) {
+        log_error("kevent trigger on kq %d failed: %s", evb->kq, strerror(errno));
+    }
+#endif
+}
+
 int
 event_wait(struct event_base *evb, int timeout)
 {
@@ -37,6 +37,87 @@ vnode_item_cmp(const void *t1, const void *t2)
     return cmp_dyn_token(ct1->token, ct2->token);
 }
 
+/*
+ * A token takes the 32-bit fast path if comparing its first word as an
+ * unsigned integer orders it exactly like cmp_dyn_token does.
+ */
+static bool
+vnode_token_is_narrow(struct dyn_token *token)
+{
+    if (token->len != 1) {
+        return false;
+    }
+
+    if (token->signum == 0) {
+        return token->mag[0] == 0;
+    }
+
+    return token->signum == 1 && token->mag[0] != 0;
+}
+
+/*
+ * Lay out the sorted continuum in eytzinger (breadth first) order, so that
+ * a binary search walks the array front to back and the first levels of
+ * the tree share a few cache lines.
+ */
+static uint32_t
+vnode_eytzinger_fill(struct rack *rack, uint32_t i, uint32_t k)
+{
+    if (k <= rack->ncontinuum) {
+        i = vnode_eytzinger_fill(rack, i, 2 * k);
+        rack->fast_token[k] = rack->continuum[i].token->mag[0];
+        rack->fast_index[k] = rack->continuum[i].index;
+        i++;
+        i = vnode_eytzinger_fill(rack, i, 2 * k + 1);
+    }
+
+    return i;
+}
+
+/* turn the fast path of rack off, freeing whichever array it has */
+static void
+vnode_rack_free_fast(struct rack *rack)
+{
+    if (rack->fast_token != NULL) {
+        dn_free(rack->fast_token);
+    }
+    if (rack->fast_index != NULL) {
+        dn_free(rack->fast_index);
+    }
+    rack->fast_token = NULL;
+    rack->fast_index = NULL;
+}
+
+static rstatus_t
+vnode_rack_build_fast(struct rack *rack)
+{
+    uint32_t i;
+
+    vnode_rack_free_fast(rack);
+
+    if (rack->ncontinuum == 0) {
+        return DN_OK;
+    }
+
+    for (i = 0; i < rack->ncontinuum; i++) {
+        if (!vnode_token_is_narrow(rack->continuum[i].token)) {
+            return DN_OK;
+        }
+    }
+
+    /* slot 0 is unused, the eytzinger tree is rooted at 1 */
+    rack->fast_token = dn_alloc(sizeof(uint32_t) * (rack->ncontinuum + 1));
+    rack->fast_index = dn_alloc(sizeof(uint32_t) * (rack->ncontinuum + 1));
+    if (rack->fast_token == NULL || rack->fast_index == NULL) {
+        vnode_rack_free_fast(rack);
+        return DN_ENOMEM;
+    }
+
+    vnode_eytzinger_fill(rack, 0, 1);
+
+    return DN_OK;
+}
+
 rstatus_t
 vnode_rack_verify_continuum(void *elem, void *data)
 {
@@ -44,6 +125,11 @@ vnode_rack_verify_continuum(void *elem, void *data)
     qsort(rack->continuum, rack->ncontinuum, sizeof(*rack->continuum),
           vnode_item_cmp);
 
+    rstatus_t status = vnode_rack_build_fast(rack);
+    if (status != DN_OK) {
+        return status;
+    }
+
     log_debug(LOG_VERB, "**** printing continuums for rack '%.*s'", rack->name->len, rack->name->data);
     uint32_t i;
     for (i = 0; i < rack->ncontinuum; i++) {
@@ -150,3 +236,38 @@ vnode_dispatch(struct continuum *continuum, uint32_t ncontinuum, struct dyn_toke
 
     return right->index;
 }
+
+/*
+ * Same mapping as vnode_dispatch, using the rack's eytzinger array when
+ * both the continuum and the token fit in 32 bits.
+ */
+uint32_t
+vnode_rack_dispatch(struct rack *rack, struct dyn_token *token)
+{
+    uint32_t k, n, val;
+
+    if (rack->fast_token == NULL || !vnode_token_is_narrow(token)) {
+        return vnode_dispatch(rack->continuum, rack->ncontinuum, token);
+    }
+
+    n = rack->ncontinuum;
+    val = token->mag[0];
+
+    k = 1;
+    while (k <= n) {
+        k = 2 * k + (rack->fast_token[k] < val);
+    }
+
+    /* undo the trailing right turns and the last left turn */
+    while (k & 1) {
+        k >>= 1;
+    }
+    k >>= 1;
+
+    /* token is past the last point on the ring, wrap to the first one */
+    if (k == 0) {
+        return rack->continuum[0].index;
+    }
+
+    return rack->fast_index[k];
+}
@@ -140,12 +140,576 @@ memcache_touch(struct msg *r)
     return false;
 }
 
+/*
+ * Memcache binary protocol. Every frame, request or response, starts with a
+ * fixed header:
+ *
+ *   magic (1) opcode (1) key length (2) extras length (1) data type (1)
+ *   vbucket id or status (2) total body length (4) opaque (4) cas (8)
+ *
+ * followed by the extras, the key and the value, which take up the body.
+ * The parser is picked by the magic of the first byte of a message, as
+ * memcached itself does.
+ */
+#define MEMCACHE_BINARY_REQ_MAGIC       0x80
+#define MEMCACHE_BINARY_RSP_MAGIC       0x81
+
+#define MEMCACHE_BINARY_GET             0x00
+#define MEMCACHE_BINARY_SET             0x01
+#define MEMCACHE_BINARY_ADD             0x02
+#define MEMCACHE_BINARY_REPLACE         0x03
+#define MEMCACHE_BINARY_DELETE          0x04
+#define MEMCACHE_BINARY_INCR            0x05
+#define MEMCACHE_BINARY_DECR            0x06
+#define MEMCACHE_BINARY_QUIT            0x07
+#define MEMCACHE_BINARY_GETQ            0x09
+#define MEMCACHE_BINARY_NOOP            0x0a
+#define MEMCACHE_BINARY_GETK            0x0c
+#define MEMCACHE_BINARY_GETKQ           0x0d
+#define MEMCACHE_BINARY_APPEND          0x0e
+#define MEMCACHE_BINARY_PREPEND         0x0f
+#define MEMCACHE_BINARY_SETQ            0x11
+#define MEMCACHE_BINARY_ADDQ            0x12
+#define MEMCACHE_BINARY_REPLACEQ        0x13
+#define MEMCACHE_BINARY_DELETEQ         0x14
+#define MEMCACHE_BINARY_INCRQ           0x15
+#define MEMCACHE_BINARY_DECRQ           0x16
+#define MEMCACHE_BINARY_QUITQ           0x17
+#define MEMCACHE_BINARY_APPENDQ         0x19
+#define MEMCACHE_BINARY_PREPENDQ        0x1a
+#define MEMCACHE_BINARY_TOUCH           0x1c
+
+#define MEMCACHE_BINARY_OK              0x0000
+#define MEMCACHE_BINARY_KEY_ENOENT      0x0001
+#define MEMCACHE_BINARY_KEY_EEXISTS     0x0002
+#define MEMCACHE_BINARY_E2BIG           0x0003
+#define MEMCACHE_BINARY_EINVAL          0x0004
+#define MEMCACHE_BINARY_NOT_STORED      0x0005
+#define MEMCACHE_BINARY_DELTA_BADVAL    0x0006
+#define MEMCACHE_BINARY_UNKNOWN_COMMAND 0x0081
+#define MEMCACHE_BINARY_EINTERNAL       0x0084
+
+/* the opcode that answers even on success for a quiet opcode */
+static uint8_t
+memcache_binary_loud(uint8_t opcode)
+{
+    switch (opcode) {
+    case MEMCACHE_BINARY_GETQ:
+        return MEMCACHE_BINARY_GET;
+
+    case MEMCACHE_BINARY_GETKQ:
+        return MEMCACHE_BINARY_GETK;
+
+    case MEMCACHE_BINARY_SETQ:
+        return MEMCACHE_BINARY_SET;
+
+    case MEMCACHE_BINARY_ADDQ:
+        return MEMCACHE_BINARY_ADD;
+
+    case MEMCACHE_BINARY_REPLACEQ:
+        return MEMCACHE_BINARY_REPLACE;
+
+    case MEMCACHE_BINARY_DELETEQ:
+        return MEMCACHE_BINARY_DELETE;
+
+    case MEMCACHE_BINARY_INCRQ:
+        return MEMCACHE_BINARY_INCR;
+
+    case MEMCACHE_BINARY_DECRQ:
+        return MEMCACHE_BINARY_DECR;
+
+    case MEMCACHE_BINARY_QUITQ:
+        return MEMCACHE_BINARY_QUIT;
+
+    case MEMCACHE_BINARY_APPENDQ:
+        return MEMCACHE_BINARY_APPEND;
+
+    case MEMCACHE_BINARY_PREPENDQ:
+        return MEMCACHE_BINARY_PREPEND;
+
+    default:
+        break;
+    }
+
+    return opcode;
+}
+
+/* a quiet get answers only on a hit, and never ends a message */
+static bool
+memcache_binary_quiet_get(uint8_t opcode)
+{
+    return opcode == MEMCACHE_BINARY_GETQ || opcode == MEMCACHE_BINARY_GETKQ;
+}
+
+/*
+ * Take in the header and key of the request frame at p. A run of quiet gets
+ * is one request, closed by the first loud frame - usually a noop - which
+ * r->end points at. Its keys, and that of the frame closing it, are kept
+ * like those of a text 'get', so that it can be split per owner. A quiet
+ * update is sent as its loud opcode, and the reply is dropped in
+ * pre-coalesce if it is a success.
+ */
+static rstatus_t
+memcache_binary_req_frame(struct msg *r, uint8_t *p, uint8_t *key, uint16_t keylen)
+{
+    uint8_t opcode, loud;
+    bool run;
+
+    opcode = p[1];
+    loud = memcache_binary_loud(opcode);
+    run = memcache_binary_quiet_get(r->bin_opcode);
+
+    if (run && !memcache_binary_quiet_get(opcode)) {
+        if (loud != opcode) {
+            log_debug(LOG_INFO, "quiet gets of req %"PRIu64" closed by a quiet frame",
+                      r->id);
+            return DN_ERROR;
+        }
+        r->end = p;
+    }
+
+    switch (loud) {
+    case MEMCACHE_BINARY_GET:
+    case MEMCACHE_BINARY_GETK:
+        if (p[4] != 0) {
+            return DN_ERROR;
+        }
+        r->type = MSG_REQ_MC_GET;
+        r->is_read = 1;
+        break;
+
+    case MEMCACHE_BINARY_NOOP:
+        if (!run) {
+            r->type = MSG_REQ_MC_NOOP;
+            r->is_read = 1;
+        }
+        break;
+
+    case MEMCACHE_BINARY_SET:
+        r->type = MSG_REQ_MC_SET;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_ADD:
+        r->type = MSG_REQ_MC_ADD;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_REPLACE:
+        r->type = MSG_REQ_MC_REPLACE;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_APPEND:
+        r->type = MSG_REQ_MC_APPEND;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_PREPEND:
+        r->type = MSG_REQ_MC_PREPEND;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_DELETE:
+        r->type = MSG_REQ_MC_DELETE;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_INCR:
+        r->type = MSG_REQ_MC_INCR;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_DECR:
+        r->type = MSG_REQ_MC_DECR;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_TOUCH:
+        r->type = MSG_REQ_MC_TOUCH;
+        r->is_read = 0;
+        break;
+
+    case MEMCACHE_BINARY_QUIT:
+        r->type = MSG_REQ_MC_QUIT;
+        r->quit = 1;
+        r->is_read = 1;
+        return DN_OK;
+
+    default:
+        return DN_ERROR;
+    }
+
+    if (loud != MEMCACHE_BINARY_NOOP && keylen == 0) {
+        return DN_ERROR;
+    }
+
+    if ((run || memcache_binary_quiet_get(opcode)) && keylen != 0 &&
+        msg_add_key(r, key, key + keylen) != DN_OK) {
+        return DN_ENOMEM;
+    }
+
+    if (r->key_start == NULL && keylen != 0) {
+        r->key_start = key;
+        r->key_end = key + keylen;
+    }
+
+    if (loud != opcode && !memcache_binary_quiet_get(opcode)) {
+        p[1] = loud;
+        r->quiet = 1;
+    }
+
+    return DN_OK;
+}
+
+/* take in the header of the response frame at p */
+static void
+memcache_binary_rsp_frame(struct msg *r, uint8_t *p)
+{
+    uint16_t status;
+
+    dn_memcpy(&status, p + 6, sizeof(status));
+    status = ntohs(status);
+
+    r->end = p;
+
+    switch (status) {
+    case MEMCACHE_BINARY_OK:
+        break;
+
+    case MEMCACHE_BINARY_KEY_ENOENT:
+        r->type = MSG_RSP_MC_NOT_FOUND;
+        return;
+
+    case MEMCACHE_BINARY_KEY_EEXISTS:
+        r->type = MSG_RSP_MC_EXISTS;
+        return;
+
+    case MEMCACHE_BINARY_NOT_STORED:
+        r->type = MSG_RSP_MC_NOT_STORED;
+        return;
+
+    case MEMCACHE_BINARY_E2BIG:
+    case MEMCACHE_BINARY_EINVAL:
+    case MEMCACHE_BINARY_DELTA_BADVAL:
+        r->type = MSG_RSP_MC_CLIENT_ERROR;
+        return;
+
+    case MEMCACHE_BINARY_UNKNOWN_COMMAND:
+        r->type = MSG_RSP_MC_ERROR;
+        return;
+
+    default:
+        r->type = MSG_RSP_MC_SERVER_ERROR;
+        return;
+    }
+
+    switch (memcache_binary_loud(p[1])) {
+    case MEMCACHE_BINARY_GET:
+    case MEMCACHE_BINARY_GETK:
+        r->type = MSG_RSP_MC_VALUE;
+        break;
+
+    case MEMCACHE_BINARY_SET:
+    case MEMCACHE_BINARY_ADD:
+    case MEMCACHE_BINARY_REPLACE:
+    case MEMCACHE_BINARY_APPEND:
+    case MEMCACHE_BINARY_PREPEND:
+        r->type = MSG_RSP_MC_STORED;
+        break;
+
+    case MEMCACHE_BINARY_DELETE:
+        r->type = MSG_RSP_MC_DELETED;
+        break;
+
+    case MEMCACHE_BINARY_INCR:
+    case MEMCACHE_BINARY_DECR:
+        r->type = MSG_RSP_MC_NUM;
+        break;
+
+    case MEMCACHE_BINARY_TOUCH:
+        r->type = MSG_RSP_MC_TOUCHED;
+        break;
+
+    default:
+        r->type = MSG_RSP_MC_END;
+        break;
+    }
+}
+
+/*
+ * Parse binary frames from r->pos up to the one that ends the message: any
+ * frame but a quiet get. A frame is taken in only once its header, extras
+ * and key are in the mbuf; its value is then skipped, across mbufs if need
+ * be, without being looked at.
+ */
+static void
+memcache_parse_binary(struct msg *r)
+{
+    struct mbuf *b;
+    uint8_t *p;
+    uint16_t keylen;
+    uint32_t bodylen, n;
+    uint8_t extlen, opcode;
+    rstatus_t status;
+    enum {
+        SW_FRAME,
+        SW_VALUE
+    } state;
+
+    state = r->state;
+    b = STAILQ_LAST(&r->mhdr, mbuf, next);
+    p = r->pos;
+
+    r->binary = 1;
+
+    for (;;) {
+        if (state == SW_VALUE) {
+            n = MIN(r->rlen, (uint32_t)(b->last - p));
+            p += n;
+            r->rlen -= n;
+            if (r->rlen != 0) {
+                r->vlen_rem = r->rlen;
+                r->pos = p;
+                r->state = state;
+                r->result = MSG_PARSE_AGAIN;
+                return;
+            }
+
+            state = SW_FRAME;
+            if (!memcache_binary_quiet_get(r->bin_opcode)) {
+                goto done;
+            }
+        }
+
+        if (b->last - p < MEMCACHE_BINARY_HEADER_LEN) {
+            goto again;
+        }
+
+        if (*p != (r->request ? MEMCACHE_BINARY_REQ_MAGIC : MEMCACHE_BINARY_RSP_MAGIC)) {
+            goto error;
+        }
+
+        dn_memcpy(&keylen, p + 2, sizeof(keylen));
+        keylen = ntohs(keylen);
+        extlen = p[4];
+        dn_memcpy(&bodylen, p + 8, sizeof(bodylen));
+        bodylen = ntohl(bodylen);
+
+        if (keylen > MEMCACHE_MAX_KEY_LENGTH || (uint32_t)extlen + keylen > bodylen) {
+            goto error;
+        }
+
+        if (b->last - p < MEMCACHE_BINARY_HEADER_LEN + extlen + keylen) {
+            goto again;
+        }
+
+        opcode = p[1];
+        if (r->request) {
+            status = memcache_binary_req_frame(r, p, p + MEMCACHE_BINARY_HEADER_LEN + extlen,
+                                               keylen);
+            if (status == DN_ENOMEM) {
+                goto enomem;
+            }
+            if (status != DN_OK) {
+                goto error;
+            }
+        } else {
+            memcache_binary_rsp_frame(r, p);
+        }
+
+        r->bin_opcode = opcode;
+        dn_memcpy(&r->bin_opaque, p + 12, sizeof(r->bin_opaque));
+        r->rlen = bodylen - extlen - keylen;
+        r->vlen = r->rlen;
+        p += MEMCACHE_BINARY_HEADER_LEN + extlen + keylen;
+        state = SW_VALUE;
+    }
+
+again:
+    /* the frame at p is parsed again once it is all in */
+    r->pos = p;
+    r->state = state;
+
+    if (b->last == b->end && p != b->last) {
+        if (p == b->pos) {
+            goto error;
+        }
+        r->result = MSG_PARSE_REPAIR;
+    } else {
+        r->result = MSG_PARSE_AGAIN;
+    }
+
+    log_hexdump(LOG_VERB, b->pos, mbuf_length(b), "parsed binary %s %"PRIu64" res %d "
+                "type %d rpos %d of %d", r->request ? "req" : "rsp", r->id, r->result,
+                r->type, r->pos - b->pos, b->last - b->pos);
+    return;
+
+done:
+    ASSERT(r->type > MSG_UNKNOWN && r->type < MSG_SENTINEL);
+    r->pos = p;
+    r->state = SW_FRAME;
+    r->result = MSG_PARSE_OK;
+
+    log_hexdump(LOG_VERB, b->pos, mbuf_length(b), "parsed binary %s %"PRIu64" res %d "
+                "type %d rpos %d of %d", r->request ? "req" : "rsp", r->id, r->result,
+                r->type, r->pos - b->pos, b->last - b->pos);
+    return;
+
+error:
+    r->result = MSG_PARSE_ERROR;
+    r->state = state;
+    errno = EINVAL;
+
+    log_hexdump(LOG_INFO, b->pos, mbuf_length(b), "parsed bad binary %s %"PRIu64" "
+                "res %d type %d", r->request ? "req" : "rsp", r->id, r->result, r->type);
+    return;
+
+enomem:
+    r->result = MSG_OOM_ERROR;
+    r->state = state;
+    errno = ENOMEM;
+}
+
+/*
+ * Return true, if the memcache command is a meta command, otherwise
+ * return false
+ */
+static bool
+memcache_meta(struct msg *r)
+{
+    switch (r->type) {
+    case MSG_REQ_MC_MG:
+    case MSG_REQ_MC_MS:
+    case MSG_REQ_MC_MD:
+    case MSG_REQ_MC_MN:
+        return true;
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
+/* value of the base64 digit ch, or -1 */
+static int
+memcache_base64_digit(uint8_t ch)
+{
+    if (ch >= 'A' && ch <= 'Z') {
+        return ch - 'A';
+    }
+    if (ch >= 'a' && ch <= 'z') {
+        return ch - 'a' + 26;
+    }
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0' + 52;
+    }
+    if (ch == '+') {
+        return 62;
+    }
+    if (ch == '/') {
+        return 63;
+    }
+
+    return -1;
+}
+
+/*
+ * Decode the base64 key of a meta command with the b flag into r->key_buf,
+ * which key_start then points into: memcached keeps the item under the
+ * decoded key, so that is the one routed, hashed and invalidated. The
+ * encoded key is still what goes to the server.
+ */
+static rstatus_t
+memcache_meta_key_decode(struct msg *r)
+{
+    uint8_t *s, *d;
+    uint32_t len, i, npad, bits;
+    int v;
+
+    len = (uint32_t)(r->key_end - r->key_start);
+    if (len == 0 || len % 4 != 0) {
+        return DN_ERROR;
+    }
+
+    s = r->key_start;
+    npad = (s[len - 1] == '=') + (s[len - 2] == '=');
+    if (npad == 2 && len == 4) {
+        return DN_ERROR;
+    }
+
+    d = dn_alloc(len / 4 * 3);
+    if (d == NULL) {
+        return DN_ENOMEM;
+    }
+
+    for (bits = 0, i = 0; i < len; i++) {
+        v = (i >= len - npad) ? 0 : memcache_base64_digit(s[i]);
+        if (v < 0) {
+            dn_free(d);
+            return DN_ERROR;
+        }
+        bits = (bits << 6) | (uint32_t)v;
+        if (i % 4 == 3) {
+            d[i / 4 * 3] = (uint8_t)(bits >> 16);
+            d[i / 4 * 3 + 1] = (uint8_t)(bits >> 8);
+            d[i / 4 * 3 + 2] = (uint8_t)bits;
+            bits = 0;
+        }
+    }
+
+    r->key_buf = d;
+    r->key_start = d;
+    r->key_end = d + len / 4 * 3 - npad;
+
+    return DN_OK;
+}
+
+/*
+ * Take in the meta flag [m, p). The q flag is blanked out so that the server
+ * always answers and the reply can be matched to the request; the reply q
+ * would have suppressed is dropped in pre-coalesce instead. Flags that
+ * change the item make an 'mg' a write, and b has the key decoded.
+ */
+static rstatus_t
+memcache_meta_flag(struct msg *r, uint8_t *m, uint8_t *p)
+{
+    switch (*m) {
+    case 'q':
+        if (p - m == 1) {
+            *m = ' ';
+            r->quiet = 1;
+        }
+        break;
+
+    case 'N':
+    case 'T':
+        if (r->type == MSG_REQ_MC_MG) {
+            r->is_read = 0;
+        }
+        break;
+
+    case 'b':
+        if (p - m == 1 && r->key_buf == NULL && r->key_end > r->key_start) {
+            return memcache_meta_key_decode(r);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return DN_OK;
+}
+
 void
 memcache_parse_req(struct msg *r)
 {
     struct mbuf *b;
     uint8_t *p, *m;
     uint8_t ch;
+    rstatus_t status;
     enum {
         SW_START,
         SW_REQ_TYPE,
@@ -168,6 +732,8 @@ memcache_parse_req(struct msg *r)
         SW_CRLF,
         SW_NOREPLY,
         SW_AFTER_NOREPLY,
+        SW_SPACES_BEFORE_META_FLAG,
+        SW_META_FLAG,
         SW_ALMOST_DONE,
         SW_SENTINEL
     } state;
@@ -185,6 +751,12 @@ memcache_parse_req(struct msg *r)
     ASSERT(r->pos != NULL);
     ASSERT(r->pos >= b->pos && r->pos <= b->last);
 
+    if (r->binary || (state == SW_START && r->pos < b->last &&
+                      *r->pos == MEMCACHE_BINARY_REQ_MAGIC)) {
+        memcache_parse_binary(r);
+        return;
+    }
+
     for (p = r->pos; p < b->last; p++) {
         ch = *p;
 
@@ -213,6 +785,35 @@ memcache_parse_req(struct msg *r)
 
                 switch (p - m) {
 
+                case 2:
+                    if (m[0] != 'm') {
+                        break;
+                    }
+
+                    switch (m[1]) {
+                    case 'g':
+                        r->type = MSG_REQ_MC_MG;
+                        r->is_read = 1;
+                        break;
+
+                    case 's':
+                        r->type = MSG_REQ_MC_MS;
+                        r->is_read = 0;
+                        break;
+
+                    case 'd':
+                        r->type = MSG_REQ_MC_MD;
+                        r->is_read = 0;
+                        break;
+
+                    case 'n':
+                        r->type = MSG_REQ_MC_MN;
+                        r->is_read = 1;
+                        break;
+                    }
+
+                    break;
+
                 case 3:
                     if (str4cmp(m, 'g', 'e', 't', ' ')) {
                         r->type = MSG_REQ_MC_GET;
@@ -321,6 +922,9 @@ memcache_parse_req(struct msg *r)
                 case MSG_REQ_MC_INCR:
                 case MSG_REQ_MC_DECR:
                 case MSG_REQ_MC_TOUCH:
+                case MSG_REQ_MC_MG:
+                case MSG_REQ_MC_MS:
+                case MSG_REQ_MC_MD:
                     if (ch == CR) {
                         goto error;
                     }
@@ -332,6 +936,11 @@ memcache_parse_req(struct msg *r)
                     state = SW_CRLF;
                     break;
 
+                case MSG_REQ_MC_MN:
+                    p = p - 1; /* go back by 1 byte */
+                    state = SW_SPACES_BEFORE_META_FLAG;
+                    break;
+
                 case MSG_UNKNOWN:
                     goto error;
 
@@ -355,6 +964,12 @@ memcache_parse_req(struct msg *r)
             break;
 
         case SW_KEY:
+            if (r->token == NULL) {
+                /* key moved to a new mbuf by repair */
+                r->token = p;
+                r->key_start = p;
+            }
+
             if (ch == ' ' || ch == CR) {
                 if ((p - r->key_start) > MEMCACHE_MAX_KEY_LENGTH) {
                     log_error("parsed bad req %"PRIu64" of type %d with key "
@@ -366,9 +981,17 @@ memcache_parse_req(struct msg *r)
                 r->key_end = p;
                 r->token = NULL;
 
+                if (memcache_retrieval(r) && msg_add_key(r, r->key_start, p) != DN_OK) {
+                    goto enomem;
+                }
+
                 /* get next state */
                 if (memcache_storage(r)) {
                     state = SW_SPACES_BEFORE_FLAGS;
+                } else if (r->type == MSG_REQ_MC_MS) {
+                    state = SW_SPACES_BEFORE_VLEN;
+                } else if (memcache_meta(r)) {
+                    state = SW_SPACES_BEFORE_META_FLAG;
                 } else if (memcache_arithmetic(r) || memcache_touch(r)) {
                     state = SW_SPACES_BEFORE_NUM;
                 } else if (memcache_delete(r)) {
@@ -380,7 +1003,8 @@ memcache_parse_req(struct msg *r)
                 }
 
                 if (ch == CR) {
-                    if (memcache_storage(r) || memcache_arithmetic(r)) {
+                    if (memcache_storage(r) || memcache_arithmetic(r) ||
+                        r->type == MSG_REQ_MC_MS) {
                         goto error;
                     }
                     p = p - 1; /* go back by 1 byte */
@@ -401,7 +1025,9 @@ memcache_parse_req(struct msg *r)
 
             default:
                 r->token = p;
-                goto fragment;
+                r->key_start = p;
+                state = SW_KEY;
+                break;
             }
 
             break;
@@ -482,6 +1108,11 @@ memcache_parse_req(struct msg *r)
                 p = p - 1; /* go back by 1 byte */
                 r->token = NULL;
                 state = SW_SPACES_BEFORE_CAS;
+            } else if (memcache_meta(r) && (ch == ' ' || ch == CR)) {
+                /* vlen_end <- p - 1 */
+                p = p - 1; /* go back by 1 byte */
+                r->token = NULL;
+                state = SW_SPACES_BEFORE_META_FLAG;
             } else if (ch == ' ' || ch == CR) {
                 /* vlen_end <- p - 1 */
                 p = p - 1; /* go back by 1 byte */
@@ -539,6 +1170,7 @@ memcache_parse_req(struct msg *r)
             if (m >= b->last) {
                 ASSERT(r->vlen >= (uint32_t)(b->last - p));
                 r->vlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->vlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m; /* move forward by vlen bytes */
                 break;
@@ -652,6 +1284,53 @@ memcache_parse_req(struct msg *r)
 
             break;
 
+        case SW_SPACES_BEFORE_META_FLAG:
+            switch (ch) {
+            case ' ':
+                break;
+
+            case CR:
+                if (r->type == MSG_REQ_MC_MS) {
+                    state = SW_RUNTO_VAL;
+                } else {
+                    state = SW_ALMOST_DONE;
+                }
+                break;
+
+            default:
+                if (!isalpha(ch)) {
+                    goto error;
+                }
+                /* flag_start <- p */
+                r->token = p;
+                state = SW_META_FLAG;
+                break;
+            }
+
+            break;
+
+        case SW_META_FLAG:
+            if (r->token == NULL) {
+                /* flag moved to a new mbuf by repair */
+                r->token = p;
+            }
+
+            if (ch == ' ' || ch == CR) {
+                /* flag_end <- p - 1 */
+                status = memcache_meta_flag(r, r->token, p);
+                if (status == DN_ENOMEM) {
+                    goto enomem;
+                }
+                if (status != DN_OK) {
+                    goto error;
+                }
+                r->token = NULL;
+                p = p - 1; /* go back by 1 byte */
+                state = SW_SPACES_BEFORE_META_FLAG;
+            }
+
+            break;
+
         case SW_CRLF:
             switch (ch) {
             case ' ':
@@ -717,19 +1396,6 @@ memcache_parse_req(struct msg *r)
                 r->state, r->pos - b->pos, b->last - b->pos);
     return;
 
-fragment:
-    ASSERT(p != b->last);
-    ASSERT(r->token != NULL);
-    r->pos = r->token;
-    r->token = NULL;
-    r->state = state;
-    r->result = MSG_PARSE_FRAGMENT;
-
-    log_hexdump(LOG_VERB, b->pos, mbuf_length(b), "parsed req %"PRIu64" res %d "
-                "type %d state %d rpos %d of %d", r->id, r->result, r->type,
-                r->state, r->pos - b->pos, b->last - b->pos);
-    return;
-
 done:
     ASSERT(r->type > MSG_UNKNOWN && r->type < MSG_SENTINEL);
     r->pos = p + 1;
@@ -750,6 +1416,12 @@ error:
     log_hexdump(LOG_INFO, b->pos, mbuf_length(b), "parsed bad req %"PRIu64" "
                 "res %d type %d state %d", r->id, r->result, r->type,
                 r->state);
+    return;
+
+enomem:
+    r->result = MSG_OOM_ERROR;
+    r->state = state;
+    errno = ENOMEM;
 }
 
 void
@@ -791,6 +1463,12 @@ memcache_parse_rsp(struct msg *r)
     ASSERT(r->pos != NULL);
     ASSERT(r->pos >= b->pos && r->pos <= b->last);
 
+    if (r->binary || (state == SW_START && r->pos < b->last &&
+                      *r->pos == MEMCACHE_BINARY_RSP_MAGIC)) {
+        memcache_parse_binary(r);
+        return;
+    }
+
     for (p = r->pos; p < b->last; p++) {
         ch = *p;
 
@@ -839,6 +1517,26 @@ memcache_parse_rsp(struct msg *r)
                 r->type = MSG_UNKNOWN;
 
                 switch (p - m) {
+                case 2:
+                    /* meta replies; NS, EX and NF mean what their long forms do */
+                    if (m[0] == 'V' && m[1] == 'A') {
+                        r->type = MSG_RSP_MC_VA;
+                    } else if (m[0] == 'H' && m[1] == 'D') {
+                        r->type = MSG_RSP_MC_HD;
+                    } else if (m[0] == 'E' && m[1] == 'N') {
+                        r->type = MSG_RSP_MC_EN;
+                    } else if (m[0] == 'M' && m[1] == 'N') {
+                        r->type = MSG_RSP_MC_MN;
+                    } else if (m[0] == 'N' && m[1] == 'S') {
+                        r->type = MSG_RSP_MC_NOT_STORED;
+                    } else if (m[0] == 'E' && m[1] == 'X') {
+                        r->type = MSG_RSP_MC_EXISTS;
+                    } else if (m[0] == 'N' && m[1] == 'F') {
+                        r->type = MSG_RSP_MC_NOT_FOUND;
+                    }
+
+                    break;
+
                 case 3:
                     if (str4cmp(m, 'E', 'N', 'D', '\r')) {
                         r->type = MSG_RSP_MC_END;
@@ -952,6 +1650,17 @@ memcache_parse_rsp(struct msg *r)
                     state = SW_RUNTO_CRLF;
                     break;
 
+                case MSG_RSP_MC_VA:
+                    state = SW_SPACES_BEFORE_VLEN;
+                    break;
+
+                case MSG_RSP_MC_HD:
+                case MSG_RSP_MC_EN:
+                case MSG_RSP_MC_MN:
+                    /* runs over the flags */
+                    state = SW_RUNTO_CRLF;
+                    break;
+
                 default:
                     NOT_REACHED();
                 }
@@ -1067,6 +1776,7 @@ memcache_parse_rsp(struct msg *r)
             if (m >= b->last) {
                 ASSERT(r->vlen >= (uint32_t)(b->last - p));
                 r->vlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->vlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m; /* move forward by vlen bytes */
                 break;
@@ -1087,6 +1797,10 @@ memcache_parse_rsp(struct msg *r)
         case SW_VAL_LF:
             switch (ch) {
             case LF:
+                if (r->type == MSG_RSP_MC_VA) {
+                    /* rsp_end <- p */
+                    goto done;
+                }
                 state = SW_END;
                 break;
 
@@ -1126,7 +1840,7 @@ memcache_parse_rsp(struct msg *r)
         case SW_RUNTO_CRLF:
             switch (ch) {
             case CR:
-                if (r->type == MSG_RSP_MC_VALUE) {
+                if (r->type == MSG_RSP_MC_VALUE || r->type == MSG_RSP_MC_VA) {
                     state = SW_RUNTO_VAL;
                 } else {
                     state = SW_ALMOST_DONE;
@@ -1216,52 +1930,230 @@ error:
 }
 
 /*
- * Pre-split copy handler invoked when the request is a multi vector -
- * 'get' or 'gets' request and is about to be split into two requests
+ * Build frag as the quiet gets of r that r->frag_map puts in fragment fid,
+ * closed by the frame that closed r if it is the last fragment and by a
+ * noop otherwise. The replies to all but the last fragment are cut at their
+ * closing frame in pre-coalesce, so the fragment that holds the key of a
+ * keyed closing frame is swapped with the last one.
  */
-void
-memcache_pre_splitcopy(struct mbuf *mbuf, void *arg)
+static rstatus_t
+memcache_binary_fragment(struct msg *r, struct msg *frag, uint32_t fid)
 {
-    struct msg *r = arg;                  /* request vector */
-    struct string get = string("get ");   /* 'get ' string */
-    struct string gets = string("gets "); /* 'gets ' string */
+    struct keypos *kpos;
+    struct mbuf *mbuf;
+    uint32_t i, n, nkey, last, tail, len;
+    uint16_t keylen;
+    uint8_t *p, *q;
+
+    ASSERT(r->end != NULL);
+
+    nkey = array_n(r->keys);
+    for (last = 0, i = 0; i < nkey; i++) {
+        last = MAX(last, *(uint32_t *)array_get(r->frag_map, i));
+    }
+
+    dn_memcpy(&keylen, r->end + 2, sizeof(keylen));
+    keylen = ntohs(keylen);
+    if (keylen != 0) {
+        nkey--;
+        tail = *(uint32_t *)array_get(r->frag_map, nkey);
+        if (fid == last) {
+            fid = tail;
+        } else if (fid == tail) {
+            fid = last;
+        }
+    } else {
+        tail = last;
+    }
+
+    for (i = 0; i < nkey; i++) {
+        if (*(uint32_t *)array_get(r->frag_map, i) != fid) {
+            continue;
+        }
+
+        /* a quiet get has no extras, so its header is right before its key */
+        kpos = array_get(r->keys, i);
+        len = MEMCACHE_BINARY_HEADER_LEN + (uint32_t)(kpos->end - kpos->start);
+
+        p = msg_reserve(frag, len);
+        if (p == NULL) {
+            return DN_ENOMEM;
+        }
+        dn_memcpy(p, kpos->start - MEMCACHE_BINARY_HEADER_LEN, len);
+
+        if (frag->key_start == NULL) {
+            frag->key_start = p + MEMCACHE_BINARY_HEADER_LEN;
+            frag->key_end = p + len;
+        }
+    }
+
+    frag->binary = 1;
+
+    if (fid != tail) {
+        p = msg_reserve(frag, MEMCACHE_BINARY_HEADER_LEN);
+        if (p == NULL) {
+            return DN_ENOMEM;
+        }
+        memset(p, 0, MEMCACHE_BINARY_HEADER_LEN);
+        p[0] = MEMCACHE_BINARY_REQ_MAGIC;
+        p[1] = MEMCACHE_BINARY_NOOP;
+        dn_memcpy(p + 12, &r->bin_opaque, sizeof(r->bin_opaque));
+
+        frag->bin_opcode = MEMCACHE_BINARY_NOOP;
+        frag->bin_opaque = r->bin_opaque;
+
+        return DN_OK;
+    }
+
+    /* the closing frame runs from r->end to the end of r */
+    for (mbuf = STAILQ_FIRST(&r->mhdr); mbuf != NULL; mbuf = STAILQ_NEXT(mbuf, next)) {
+        if (r->end >= mbuf->pos && r->end < mbuf->last) {
+            break;
+        }
+    }
+    ASSERT(mbuf != NULL);
+
+    for (q = r->end; mbuf != NULL; mbuf = STAILQ_NEXT(mbuf, next), q = NULL) {
+        if (q == NULL) {
+            q = mbuf->pos;
+        }
+        n = (uint32_t)(mbuf->last - q);
+        if (n == 0) {
+            continue;
+        }
+
+        p = msg_reserve(frag, n);
+        if (p == NULL) {
+            return DN_ENOMEM;
+        }
+        dn_memcpy(p, q, n);
+
+        if (q == r->end && keylen != 0 && frag->key_start == NULL) {
+            frag->key_start = p + MEMCACHE_BINARY_HEADER_LEN + r->end[4];
+            frag->key_end = frag->key_start + keylen;
+        }
+    }
+
+    frag->bin_opcode = r->bin_opcode;
+    frag->bin_opaque = r->bin_opaque;
+
+    return DN_OK;
+}
+
+/*
+ * Build frag as the part of the multi-key request r - 'get' or 'gets', or a
+ * run of binary quiet gets - that holds the keys r->frag_map puts in
+ * fragment fid
+ */
+rstatus_t
+memcache_fragment(struct msg *r, struct msg *frag, uint32_t fid)
+{
+    struct string get = string("get");   /* 'get' string */
+    struct string gets = string("gets"); /* 'gets' string */
+    struct string *cmd;
+    struct keypos *kpos;
+    uint32_t i, keylen;
+    uint8_t *p;
 
     ASSERT(r->request);
     ASSERT(!r->redis);
-    ASSERT(mbuf_empty(mbuf));
+    ASSERT(array_n(r->keys) == array_n(r->frag_map));
+
+    if (r->binary) {
+        return memcache_binary_fragment(r, frag, fid);
+    }
 
     switch (r->type) {
     case MSG_REQ_MC_GET:
-        mbuf_copy(mbuf, get.data, get.len);
+        cmd = &get;
         break;
 
     case MSG_REQ_MC_GETS:
-        mbuf_copy(mbuf, gets.data, gets.len);
+        cmd = &gets;
         break;
 
     default:
         NOT_REACHED();
+        return DN_ERROR;
+    }
+
+    p = msg_reserve(frag, cmd->len);
+    if (p == NULL) {
+        return DN_ENOMEM;
+    }
+    dn_memcpy(p, cmd->data, cmd->len);
+
+    for (i = 0; i < array_n(r->keys); i++) {
+        if (*(uint32_t *)array_get(r->frag_map, i) != fid) {
+            continue;
+        }
+
+        kpos = array_get(r->keys, i);
+        keylen = (uint32_t)(kpos->end - kpos->start);
+
+        p = msg_reserve(frag, 1 + keylen);
+        if (p == NULL) {
+            return DN_ENOMEM;
+        }
+        *p = ' ';
+        dn_memcpy(p + 1, kpos->start, keylen);
+
+        if (frag->key_start == NULL) {
+            frag->key_start = p + 1;
+            frag->key_end = p + 1 + keylen;
+        }
     }
+
+    p = msg_reserve(frag, CRLF_LEN);
+    if (p == NULL) {
+        return DN_ENOMEM;
+    }
+    dn_memcpy(p, CRLF, CRLF_LEN);
+
+    return DN_OK;
 }
 
 /*
- * Post-split copy handler invoked when the request is a multi vector -
- * 'get' or 'gets' request and has already been split into two requests
+ * Reply to a quiet request that went out loud - a binary quiet update or
+ * a meta command with q: nothing on success, or on a miss for 'mg'. A
+ * binary error goes back under the opcode the client sent.
  */
-rstatus_t
-memcache_post_splitcopy(struct msg *r)
+static void
+memcache_quiet_rsp(struct msg *r)
 {
+    struct msg *pr = r->peer;
     struct mbuf *mbuf;
-    struct string crlf = string(CRLF);
+    bool drop;
 
-    ASSERT(r->request);
-    ASSERT(!r->redis);
-    ASSERT(!STAILQ_EMPTY(&r->mhdr));
+    switch (r->type) {
+    case MSG_RSP_MC_STORED:
+    case MSG_RSP_MC_DELETED:
+    case MSG_RSP_MC_NUM:
+    case MSG_RSP_MC_TOUCHED:
+        drop = pr->binary;
+        break;
 
-    mbuf = STAILQ_LAST(&r->mhdr, mbuf, next);
-    mbuf_copy(mbuf, crlf.data, crlf.len);
+    case MSG_RSP_MC_HD:
+        drop = (pr->type == MSG_REQ_MC_MS || pr->type == MSG_REQ_MC_MD);
+        break;
 
-    return DN_OK;
+    case MSG_RSP_MC_EN:
+        drop = (pr->type == MSG_REQ_MC_MG);
+        break;
+
+    default:
+        drop = false;
+        break;
+    }
+
+    if (drop) {
+        STAILQ_FOREACH(mbuf, &r->mhdr, next) {
+            mbuf->pos = mbuf->last;
+        }
+        r->mlen = 0;
+    } else if (r->binary && r->end != NULL) {
+        r->end[1] = pr->bin_opcode;
+    }
 }
 
 /*
@@ -1278,11 +2170,21 @@ memcache_pre_coalesce(struct msg *r)
     ASSERT(!r->request);
     ASSERT(pr->request);
 
+    if (pr->quiet) {
+        memcache_quiet_rsp(r);
+        return;
+    }
+
     if (pr->frag_id == 0) {
         /* do nothing, if not a response to a fragmented request */
         return;
     }
 
+    if (pr->binary && pr->last_fragment) {
+        /* the reply to the frame that closed the client's quiet gets */
+        return;
+    }
+
     switch (r->type) {
 
     case MSG_RSP_MC_VALUE:
@@ -1350,3 +2252,24 @@ void
 memcache_post_coalesce(struct msg *r)
 {
 }
+
+/*
+ * Write at p the header of a binary error reply to req, followed by a text
+ * body of bodylen bytes
+ */
+void
+memcache_binary_error(struct msg *req, uint8_t *p, uint32_t bodylen)
+{
+    uint16_t status = htons(MEMCACHE_BINARY_EINTERNAL);
+
+    ASSERT(req->binary);
+
+    bodylen = htonl(bodylen);
+
+    memset(p, 0, MEMCACHE_BINARY_HEADER_LEN);
+    p[0] = MEMCACHE_BINARY_RSP_MAGIC;
+    p[1] = req->bin_opcode;
+    dn_memcpy(p + 6, &status, sizeof(status));
+    dn_memcpy(p + 8, &bodylen, sizeof(bodylen));
+    dn_memcpy(p + 12, &req->bin_opaque, sizeof(req->bin_opaque));
+}
@@ -27,19 +27,18 @@
 #define _DN_PROTO_H_
 
 
-
+#define MEMCACHE_BINARY_HEADER_LEN  24  /* memcache binary protocol frame header */
 
 void memcache_parse_req(struct msg *r);
 void memcache_parse_rsp(struct msg *r);
-void memcache_pre_splitcopy(struct mbuf *mbuf, void *arg);
-rstatus_t memcache_post_splitcopy(struct msg *r);
+rstatus_t memcache_fragment(struct msg *r, struct msg *frag, uint32_t fid);
 void memcache_pre_coalesce(struct msg *r);
 void memcache_post_coalesce(struct msg *r);
+void memcache_binary_error(struct msg *req, uint8_t *p, uint32_t bodylen);
 
 void redis_parse_req(struct msg *r);
 void redis_parse_rsp(struct msg *r);
-void redis_pre_splitcopy(struct mbuf *mbuf, void *arg);
-rstatus_t redis_post_splitcopy(struct msg *r);
+rstatus_t redis_fragment(struct msg *r, struct msg *frag, uint32_t fid);
 void redis_pre_coalesce(struct msg *r);
 void redis_post_coalesce(struct msg *r);
 
@@ -22,10 +22,93 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "../dyn_core.h"
 #include "dyn_proto.h"
 
+static const uint32_t redis_pow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+/*
+ * Fold the run of digits at p into *val and return the first byte past it,
+ * or last. Where the buffer has eight bytes to spare they are checked and
+ * converted as one word; the tail is done a byte at a time.
+ */
+static inline uint8_t *
+redis_scan_digits(uint8_t *p, uint8_t *last, uint32_t *val)
+{
+    uint32_t v = *val;
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (last - p >= 8) {
+        uint64_t x, nondigit;
+        uint32_t n;
+
+        dn_memcpy(&x, p, 8);
+
+        /* a byte is a digit iff its high nibble is 3 both before and after adding 6 */
+        nondigit = ((x & 0xF0F0F0F0F0F0F0F0ULL) |
+                    (((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ^
+                   0x3333333333333333ULL;
+        n = (nondigit == 0) ? 8 : (uint32_t)__builtin_ctzll(nondigit) / 8;
+        if (n == 0) {
+            break;
+        }
+
+        /* keep the n digits, right aligned behind leading zeros */
+        x &= 0x0F0F0F0F0F0F0F0FULL;
+        if (n < 8) {
+            x = (x & ((1ULL << (8 * n)) - 1)) << (8 * (8 - n));
+        }
+        x = ((x * 10) + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+        x = ((x * 100) + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+        x = (x * 10000) + (x >> 32);
+
+        v = v * redis_pow10[n] + (uint32_t)(x & 0xFFFFFFFF);
+        p += n;
+
+        if (n < 8) {
+            *val = v;
+            return p;
+        }
+    }
+#endif
+
+    for (; p < last && isdigit(*p); p++) {
+        v = v * 10 + (uint32_t)(*p - '0');
+    }
+
+    *val = v;
+    return p;
+}
+
+/* first CR in [p, last), or last */
+static inline uint8_t *
+redis_find_cr(uint8_t *p, uint8_t *last)
+{
+    uint8_t *cr;
+
+#ifdef __SSE2__
+    __m128i vcr = _mm_set1_epi8(CR);
+    int mask;
+
+    for (; last - p >= 16; p += 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)p), vcr));
+        if (mask != 0) {
+            return p + __builtin_ctz((unsigned)mask);
+        }
+    }
+#endif
+
+    cr = memchr(p, CR, (size_t)(last - p));
+
+    return (cr != NULL) ? cr : last;
+}
+
 /*
  * Return true, if the redis command accepts no arguments, otherwise
  * return false
@@ -317,7 +400,6 @@ redis_parse_req(struct msg *r)
         SW_ARGN_LEN_LF,
         SW_ARGN,
         SW_ARGN_LF,
-        SW_FRAGMENT,
         SW_SENTINEL
     } state;
 
@@ -350,7 +432,7 @@ redis_parse_req(struct msg *r)
                 r->rnarg = 0;
                 state = SW_NARG;
             } else if (isdigit(ch)) {
-                r->rnarg = r->rnarg * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rnarg) - 1;
             } else if (ch == CR) {
                 if (r->rnarg == 0) {
                     goto error;
@@ -385,7 +467,7 @@ redis_parse_req(struct msg *r)
                 r->token = p;
                 r->rlen = 0;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if (r->rlen == 0 || r->rnarg == 0) {
                     goto error;
@@ -1080,7 +1162,7 @@ redis_parse_req(struct msg *r)
                 r->token = p;
                 r->rlen = 0;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if (r->rlen == 0) {
                     log_error("parsed bad req %"PRIu64" of type %d with empty "
@@ -1142,6 +1224,10 @@ redis_parse_req(struct msg *r)
             r->key_start = m;
             r->key_end = p;
 
+            if (redis_argx(r) && msg_add_key(r, m, p) != DN_OK) {
+                goto enomem;
+            }
+
             state = SW_KEY_LF;
 
             break;
@@ -1178,7 +1264,7 @@ redis_parse_req(struct msg *r)
                     if (r->rnarg == 0) {
                         goto done;
                     }
-                    state = SW_FRAGMENT;
+                    state = SW_KEY_LEN;
                 } else if (redis_argeval(r)) {
                     if (r->rnarg == 0) {
                         goto done;
@@ -1196,10 +1282,6 @@ redis_parse_req(struct msg *r)
 
             break;
 
-        case SW_FRAGMENT:
-            r->token = p;
-            goto fragment;
-
         case SW_ARG1_LEN:
             if (r->token == NULL) {
                 if (ch != '$') {
@@ -1208,7 +1290,7 @@ redis_parse_req(struct msg *r)
                 r->rlen = 0;
                 r->token = p;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if ((p - r->token) <= 1 || r->rnarg == 0) {
                     goto error;
@@ -1238,6 +1320,7 @@ redis_parse_req(struct msg *r)
             m = p + r->rlen;
             if (m >= b->last) {
                 r->rlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->rlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m;
                 break;
@@ -1302,7 +1385,7 @@ redis_parse_req(struct msg *r)
                 r->rlen = 0;
                 r->token = p;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if ((p - r->token) <= 1 || r->rnarg == 0) {
                     goto error;
@@ -1340,6 +1423,7 @@ redis_parse_req(struct msg *r)
             m = p + r->rlen;
             if (m >= b->last) {
                 r->rlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->rlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m;
                 break;
@@ -1428,7 +1512,7 @@ redis_parse_req(struct msg *r)
                 r->rlen = 0;
                 r->token = p;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if ((p - r->token) <= 1 || r->rnarg == 0) {
                     goto error;
@@ -1458,6 +1542,7 @@ redis_parse_req(struct msg *r)
             m = p + r->rlen;
             if (m >= b->last) {
                 r->rlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->rlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m;
                 break;
@@ -1506,7 +1591,7 @@ redis_parse_req(struct msg *r)
                 r->rlen = 0;
                 r->token = p;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if ((p - r->token) <= 1 || r->rnarg == 0) {
                     goto error;
@@ -1536,6 +1621,7 @@ redis_parse_req(struct msg *r)
             m = p + r->rlen;
             if (m >= b->last) {
                 r->rlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->rlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m;
                 break;
@@ -1595,19 +1681,6 @@ redis_parse_req(struct msg *r)
                 r->state, r->pos - b->pos, b->last - b->pos);
     return;
 
-fragment:
-    ASSERT(p != b->last);
-    ASSERT(r->token != NULL);
-    r->pos = r->token;
-    r->token = NULL;
-    r->state = state;
-    r->result = MSG_PARSE_FRAGMENT;
-
-    log_hexdump(LOG_VERB, b->pos, mbuf_length(b), "parsed req %"PRIu64" res %d "
-               "type %d state %d rpos %d of %d", r->id, r->result, r->type,
-               r->state, r->pos - b->pos, b->last - b->pos);
-    return;
-
 done:
     ASSERT(r->type > MSG_UNKNOWN && r->type < MSG_SENTINEL);
     r->pos = p + 1;
@@ -1629,7 +1702,12 @@ error:
     log_hexdump(LOG_INFO, b->pos, mbuf_length(b), "parsed bad req %"PRIu64" "
                 "res %d type %d state %d", r->id, r->result, r->type,
                 r->state);
+    return;
 
+enomem:
+    r->result = MSG_OOM_ERROR;
+    r->state = state;
+    errno = ENOMEM;
 }
 
 /*
@@ -1765,7 +1843,7 @@ redis_parse_rsp(struct msg *r)
             } else if (ch == '-') {
                 ;
             } else if (isdigit(ch)) {
-                r->integer = r->integer * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->integer) - 1;
             } else {
                 goto error;
             }
@@ -1778,6 +1856,7 @@ redis_parse_rsp(struct msg *r)
                 break;
 
             default:
+                p = redis_find_cr(p + 1, b->last) - 1;
                 break;
             }
 
@@ -1807,7 +1886,7 @@ redis_parse_rsp(struct msg *r)
                 /* handles null bulk reply = '$-1' */
                 state = SW_RUNTO_CRLF;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == CR) {
                 if ((p - r->token) <= 1) {
                     goto error;
@@ -1836,6 +1915,7 @@ redis_parse_rsp(struct msg *r)
             m = p + r->rlen;
             if (m >= b->last) {
                 r->rlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->rlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m;
                 break;
@@ -1875,7 +1955,7 @@ redis_parse_rsp(struct msg *r)
             } else if (ch == '-') {
                 state = SW_RUNTO_CRLF;
             } else if (isdigit(ch)) {
-                r->rnarg = r->rnarg * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rnarg) - 1;
             } else if (ch == CR) {
                 if ((p - r->token) <= 1) {
                     goto error;
@@ -1924,7 +2004,7 @@ redis_parse_rsp(struct msg *r)
                 r->token = p;
                 r->rlen = 0;
             } else if (isdigit(ch)) {
-                r->rlen = r->rlen * 10 + (uint32_t)(ch - '0');
+                p = redis_scan_digits(p, b->last, &r->rlen) - 1;
             } else if (ch == '-') {
                 ;
             } else if (ch == CR) {
@@ -1964,6 +2044,7 @@ redis_parse_rsp(struct msg *r)
             m = p + r->rlen;
             if (m >= b->last) {
                 r->rlen -= (uint32_t)(b->last - p);
+                r->vlen_rem = r->rlen + CRLF_LEN;
                 m = b->last - 1;
                 p = m;
                 break;
@@ -2045,76 +2126,61 @@ error:
 }
 
 /*
- * Pre-split copy handler invoked when the request is a multi vector -
- * 'mget' or 'del' request and is about to be split into two requests
+ * Build frag as the part of the multi-key request r - 'mget' or 'del' - that
+ * holds the keys r->frag_map puts in fragment fid, in request order
  */
-void
-redis_pre_splitcopy(struct mbuf *mbuf, void *arg)
+rstatus_t
+redis_fragment(struct msg *r, struct msg *frag, uint32_t fid)
 {
-    struct msg *r = arg;
-    int n;
+    struct keypos *kpos;
+    uint32_t i, nkey, keylen;
+    uint8_t hdr[64], *p;
+    size_t n;
 
     ASSERT(r->request);
-    ASSERT(r->narg > 1);
-    ASSERT(mbuf_empty(mbuf));
-
-    switch (r->type) {
-    case MSG_REQ_REDIS_MGET:
-        n = dn_snprintf(mbuf->last, mbuf_size(mbuf), "*%d\r\n$4\r\nmget\r\n",
-                        r->narg - 1);
-        break;
+    ASSERT(r->type == MSG_REQ_REDIS_MGET || r->type == MSG_REQ_REDIS_DEL);
+    ASSERT(array_n(r->keys) == array_n(r->frag_map));
 
-    case MSG_REQ_REDIS_DEL:
-        n = dn_snprintf(mbuf->last, mbuf_size(mbuf), "*%d\r\n$3\r\ndel\r\n",
-                        r->narg - 1);
-        break;
+    for (nkey = 0, i = 0; i < array_n(r->frag_map); i++) {
+        if (*(uint32_t *)array_get(r->frag_map, i) == fid) {
+            nkey++;
+        }
+    }
 
-    default:
-        n = 0;
-        NOT_REACHED();
+    n = (size_t)dn_scnprintf(hdr, sizeof(hdr), "*%"PRIu32"\r\n%s", nkey + 1,
+                             r->type == MSG_REQ_REDIS_MGET ? "$4\r\nmget\r\n" :
+                             "$3\r\ndel\r\n");
+    p = msg_reserve(frag, n);
+    if (p == NULL) {
+        return DN_ENOMEM;
     }
+    dn_memcpy(p, hdr, n);
 
-    mbuf->last += n;
-}
+    for (i = 0; i < array_n(r->keys); i++) {
+        if (*(uint32_t *)array_get(r->frag_map, i) != fid) {
+            continue;
+        }
 
-/*
- * Post-split copy handler invoked when the request is a multi vector -
- * 'mget' or 'del' request and has already been split into two requests
- */
-rstatus_t
-redis_post_splitcopy(struct msg *r)
-{
-    struct mbuf *hbuf, *nhbuf;         /* head mbuf and new head mbuf */
-    struct string hstr = string("*2"); /* header string */
+        kpos = array_get(r->keys, i);
+        keylen = (uint32_t)(kpos->end - kpos->start);
 
-    ASSERT(r->request);
-    ASSERT(r->type == MSG_REQ_REDIS_MGET || r->type == MSG_REQ_REDIS_DEL);
-    ASSERT(!STAILQ_EMPTY(&r->mhdr));
+        /* a key and its length go in one mbuf, so that the key can be routed on */
+        n = (size_t)dn_scnprintf(hdr, sizeof(hdr), "$%"PRIu32"\r\n", keylen);
+        p = msg_reserve(frag, n + keylen + CRLF_LEN);
+        if (p == NULL) {
+            return DN_ENOMEM;
+        }
+        dn_memcpy(p, hdr, n);
+        dn_memcpy(p + n, kpos->start, keylen);
+        dn_memcpy(p + n + keylen, CRLF, CRLF_LEN);
 
-    nhbuf = mbuf_get();
-    if (nhbuf == NULL) {
-        return DN_ENOMEM;
+        if (frag->key_start == NULL) {
+            frag->key_start = p + n;
+            frag->key_end = p + n + keylen;
+        }
     }
 
-    /*
-     * Fix the head mbuf in the head (A) msg. The fix is straightforward
-     * as we just need to skip over the narg token
-     */
-    hbuf = STAILQ_FIRST(&r->mhdr);
-    ASSERT(hbuf->pos == r->narg_start);
-    ASSERT(hbuf->pos < r->narg_end && r->narg_end <= hbuf->last);
-    hbuf->pos = r->narg_end;
-
-    /*
-     * Add a new head mbuf in the head (A) msg that just contains '*2'
-     * token
-     */
-    STAILQ_INSERT_HEAD(&r->mhdr, nhbuf, next);
-    mbuf_copy(nhbuf, hstr.data, hstr.len);
-
-    /* fix up the narg_start and narg_end */
-    r->narg_start = nhbuf->pos;
-    r->narg_end = nhbuf->last;
+    frag->narg = nkey + 1;
 
     return DN_OK;
 }
@@ -2204,6 +2270,170 @@ redis_pre_coalesce(struct msg *r)
     }
 }
 
+/*
+ * Reference the bulk at (*mbuf, *pos) of a multi-bulk reply from out without
+ * copying it, and move past it
+ */
+static rstatus_t
+redis_ref_bulk(struct mbuf **mbuf, uint8_t **pos, struct mhdr *out)
+{
+    struct mbuf *b, *sb, *rbuf;
+    uint8_t *p, *sp, ch;
+    size_t hlen, len, n;
+    bool nil;
+
+    b = *mbuf;
+    p = *pos;
+
+    while (b != NULL && p == b->last) {
+        b = STAILQ_NEXT(b, next);
+        p = (b != NULL) ? b->pos : NULL;
+    }
+
+    if (b == NULL || *p != '$') {
+        return DN_ERROR;
+    }
+
+    /* '$<len>\r\n' or '$-1\r\n', which can span mbufs */
+    sb = b;
+    sp = p;
+    hlen = 0;
+    len = 0;
+    nil = false;
+    do {
+        while (p == b->last) {
+            b = STAILQ_NEXT(b, next);
+            if (b == NULL) {
+                return DN_ERROR;
+            }
+            p = b->pos;
+        }
+
+        ch = *p++;
+        hlen++;
+        if (isdigit(ch)) {
+            len = len * 10 + (size_t)(ch - '0');
+        } else if (ch == '-') {
+            nil = true;
+        }
+    } while (ch != LF);
+
+    len = nil ? hlen : hlen + len + CRLF_LEN;
+
+    for (b = sb, p = sp; len > 0; p += n, len -= n) {
+        while (p == b->last) {
+            b = STAILQ_NEXT(b, next);
+            if (b == NULL) {
+                return DN_ERROR;
+            }
+            p = b->pos;
+        }
+
+        n = MIN(len, (size_t)(b->last - p));
+
+        rbuf = mbuf_ref(b);
+        if (rbuf == NULL) {
+            return DN_ENOMEM;
+        }
+        rbuf->start = rbuf->pos = p;
+        rbuf->last = rbuf->end = rbuf->end_extra = p + n;
+        mbuf_insert(out, rbuf);
+    }
+
+    *mbuf = b;
+    *pos = p;
+
+    return DN_OK;
+}
+
+/*
+ * Put the bulks of the replies to the fragments of 'mget' r back in the order
+ * of its keys. They are referenced from the reply to the first fragment,
+ * after the count in its head mbuf; the replies they came in are left empty.
+ */
+static rstatus_t
+redis_coalesce_mget(struct msg *r)
+{
+    struct {
+        struct msg  *rsp;
+        struct mbuf *mbuf;
+        uint8_t     *pos;
+    } *frag;
+    struct mhdr out;
+    struct msg *cmsg, *pr;
+    struct mbuf *mbuf, *hbuf;
+    uint32_t i, j, nfrag;
+    rstatus_t status;
+
+    ASSERT(r->first_fragment && r->frag_map != NULL);
+
+    frag = dn_alloc(r->nfrag * sizeof(*frag));
+    if (frag == NULL) {
+        return DN_ENOMEM;
+    }
+
+    STAILQ_INIT(&out);
+    hbuf = STAILQ_FIRST(&r->peer->mhdr);
+
+    for (nfrag = 0, cmsg = r; nfrag < r->nfrag && cmsg != NULL &&
+         cmsg->frag_id == r->frag_id; nfrag++, cmsg = TAILQ_NEXT(cmsg, c_tqe)) {
+        pr = cmsg->peer;
+        if (cmsg->error || pr == NULL) {
+            status = DN_ERROR;
+            goto done;
+        }
+
+        mbuf = (pr == r->peer) ? STAILQ_NEXT(hbuf, next) : STAILQ_FIRST(&pr->mhdr);
+        frag[nfrag].rsp = pr;
+        frag[nfrag].mbuf = mbuf;
+        frag[nfrag].pos = (mbuf != NULL) ? mbuf->pos : NULL;
+    }
+
+    if (nfrag != r->nfrag) {
+        status = DN_ERROR;
+        goto done;
+    }
+
+    for (i = 0; i < array_n(r->frag_map); i++) {
+        j = *(uint32_t *)array_get(r->frag_map, i);
+        ASSERT(j < nfrag);
+
+        status = redis_ref_bulk(&frag[j].mbuf, &frag[j].pos, &out);
+        if (status != DN_OK) {
+            goto done;
+        }
+    }
+
+    for (j = 0; j < nfrag; j++) {
+        pr = frag[j].rsp;
+        STAILQ_FOREACH(mbuf, &pr->mhdr, next) {
+            if (mbuf != hbuf) {
+                mbuf->pos = mbuf->last;
+            }
+        }
+        pr->mlen = 0;
+    }
+
+    pr = r->peer;
+    pr->mlen = mbuf_length(hbuf);
+    STAILQ_FOREACH(mbuf, &out, next) {
+        pr->mlen += mbuf_length(mbuf);
+    }
+    STAILQ_CONCAT(&pr->mhdr, &out);
+
+    status = DN_OK;
+
+done:
+    while (!STAILQ_EMPTY(&out)) {
+        mbuf = STAILQ_FIRST(&out);
+        mbuf_remove(&out, mbuf);
+        mbuf_put(mbuf);
+    }
+    dn_free(frag);
+
+    return status;
+}
+
 /*
  * Post-coalesce handler is invoked when the message is a response to
  * the fragmented multi vector request - 'mget' or 'del' and all the
@@ -2215,6 +2445,7 @@ redis_post_coalesce(struct msg *r)
 {
     struct msg *pr = r->peer; /* peer response */
     struct mbuf *mbuf;
+    rstatus_t status;
     int n;
 
     ASSERT(r->request && r->first_fragment);
@@ -2247,9 +2478,16 @@ redis_post_coalesce(struct msg *r)
         mbuf = STAILQ_FIRST(&pr->mhdr);
         ASSERT(mbuf_empty(mbuf));
 
-        n = dn_scnprintf(mbuf->last, mbuf_size(mbuf), "*%d\r\n", r->nfrag);
+        n = dn_scnprintf(mbuf->last, mbuf_size(mbuf), "*%"PRIu32"\r\n",
+                         array_n(r->frag_map));
         mbuf->last += n;
         pr->mlen += (uint32_t)n;
+
+        status = redis_coalesce_mget(r);
+        if (status != DN_OK) {
+            r->error = 1;
+            r->err = (status == DN_ENOMEM) ? ENOMEM : EINVAL;
+        }
         break;
 
     default: